@@ -21,8 +21,8 @@
  * OF THIS SOFTWARE.
  */
 
-/* cliptest: for debugging calculate_edges() function, which is copied
- * from compositor.c.
+/* cliptest: for debugging the vertex clipping shared with gl-renderer
+ * (src/vertex-clipping.c).
  * controls:
  *	clip box position: mouse left drag, keys: w a s d
  *	clip box size: mouse right drag, keys: i j k l
@@ -41,13 +41,12 @@
 #include <time.h>
 #include <pixman.h>
 #include <cairo.h>
-#include <float.h>
-#include <assert.h>
 
 #include <linux/input.h>
 #include <wayland-client.h>
 
 #include "window.h"
+#include "../src/vertex-clipping.h"
 
 typedef float GLfloat;
 
@@ -79,372 +78,32 @@ weston_surface_to_global_float(struct weston_surface *surface,
 	*y = -g->s * sx + g->c * sy;
 }
 
-/* ---------------------- copied begins -----------------------*/
-
-struct polygon8 {
-	GLfloat x[8];
-	GLfloat y[8];
-	int n;
-};
-
-struct clip_context {
-	struct {
-		GLfloat x;
-		GLfloat y;
-	} prev;
-
-	struct {
-		GLfloat x1, y1;
-		GLfloat x2, y2;
-	} clip;
-
-	struct {
-		GLfloat *x;
-		GLfloat *y;
-	} vertices;
-};
-
-static GLfloat
-float_difference(GLfloat a, GLfloat b)
-{
-	/* http://www.altdevblogaday.com/2012/02/22/comparing-floating-point-numbers-2012-edition/ */
-	static const GLfloat max_diff = 4.0f * FLT_MIN;
-	static const GLfloat max_rel_diff = 4.0e-5;
-	GLfloat diff = a - b;
-	GLfloat adiff = fabsf(diff);
-
-	if (adiff <= max_diff)
-		return 0.0f;
-
-	a = fabsf(a);
-	b = fabsf(b);
-	if (adiff <= (a > b ? a : b) * max_rel_diff)
-		return 0.0f;
-
-	return diff;
-}
-
-/* A line segment (p1x, p1y)-(p2x, p2y) intersects the line x = x_arg.
- * Compute the y coordinate of the intersection.
- */
-static GLfloat
-clip_intersect_y(GLfloat p1x, GLfloat p1y, GLfloat p2x, GLfloat p2y,
-		 GLfloat x_arg)
-{
-	GLfloat a;
-	GLfloat diff = float_difference(p1x, p2x);
-
-	/* Practically vertical line segment, yet the end points have already
-	 * been determined to be on different sides of the line. Therefore
-	 * the line segment is part of the line and intersects everywhere.
-	 * Return the end point, so we use the whole line segment.
-	 */
-	if (diff == 0.0f)
-		return p2y;
-
-	a = (x_arg - p2x) / diff;
-	return p2y + (p1y - p2y) * a;
-}
-
-/* A line segment (p1x, p1y)-(p2x, p2y) intersects the line y = y_arg.
- * Compute the x coordinate of the intersection.
- */
-static GLfloat
-clip_intersect_x(GLfloat p1x, GLfloat p1y, GLfloat p2x, GLfloat p2y,
-		 GLfloat y_arg)
-{
-	GLfloat a;
-	GLfloat diff = float_difference(p1y, p2y);
-
-	/* Practically horizontal line segment, yet the end points have already
-	 * been determined to be on different sides of the line. Therefore
-	 * the line segment is part of the line and intersects everywhere.
-	 * Return the end point, so we use the whole line segment.
-	 */
-	if (diff == 0.0f)
-		return p2x;
-
-	a = (y_arg - p2y) / diff;
-	return p2x + (p1x - p2x) * a;
-}
-
-enum path_transition {
-	PATH_TRANSITION_OUT_TO_OUT = 0,
-	PATH_TRANSITION_OUT_TO_IN = 1,
-	PATH_TRANSITION_IN_TO_OUT = 2,
-	PATH_TRANSITION_IN_TO_IN = 3,
-};
-
-static void
-clip_append_vertex(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	*ctx->vertices.x++ = x;
-	*ctx->vertices.y++ = y;
-}
-
-static enum path_transition
-path_transition_left_edge(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	return ((ctx->prev.x >= ctx->clip.x1) << 1) | (x >= ctx->clip.x1);
-}
-
-static enum path_transition
-path_transition_right_edge(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	return ((ctx->prev.x < ctx->clip.x2) << 1) | (x < ctx->clip.x2);
-}
-
-static enum path_transition
-path_transition_top_edge(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	return ((ctx->prev.y >= ctx->clip.y1) << 1) | (y >= ctx->clip.y1);
-}
-
-static enum path_transition
-path_transition_bottom_edge(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	return ((ctx->prev.y < ctx->clip.y2) << 1) | (y < ctx->clip.y2);
-}
-
-static void
-clip_polygon_leftright(struct clip_context *ctx,
-		       enum path_transition transition,
-		       GLfloat x, GLfloat y, GLfloat clip_x)
-{
-	GLfloat yi;
-
-	switch (transition) {
-	case PATH_TRANSITION_IN_TO_IN:
-		clip_append_vertex(ctx, x, y);
-		break;
-	case PATH_TRANSITION_IN_TO_OUT:
-		yi = clip_intersect_y(ctx->prev.x, ctx->prev.y, x, y, clip_x);
-		clip_append_vertex(ctx, clip_x, yi);
-		break;
-	case PATH_TRANSITION_OUT_TO_IN:
-		yi = clip_intersect_y(ctx->prev.x, ctx->prev.y, x, y, clip_x);
-		clip_append_vertex(ctx, clip_x, yi);
-		clip_append_vertex(ctx, x, y);
-		break;
-	case PATH_TRANSITION_OUT_TO_OUT:
-		/* nothing */
-		break;
-	default:
-		assert(0 && "bad enum path_transition");
-	}
-
-	ctx->prev.x = x;
-	ctx->prev.y = y;
-}
-
-static void
-clip_polygon_topbottom(struct clip_context *ctx,
-		       enum path_transition transition,
-		       GLfloat x, GLfloat y, GLfloat clip_y)
-{
-	GLfloat xi;
-
-	switch (transition) {
-	case PATH_TRANSITION_IN_TO_IN:
-		clip_append_vertex(ctx, x, y);
-		break;
-	case PATH_TRANSITION_IN_TO_OUT:
-		xi = clip_intersect_x(ctx->prev.x, ctx->prev.y, x, y, clip_y);
-		clip_append_vertex(ctx, xi, clip_y);
-		break;
-	case PATH_TRANSITION_OUT_TO_IN:
-		xi = clip_intersect_x(ctx->prev.x, ctx->prev.y, x, y, clip_y);
-		clip_append_vertex(ctx, xi, clip_y);
-		clip_append_vertex(ctx, x, y);
-		break;
-	case PATH_TRANSITION_OUT_TO_OUT:
-		/* nothing */
-		break;
-	default:
-		assert(0 && "bad enum path_transition");
-	}
-
-	ctx->prev.x = x;
-	ctx->prev.y = y;
-}
-
-static void
-clip_context_prepare(struct clip_context *ctx, const struct polygon8 *src,
-		      GLfloat *dst_x, GLfloat *dst_y)
-{
-	ctx->prev.x = src->x[src->n - 1];
-	ctx->prev.y = src->y[src->n - 1];
-	ctx->vertices.x = dst_x;
-	ctx->vertices.y = dst_y;
-}
-
-static int
-clip_polygon_left(struct clip_context *ctx, const struct polygon8 *src,
-		  GLfloat *dst_x, GLfloat *dst_y)
-{
-	enum path_transition trans;
-	int i;
-
-	clip_context_prepare(ctx, src, dst_x, dst_y);
-	for (i = 0; i < src->n; i++) {
-		trans = path_transition_left_edge(ctx, src->x[i], src->y[i]);
-		clip_polygon_leftright(ctx, trans, src->x[i], src->y[i],
-				       ctx->clip.x1);
-	}
-	return ctx->vertices.x - dst_x;
-}
-
-static int
-clip_polygon_right(struct clip_context *ctx, const struct polygon8 *src,
-		   GLfloat *dst_x, GLfloat *dst_y)
-{
-	enum path_transition trans;
-	int i;
-
-	clip_context_prepare(ctx, src, dst_x, dst_y);
-	for (i = 0; i < src->n; i++) {
-		trans = path_transition_right_edge(ctx, src->x[i], src->y[i]);
-		clip_polygon_leftright(ctx, trans, src->x[i], src->y[i],
-				       ctx->clip.x2);
-	}
-	return ctx->vertices.x - dst_x;
-}
-
-static int
-clip_polygon_top(struct clip_context *ctx, const struct polygon8 *src,
-		 GLfloat *dst_x, GLfloat *dst_y)
-{
-	enum path_transition trans;
-	int i;
-
-	clip_context_prepare(ctx, src, dst_x, dst_y);
-	for (i = 0; i < src->n; i++) {
-		trans = path_transition_top_edge(ctx, src->x[i], src->y[i]);
-		clip_polygon_topbottom(ctx, trans, src->x[i], src->y[i],
-				       ctx->clip.y1);
-	}
-	return ctx->vertices.x - dst_x;
-}
-
-static int
-clip_polygon_bottom(struct clip_context *ctx, const struct polygon8 *src,
-		    GLfloat *dst_x, GLfloat *dst_y)
-{
-	enum path_transition trans;
-	int i;
-
-	clip_context_prepare(ctx, src, dst_x, dst_y);
-	for (i = 0; i < src->n; i++) {
-		trans = path_transition_bottom_edge(ctx, src->x[i], src->y[i]);
-		clip_polygon_topbottom(ctx, trans, src->x[i], src->y[i],
-				       ctx->clip.y2);
-	}
-	return ctx->vertices.x - dst_x;
-}
-
-#define max(a, b) (((a) > (b)) ? (a) : (b))
-#define min(a, b) (((a) > (b)) ? (b) : (a))
-#define clip(x, a, b)  min(max(x, a), b)
-
 /*
  * Compute the boundary vertices of the intersection of the global coordinate
  * aligned rectangle 'rect', and an arbitrary quadrilateral produced from
  * 'surf_rect' when transformed from surface coordinates into global coordinates.
- * The vertices are written to 'ex' and 'ey', and the return value is the
- * number of vertices. Vertices are produced in clockwise winding order.
- * Guarantees to produce either zero vertices, or 3-8 vertices with non-zero
- * polygon area.
+ * This is what gl-renderer's texture_region() does for each pair of rects,
+ * with the clipping itself done by the shared vertex-clipping.c.
  */
 static int
 calculate_edges(struct weston_surface *es, pixman_box32_t *rect,
 		pixman_box32_t *surf_rect, GLfloat *ex, GLfloat *ey)
 {
-	struct polygon8 polygon;
-	struct clip_context ctx;
-	int i, n;
-	GLfloat min_x, max_x, min_y, max_y;
+	int i;
 	struct polygon8 surf = {
 		{ surf_rect->x1, surf_rect->x2, surf_rect->x2, surf_rect->x1 },
 		{ surf_rect->y1, surf_rect->y1, surf_rect->y2, surf_rect->y2 },
 		4
 	};
 
-	ctx.clip.x1 = rect->x1;
-	ctx.clip.y1 = rect->y1;
-	ctx.clip.x2 = rect->x2;
-	ctx.clip.y2 = rect->y2;
-
 	/* transform surface to screen space: */
 	for (i = 0; i < surf.n; i++)
 		weston_surface_to_global_float(es, surf.x[i], surf.y[i],
 					       &surf.x[i], &surf.y[i]);
 
-	/* find bounding box: */
-	min_x = max_x = surf.x[0];
-	min_y = max_y = surf.y[0];
-
-	for (i = 1; i < surf.n; i++) {
-		min_x = min(min_x, surf.x[i]);
-		max_x = max(max_x, surf.x[i]);
-		min_y = min(min_y, surf.y[i]);
-		max_y = max(max_y, surf.y[i]);
-	}
-
-	/* First, simple bounding box check to discard early transformed
-	 * surface rects that do not intersect with the clip region:
-	 */
-	if ((min_x >= ctx.clip.x2) || (max_x <= ctx.clip.x1) ||
-	    (min_y >= ctx.clip.y2) || (max_y <= ctx.clip.y1))
-		return 0;
-
-	/* Simple case, bounding box edges are parallel to surface edges,
-	 * there will be only four edges.  We just need to clip the surface
-	 * vertices to the clip rect bounds:
-	 */
-	if (!es->transform.enabled) {
-		for (i = 0; i < surf.n; i++) {
-			ex[i] = clip(surf.x[i], ctx.clip.x1, ctx.clip.x2);
-			ey[i] = clip(surf.y[i], ctx.clip.y1, ctx.clip.y2);
-		}
-		return surf.n;
-	}
-
-	/* Transformed case: use a general polygon clipping algorithm to
-	 * clip the surface rectangle with each side of 'rect'.
-	 * The algorithm is Sutherland-Hodgman, as explained in
-	 * http://www.codeguru.com/cpp/misc/misc/graphics/article.php/c8965/Polygon-Clipping.htm
-	 * but without looking at any of that code.
-	 */
-	polygon.n = clip_polygon_left(&ctx, &surf, polygon.x, polygon.y);
-	surf.n = clip_polygon_right(&ctx, &polygon, surf.x, surf.y);
-	polygon.n = clip_polygon_top(&ctx, &surf, polygon.x, polygon.y);
-	surf.n = clip_polygon_bottom(&ctx, &polygon, surf.x, surf.y);
-
-	/* Get rid of duplicate vertices */
-	ex[0] = surf.x[0];
-	ey[0] = surf.y[0];
-	n = 1;
-	for (i = 1; i < surf.n; i++) {
-		if (float_difference(ex[n - 1], surf.x[i]) == 0.0f &&
-		    float_difference(ey[n - 1], surf.y[i]) == 0.0f)
-			continue;
-		ex[n] = surf.x[i];
-		ey[n] = surf.y[i];
-		n++;
-	}
-	if (float_difference(ex[n - 1], surf.x[0]) == 0.0f &&
-	    float_difference(ey[n - 1], surf.y[0]) == 0.0f)
-		n--;
-
-	if (n < 3)
-		return 0;
-
-	return n;
+	return clip_quad(&surf, es->transform.enabled, rect, ex, ey);
 }
 
-
-/* ---------------------- copied ends -----------------------*/
-
 static void
 geometry_set_phi(struct geometry *g, float phi)
 {
@@ -844,8 +503,8 @@ read_timer(void)
 	       1e-9 * (t.tv_nsec - begin_time.tv_nsec);
 }
 
-static int
-benchmark(void)
+static void
+benchmark_single(void)
 {
 	struct weston_surface surface;
 	struct geometry geom;
@@ -877,10 +536,134 @@ benchmark(void)
 	t = read_timer();
 
 	printf("%d calls took %g s, average %g us/call\n", N, t, t / N * 1e6);
+}
+
+/* The batch clipper may start a polygon from a different vertex. */
+static int
+same_polygon(const GLfloat *ax, const GLfloat *ay,
+	     const GLfloat *bx, const GLfloat *by, int n)
+{
+	int r, i, k;
+
+	for (r = 0; r < n; r++) {
+		for (i = 0; i < n; i++) {
+			k = (i + r) % n;
+			if (fabsf(ax[k] - bx[i]) > 1e-3f ||
+			    fabsf(ay[k] - by[i]) > 1e-3f)
+				break;
+		}
+		if (i == n)
+			return 1;
+	}
+
+	return 0;
+}
+
+#define GRID_CELL 16
+#define GRID_SIZE 32
+#define GRID_RECTS (GRID_SIZE * GRID_SIZE)
+
+/* Fragmented damage, a grid of small rects like a terminal or a busy
+ * client produces, clipped against one rotated surface: one
+ * clip_quad() call per rect versus a single clip_quad_boxes(). */
+static int
+benchmark_grid(void)
+{
+	static pixman_box32_t boxes[GRID_RECTS];
+	static GLfloat ex[GRID_RECTS * 8], ey[GRID_RECTS * 8];
+	static GLfloat bx[GRID_RECTS * 8], by[GRID_RECTS * 8];
+	static int counts[GRID_RECTS], single_counts[GRID_RECTS];
+	struct weston_surface surface;
+	struct geometry geom;
+	struct polygon8 quad;
+	int i, j, r, n, nsingle = 0, npolygons = 0, nvtx, off;
+	double t_single, t_batch;
+	const int N = 2000;
+	const int half = GRID_SIZE * GRID_CELL / 2;
+
+	for (i = 0; i < GRID_SIZE; i++) {
+		for (j = 0; j < GRID_SIZE; j++) {
+			boxes[i * GRID_SIZE + j].x1 = j * GRID_CELL - half;
+			boxes[i * GRID_SIZE + j].y1 = i * GRID_CELL - half;
+			boxes[i * GRID_SIZE + j].x2 =
+				(j + 1) * GRID_CELL - half - 1;
+			boxes[i * GRID_SIZE + j].y2 =
+				(i + 1) * GRID_CELL - half - 1;
+		}
+	}
+
+	geom.surf.x1 = -half * 3 / 4;
+	geom.surf.y1 = -half * 3 / 4;
+	geom.surf.x2 = half * 3 / 4;
+	geom.surf.y2 = half * 3 / 4;
+	geometry_set_phi(&geom, 0.3);
+
+	surface.transform.enabled = 1;
+	surface.geometry = &geom;
+
+	quad.x[0] = quad.x[3] = geom.surf.x1;
+	quad.x[1] = quad.x[2] = geom.surf.x2;
+	quad.y[0] = quad.y[1] = geom.surf.y1;
+	quad.y[2] = quad.y[3] = geom.surf.y2;
+	quad.n = 4;
+	for (i = 0; i < quad.n; i++)
+		weston_surface_to_global_float(&surface, quad.x[i], quad.y[i],
+					       &quad.x[i], &quad.y[i]);
+
+	/* Both paths must produce the same polygons. */
+	nvtx = 0;
+	for (i = 0; i < GRID_RECTS; i++) {
+		n = clip_quad(&quad, 1, &boxes[i], ex + nvtx, ey + nvtx);
+		if (n > 0)
+			single_counts[nsingle++] = n;
+		nvtx += n;
+	}
+	npolygons = clip_quad_boxes(&quad, 1, boxes, GRID_RECTS,
+				    bx, by, counts);
+	if (npolygons != nsingle) {
+		fprintf(stderr, "batch clipping gave %d polygons, "
+			"expected %d\n", npolygons, nsingle);
+		return -1;
+	}
+	for (i = 0, off = 0; i < npolygons; off += counts[i], i++) {
+		if (counts[i] != single_counts[i] ||
+		    !same_polygon(ex + off, ey + off, bx + off, by + off,
+				  counts[i])) {
+			fprintf(stderr, "batch clipping mismatch at polygon "
+				"%d\n", i);
+			return -1;
+		}
+	}
+
+	reset_timer();
+	for (r = 0; r < N; r++)
+		for (i = 0; i < GRID_RECTS; i++)
+			clip_quad(&quad, 1, &boxes[i], ex, ey);
+	t_single = read_timer();
+
+	reset_timer();
+	for (r = 0; r < N; r++)
+		clip_quad_boxes(&quad, 1, boxes, GRID_RECTS, bx, by, counts);
+	t_batch = read_timer();
+
+	printf("%d damage rects against a rotated surface, %d visible:\n",
+	       GRID_RECTS, npolygons);
+	printf("  clip_quad:       %g us/rect\n",
+	       t_single / N / GRID_RECTS * 1e6);
+	printf("  clip_quad_boxes: %g us/rect (%.2fx)\n",
+	       t_batch / N / GRID_RECTS * 1e6, t_single / t_batch);
 
 	return 0;
 }
 
+static int
+benchmark(void)
+{
+	benchmark_single();
+
+	return benchmark_grid();
+}
+
 int
 main(int argc, char *argv[])
 {
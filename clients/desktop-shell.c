@@ -57,6 +57,13 @@ struct desktop {
 	struct widget *grab_widget;
 
 	enum cursor_type grab_cursor;
+
+	/* The decoded background-image, shared by all outputs.  Loaded
+	 * on first use and only once, even if that fails, unless a
+	 * bigger output needs more of it than was decoded. */
+	cairo_surface_t *background_image;
+	int background_image_loaded;
+	int background_image_width, background_image_height;
 };
 
 struct surface {
@@ -78,6 +85,10 @@ struct background {
 	struct surface base;
 	struct window *window;
 	struct widget *widget;
+	struct desktop *desktop;
+
+	/* background-image scaled to the output, for the "scale" type */
+	cairo_surface_t *scaled;
 };
 
 struct output {
@@ -104,6 +115,7 @@ struct panel_clock {
 	struct panel *panel;
 	struct task clock_task;
 	int clock_fd;
+	int refresh;	/* seconds between updates of the shown time */
 };
 
 struct unlock_dialog {
@@ -201,12 +213,10 @@ static void
 panel_launcher_redraw_handler(struct widget *widget, void *data)
 {
 	struct panel_launcher *launcher = data;
-	cairo_surface_t *surface;
 	struct rectangle allocation;
 	cairo_t *cr;
 
-	surface = window_get_surface(launcher->panel->window);
-	cr = cairo_create(surface);
+	cr = widget_cairo_create(widget);
 
 	widget_get_allocation(widget, &allocation);
 	if (launcher->pressed) {
@@ -251,18 +261,14 @@ set_hex_color(cairo_t *cr, uint32_t color)
 static void
 panel_redraw_handler(struct widget *widget, void *data)
 {
-	cairo_surface_t *surface;
 	cairo_t *cr;
-	struct panel *panel = data;
 
-	surface = window_get_surface(panel->window);
-	cr = cairo_create(surface);
+	cr = widget_cairo_create(widget);
 	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
 	set_hex_color(cr, key_panel_color);
 	cairo_paint(cr);
 
 	cairo_destroy(cr);
-	cairo_surface_destroy(surface);
 }
 
 static int
@@ -302,23 +308,57 @@ panel_launcher_button_handler(struct widget *widget,
 		panel_launcher_activate(launcher);
 }
 
+/* Arm the timer for the next time the shown time changes, that is the
+ * next multiple of clock->refresh seconds of wall clock time.  It is
+ * re-armed on every expiry, so it follows changes to the wall clock
+ * instead of drifting from it. */
+static int
+clock_timer_reset(struct panel_clock *clock)
+{
+	struct itimerspec its;
+	struct timespec now;
+
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	its.it_interval.tv_sec = 0;
+	its.it_interval.tv_nsec = 0;
+	its.it_value.tv_sec = clock->refresh - now.tv_sec % clock->refresh;
+	its.it_value.tv_nsec = 0;
+	if (now.tv_nsec > 0) {
+		its.it_value.tv_sec--;
+		its.it_value.tv_nsec = 1000000000 - now.tv_nsec;
+	}
+	if (timerfd_settime(clock->clock_fd, 0, &its, NULL) < 0) {
+		fprintf(stderr, "could not set timerfd\n: %m");
+		return -1;
+	}
+
+	return 0;
+}
+
 static void
 clock_func(struct task *task, uint32_t events)
 {
 	struct panel_clock *clock =
 		container_of(task, struct panel_clock, clock_task);
+	struct rectangle allocation;
 	uint64_t exp;
 
 	if (read(clock->clock_fd, &exp, sizeof exp) != sizeof exp)
 		abort();
-	widget_schedule_redraw(clock->widget);
+	clock_timer_reset(clock);
+
+	/* Only the clock changes; the rest of the panel stays as it is
+	 * in the buffer. */
+	widget_get_allocation(clock->widget, &allocation);
+	widget_schedule_redraw_area(clock->widget,
+				    allocation.x, allocation.y,
+				    allocation.width, allocation.height);
 }
 
 static void
 panel_clock_redraw_handler(struct widget *widget, void *data)
 {
-	cairo_surface_t *surface;
-	struct panel_clock *clock = data;
 	cairo_t *cr;
 	struct rectangle allocation;
 	cairo_text_extents_t extents;
@@ -335,8 +375,7 @@ panel_clock_redraw_handler(struct widget *widget, void *data)
 	if (allocation.width == 0)
 		return;
 
-	surface = window_get_surface(clock->panel->window);
-	cr = cairo_create(surface);
+	cr = widget_cairo_create(widget);
 	cairo_select_font_face(cr, "sans",
 			       CAIRO_FONT_SLANT_NORMAL,
 			       CAIRO_FONT_WEIGHT_NORMAL);
@@ -354,23 +393,6 @@ panel_clock_redraw_handler(struct widget *widget, void *data)
 	cairo_destroy(cr);
 }
 
-static int
-clock_timer_reset(struct panel_clock *clock)
-{
-	struct itimerspec its;
-
-	its.it_interval.tv_sec = 60;
-	its.it_interval.tv_nsec = 0;
-	its.it_value.tv_sec = 60;
-	its.it_value.tv_nsec = 0;
-	if (timerfd_settime(clock->clock_fd, 0, &its, NULL) < 0) {
-		fprintf(stderr, "could not set timerfd\n: %m");
-		return -1;
-	}
-
-	return 0;
-}
-
 static void
 panel_destroy_clock(struct panel_clock *clock)
 {
@@ -398,6 +420,7 @@ panel_add_clock(struct panel *panel)
 	clock->panel = panel;
 	panel->clock = clock;
 	clock->clock_fd = timerfd;
+	clock->refresh = 60;
 
 	clock->clock_task.run = clock_func;
 	display_watch_fd(window_get_display(panel->window), clock->clock_fd,
@@ -625,15 +648,106 @@ enum {
 	BACKGROUND_TILE
 };
 
+/* Get background-image decoded for scaling to width x height, or at
+ * full size if width and height are 0.  The image is shared by all
+ * outputs, so it is decoded for the largest size asked for so far,
+ * and outputs of different sizes don't keep reloading it. */
+static cairo_surface_t *
+desktop_get_background_image(struct desktop *desktop, int width, int height)
+{
+	if (desktop->background_image_loaded &&
+	    desktop->background_image_width > 0 &&
+	    (width == 0 || width > desktop->background_image_width ||
+	     height > desktop->background_image_height)) {
+		if (desktop->background_image)
+			cairo_surface_destroy(desktop->background_image);
+		desktop->background_image = NULL;
+		desktop->background_image_loaded = 0;
+
+		if (width > 0 && width < desktop->background_image_width)
+			width = desktop->background_image_width;
+		if (width > 0 && height < desktop->background_image_height)
+			height = desktop->background_image_height;
+	}
+
+	if (!desktop->background_image_loaded && key_background_image) {
+		desktop->background_image =
+			load_cairo_surface_at_size(key_background_image,
+						   width, height);
+		desktop->background_image_loaded = 1;
+		desktop->background_image_width = width;
+		desktop->background_image_height = height;
+	}
+
+	return desktop->background_image;
+}
+
+/* Scale 'image' to width x height.  Bilinear filtering only looks at
+ * the four nearest source pixels, so a large downscale is done in
+ * halving steps first to keep every source pixel contributing. */
+static cairo_surface_t *
+scale_image(cairo_surface_t *image, int width, int height)
+{
+	cairo_surface_t *source, *scaled;
+	cairo_pattern_t *pattern;
+	cairo_matrix_t matrix;
+	cairo_t *cr;
+	int sw, sh, w, h;
+
+	source = cairo_surface_reference(image);
+	sw = cairo_image_surface_get_width(image);
+	sh = cairo_image_surface_get_height(image);
+
+	do {
+		w = sw / 2 >= width ? sw / 2 : width;
+		h = sh / 2 >= height ? sh / 2 : height;
+
+		scaled = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, w, h);
+		cr = cairo_create(scaled);
+		pattern = cairo_pattern_create_for_surface(source);
+		cairo_matrix_init_scale(&matrix,
+					(double) sw / w, (double) sh / h);
+		cairo_pattern_set_matrix(pattern, &matrix);
+		cairo_pattern_set_filter(pattern, CAIRO_FILTER_BEST);
+		cairo_pattern_set_extend(pattern, CAIRO_EXTEND_PAD);
+		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+		cairo_set_source(cr, pattern);
+		cairo_paint(cr);
+		cairo_pattern_destroy(pattern);
+		cairo_destroy(cr);
+
+		cairo_surface_destroy(source);
+		source = scaled;
+		sw = w;
+		sh = h;
+	} while (w != width || h != height);
+
+	return scaled;
+}
+
+static cairo_surface_t *
+background_get_scaled(struct background *background,
+		      cairo_surface_t *image, int width, int height)
+{
+	if (background->scaled &&
+	    cairo_image_surface_get_width(background->scaled) == width &&
+	    cairo_image_surface_get_height(background->scaled) == height)
+		return background->scaled;
+
+	if (background->scaled)
+		cairo_surface_destroy(background->scaled);
+	background->scaled = scale_image(image, width, height);
+
+	return background->scaled;
+}
+
 static void
 background_draw(struct widget *widget, void *data)
 {
 	struct background *background = data;
 	cairo_surface_t *surface, *image;
 	cairo_pattern_t *pattern;
-	cairo_matrix_t matrix;
 	cairo_t *cr;
-	double sx, sy;
 	struct rectangle allocation;
 	int type = -1;
 	struct display *display;
@@ -643,13 +757,8 @@ background_draw(struct widget *widget, void *data)
 
 	cr = cairo_create(surface);
 	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
-	cairo_set_source_rgba(cr, 0.0, 0.0, 0.2, 1.0);
-	cairo_paint(cr);
 
 	widget_get_allocation(widget, &allocation);
-	image = NULL;
-	if (key_background_image)
-		image = load_cairo_surface(key_background_image);
 
 	if (strcmp(key_background_type, "scale") == 0)
 		type = BACKGROUND_SCALE;
@@ -659,24 +768,30 @@ background_draw(struct widget *widget, void *data)
 		fprintf(stderr, "invalid background-type: %s\n",
 			key_background_type);
 
+	/* Scaled, the image only needs decoding at the output size. */
+	if (type == BACKGROUND_SCALE)
+		image = desktop_get_background_image(background->desktop,
+						     allocation.width,
+						     allocation.height);
+	else
+		image = desktop_get_background_image(background->desktop,
+						     0, 0);
+
 	if (image && type != -1) {
-		pattern = cairo_pattern_create_for_surface(image);
 		switch (type) {
 		case BACKGROUND_SCALE:
-			sx = (double) cairo_image_surface_get_width(image) /
-				allocation.width;
-			sy = (double) cairo_image_surface_get_height(image) /
-				allocation.height;
-			cairo_matrix_init_scale(&matrix, sx, sy);
-			cairo_pattern_set_matrix(pattern, &matrix);
+			image = background_get_scaled(background, image,
+						      allocation.width,
+						      allocation.height);
+			cairo_set_source_surface(cr, image, 0, 0);
 			break;
 		case BACKGROUND_TILE:
+			pattern = cairo_pattern_create_for_surface(image);
 			cairo_pattern_set_extend(pattern, CAIRO_EXTEND_REPEAT);
+			cairo_set_source(cr, pattern);
+			cairo_pattern_destroy(pattern);
 			break;
 		}
-		cairo_set_source(cr, pattern);
-		cairo_pattern_destroy (pattern);
-		cairo_surface_destroy(image);
 	} else {
 		set_hex_color(cr, key_background_color);
 	}
@@ -943,6 +1058,8 @@ background_destroy(struct background *background)
 	widget_destroy(background->widget);
 	window_destroy(background->window);
 
+	if (background->scaled)
+		cairo_surface_destroy(background->scaled);
 	free(background);
 }
 
@@ -955,6 +1072,7 @@ background_create(struct desktop *desktop)
 	memset(background, 0, sizeof *background);
 
 	background->base.configure = background_configure;
+	background->desktop = desktop;
 	background->window = window_create_custom(desktop->display);
 	background->widget = window_add_widget(background->window, background);
 	window_set_user_data(background->window, background);
@@ -1134,6 +1252,8 @@ int main(int argc, char *argv[])
 	/* Cleanup */
 	grab_surface_destroy(&desktop);
 	desktop_destroy_outputs(&desktop);
+	if (desktop.background_image)
+		cairo_surface_destroy(desktop.background_image);
 	if (desktop.unlock_dialog)
 		unlock_dialog_destroy(desktop.unlock_dialog);
 	desktop_shell_destroy(desktop.shell);
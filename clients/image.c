@@ -31,6 +31,8 @@
 #include <unistd.h>
 #include <math.h>
 #include <time.h>
+#include <pthread.h>
+#include <sys/epoll.h>
 #include <cairo.h>
 #include <assert.h>
 #include <linux/input.h>
@@ -40,6 +42,28 @@
 #include "window.h"
 #include "../shared/cairo-util.h"
 
+/* The preview is decoded to at least this size in each direction. */
+#define PREVIEW_SIZE 256
+
+/* Mipmap levels stop halving once they are this small. */
+#define MIN_LEVEL_SIZE 64
+#define MAX_LEVELS 16
+
+enum decode_stage {
+	DECODE_PREVIEW,
+	DECODE_FULL,
+	DECODE_LEVEL,
+	DECODE_FAILED,
+	DECODE_DONE
+};
+
+/* What the decoder thread sends over its pipe.  The surface, if any,
+ * belongs to the receiver. */
+struct decode_message {
+	enum decode_stage stage;
+	cairo_surface_t *surface;
+};
+
 struct image {
 	struct window *window;
 	struct widget *widget;
@@ -47,6 +71,20 @@ struct image {
 	char *filename;
 	cairo_surface_t *image;
 	int fullscreen;
+
+	/* The image is decoded on a thread, so the window shows up
+	 * right away: first a low resolution preview where that is
+	 * cheap, then the full image, and then smaller and smaller
+	 * copies of it, so that zoomed out redraws read far less. */
+	pthread_t decoder;
+	int decoding;
+	volatile int cancel;
+	int decode_fd[2];
+	struct task decode_task;
+	cairo_surface_t *preview;
+	cairo_surface_t *levels[MAX_LEVELS];	/* levels[0] is image */
+	int nlevels;
+
 	int *image_counter;
 	int32_t width, height;
 
@@ -101,41 +139,83 @@ clamp_view(struct image *image)
 	}
 }
 
+static double
+get_fit_scale(double width, double height, struct rectangle *allocation)
+{
+	double doc_aspect, window_aspect;
+
+	doc_aspect = width / height;
+	window_aspect = (double) allocation->width / allocation->height;
+	if (doc_aspect < window_aspect)
+		return allocation->height / height;
+	else
+		return allocation->width / width;
+}
+
+/* The smallest level that still has at least one pixel for every
+ * pixel it is drawn to. */
+static int
+get_level(struct image *image, double scale)
+{
+	int i = 0;
+
+	while (i + 1 < image->nlevels && scale * (2 << i) <= 1.0)
+		i++;
+
+	return i;
+}
+
+static void
+draw_preview(struct image *image, cairo_t *cr, struct rectangle *allocation)
+{
+	double width, height, scale;
+
+	width = cairo_image_surface_get_width(image->preview);
+	height = cairo_image_surface_get_height(image->preview);
+	scale = get_fit_scale(width, height, allocation);
+
+	cairo_translate(cr, (allocation->width - width * scale) / 2,
+			(allocation->height - height * scale) / 2);
+	cairo_scale(cr, scale, scale);
+	cairo_set_source_surface(cr, image->preview, 0, 0);
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+	cairo_paint(cr);
+}
+
 static void
 redraw_handler(struct widget *widget, void *data)
 {
 	struct image *image = data;
 	struct rectangle allocation;
 	cairo_t *cr;
-	cairo_surface_t *surface;
-	double width, height, doc_aspect, window_aspect, scale;
+	cairo_surface_t *level;
+	double width, height, scale;
 	cairo_matrix_t matrix;
 	cairo_matrix_t translate;
 
-	surface = window_get_surface(image->window);
-	cr = cairo_create(surface);
+	cr = widget_cairo_create(image->widget);
 	widget_get_allocation(image->widget, &allocation);
 	cairo_rectangle(cr, allocation.x, allocation.y,
 			allocation.width, allocation.height);
 	cairo_clip(cr);
-	cairo_push_group(cr);
 	cairo_translate(cr, allocation.x, allocation.y);
 
 	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
 	cairo_set_source_rgba(cr, 0, 0, 0, 1);
 	cairo_paint(cr);
 
+	if (!image->image) {
+		if (image->preview)
+			draw_preview(image, cr, &allocation);
+		cairo_destroy(cr);
+		return;
+	}
+
 	if (!image->initialized) {
 		image->initialized = true;
 		width = cairo_image_surface_get_width(image->image);
 		height = cairo_image_surface_get_height(image->image);
-
-		doc_aspect = width / height;
-		window_aspect = (double) allocation.width / allocation.height;
-		if (doc_aspect < window_aspect)
-			scale = allocation.height / height;
-		else
-			scale = allocation.width / width;
+		scale = get_fit_scale(width, height, &allocation);
 
 		image->width = width;
 		image->height = height;
@@ -149,15 +229,18 @@ redraw_handler(struct widget *widget, void *data)
 	cairo_matrix_multiply(&matrix, &matrix, &translate);
 	cairo_set_matrix(cr, &matrix);
 
-	cairo_set_source_surface(cr, image->image, 0, 0);
+	level = image->levels[get_level(image, get_scale(image))];
+	cairo_scale(cr,
+		    (double) image->width /
+		    cairo_image_surface_get_width(level),
+		    (double) image->height /
+		    cairo_image_surface_get_height(level));
+
+	cairo_set_source_surface(cr, level, 0, 0);
 	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
 	cairo_paint(cr);
 
-	cairo_pop_group_to_source(cr);
-	cairo_paint(cr);
 	cairo_destroy(cr);
-
-	cairo_surface_destroy(surface);
 }
 
 static void
@@ -336,9 +419,159 @@ fullscreen_handler(struct window *window, void *data)
 }
 
 static void
-close_handler(struct window *window, void *data)
+decode_send(struct image *image,
+	    enum decode_stage stage, cairo_surface_t *surface)
+{
+	struct decode_message message = { stage, surface };
+
+	/* Messages are smaller than PIPE_BUF, so this is atomic, and
+	 * too few to ever fill the pipe. */
+	if (write(image->decode_fd[1], &message, sizeof message) < 0)
+		fprintf(stderr, "failed to send decoded image: %m\n");
+}
+
+static int
+is_jpeg(const char *filename)
+{
+	unsigned char header[2];
+	FILE *fp;
+	int ret;
+
+	fp = fopen(filename, "rb");
+	if (!fp)
+		return 0;
+	ret = fread(header, sizeof header, 1, fp) == 1 &&
+		header[0] == 0xff && header[1] == 0xd8;
+	fclose(fp);
+
+	return ret;
+}
+
+/* Average each 2x2 block of source into one pixel. */
+static cairo_surface_t *
+downscale_half(cairo_surface_t *source)
+{
+	cairo_surface_t *level;
+	uint32_t *s0, *s1, *d, p, q, r, t, lo, hi;
+	uint8_t *src, *dst;
+	int width, height, src_stride, dst_stride, x, y;
+
+	width = cairo_image_surface_get_width(source) / 2;
+	height = cairo_image_surface_get_height(source) / 2;
+	level = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, width, height);
+	if (cairo_surface_status(level) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(level);
+		return NULL;
+	}
+
+	src = cairo_image_surface_get_data(source);
+	src_stride = cairo_image_surface_get_stride(source);
+	dst = cairo_image_surface_get_data(level);
+	dst_stride = cairo_image_surface_get_stride(level);
+
+	for (y = 0; y < height; y++) {
+		s0 = (uint32_t *) (src + 2 * y * src_stride);
+		s1 = (uint32_t *) (src + (2 * y + 1) * src_stride);
+		d = (uint32_t *) (dst + y * dst_stride);
+		for (x = 0; x < width; x++) {
+			p = s0[2 * x];
+			q = s0[2 * x + 1];
+			r = s1[2 * x];
+			t = s1[2 * x + 1];
+
+			/* Two channels at a time, in 16 bit lanes */
+			lo = (p & 0x00ff00ff) + (q & 0x00ff00ff) +
+				(r & 0x00ff00ff) + (t & 0x00ff00ff) +
+				0x00020002;
+			hi = ((p >> 8) & 0x00ff00ff) +
+				((q >> 8) & 0x00ff00ff) +
+				((r >> 8) & 0x00ff00ff) +
+				((t >> 8) & 0x00ff00ff) + 0x00020002;
+			d[x] = ((lo >> 2) & 0x00ff00ff) |
+				((hi >> 2) & 0x00ff00ff) << 8;
+		}
+	}
+
+	cairo_surface_mark_dirty(level);
+
+	return level;
+}
+
+static void *
+decode_thread(void *data)
 {
 	struct image *image = data;
+	cairo_surface_t *surface, *level;
+	int i;
+
+	/* A JPEG decodes at 1/8 scale for a fraction of the full cost;
+	 * other formats would pay for a second full decode. */
+	if (is_jpeg(image->filename)) {
+		surface = load_cairo_surface_at_size(image->filename,
+						     PREVIEW_SIZE,
+						     PREVIEW_SIZE);
+		if (surface)
+			decode_send(image, DECODE_PREVIEW, surface);
+	}
+
+	surface = load_cairo_surface(image->filename);
+	if (!surface) {
+		decode_send(image, DECODE_FAILED, NULL);
+		return NULL;
+	}
+	/* Keep a reference to each level until the next one is made
+	 * from it; the main thread may drop its own at any time. */
+	decode_send(image, DECODE_FULL, cairo_surface_reference(surface));
+
+	for (i = 1; i < MAX_LEVELS && !image->cancel; i++) {
+		if (cairo_image_surface_get_width(surface) <= MIN_LEVEL_SIZE ||
+		    cairo_image_surface_get_height(surface) <= MIN_LEVEL_SIZE)
+			break;
+
+		level = downscale_half(surface);
+		if (!level)
+			break;
+		cairo_surface_destroy(surface);
+		surface = level;
+		decode_send(image, DECODE_LEVEL,
+			    cairo_surface_reference(surface));
+	}
+
+	cairo_surface_destroy(surface);
+	decode_send(image, DECODE_DONE, NULL);
+
+	return NULL;
+}
+
+static void
+decode_finish(struct image *image)
+{
+	pthread_join(image->decoder, NULL);
+	display_unwatch_fd(image->display, image->decode_fd[0]);
+	close(image->decode_fd[0]);
+	close(image->decode_fd[1]);
+	image->decoding = 0;
+}
+
+static void
+image_destroy(struct image *image)
+{
+	struct decode_message message;
+	int i;
+
+	/* Wait for the decoder, dropping whatever it still sends. */
+	if (image->decoding) {
+		image->cancel = 1;
+		do {
+			if (read(image->decode_fd[0], &message,
+				 sizeof message) != sizeof message)
+				break;
+			if (message.surface)
+				cairo_surface_destroy(message.surface);
+		} while (message.stage != DECODE_DONE &&
+			 message.stage != DECODE_FAILED);
+		decode_finish(image);
+	}
 
 	*image->image_counter -= 1;
 
@@ -348,9 +581,65 @@ close_handler(struct window *window, void *data)
 	widget_destroy(image->widget);
 	window_destroy(image->window);
 
+	for (i = 0; i < image->nlevels; i++)
+		cairo_surface_destroy(image->levels[i]);
+	if (image->preview)
+		cairo_surface_destroy(image->preview);
+	free(image->filename);
 	free(image);
 }
 
+static void
+decode_func(struct task *task, uint32_t events)
+{
+	struct image *image = container_of(task, struct image, decode_task);
+	struct decode_message message;
+
+	if (read(image->decode_fd[0], &message,
+		 sizeof message) != sizeof message)
+		return;
+
+	switch (message.stage) {
+	case DECODE_PREVIEW:
+		image->preview = message.surface;
+		window_schedule_redraw(image->window);
+		break;
+	case DECODE_FULL:
+		image->image = message.surface;
+		image->levels[0] = message.surface;
+		image->nlevels = 1;
+		if (image->preview) {
+			cairo_surface_destroy(image->preview);
+			image->preview = NULL;
+		}
+		window_schedule_redraw(image->window);
+		break;
+	case DECODE_LEVEL:
+		image->levels[image->nlevels++] = message.surface;
+		if (image->initialized &&
+		    get_level(image, get_scale(image)) == image->nlevels - 1)
+			window_schedule_redraw(image->window);
+		break;
+	case DECODE_FAILED:
+		fprintf(stderr, "could not load the image %s!\n",
+			image->filename);
+		decode_finish(image);
+		image_destroy(image);
+		break;
+	case DECODE_DONE:
+		decode_finish(image);
+		break;
+	}
+}
+
+static void
+close_handler(struct window *window, void *data)
+{
+	struct image *image = data;
+
+	image_destroy(image);
+}
+
 static struct image *
 image_create(struct display *display, const char *filename,
 	     int *image_counter)
@@ -369,10 +658,10 @@ image_create(struct display *display, const char *filename,
 	free(copy);
 
 	image->filename = strdup(filename);
-	image->image = load_cairo_surface(filename);
 
-	if (!image->image) {
-		fprintf(stderr, "could not find the image %s!\n", b);
+	if (pipe(image->decode_fd) < 0) {
+		fprintf(stderr, "could not create decoder pipe: %m\n");
+		free(image->filename);
 		free(image);
 		return NULL;
 	}
@@ -400,6 +689,20 @@ image_create(struct display *display, const char *filename,
 	window_set_key_handler(image->window, key_handler);
 	widget_schedule_resize(image->widget, 500, 400);
 
+	image->decode_task.run = decode_func;
+	display_watch_fd(display, image->decode_fd[0], EPOLLIN,
+			 &image->decode_task);
+	image->decoding = 1;
+	if (pthread_create(&image->decoder, NULL, decode_thread, image) != 0) {
+		fprintf(stderr, "could not start decoder thread\n");
+		image->decoding = 0;
+		display_unwatch_fd(display, image->decode_fd[0]);
+		close(image->decode_fd[0]);
+		close(image->decode_fd[1]);
+		image_destroy(image);
+		return NULL;
+	}
+
 	return image;
 }
 
@@ -0,0 +1,375 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "scrollback.h"
+
+/*
+ * A row is stored as
+ *
+ *	varint width
+ *	varint nruns, then nruns times: varint length, 4 attribute bytes
+ *	varint ncells, then the UTF-8 text of the first ncells cells
+ *
+ * where ncells excludes trailing empty cells and an empty cell inside
+ * the row is a single zero byte.  Rows are packed back to back into
+ * chunks; a chunk keeps the offset of each of its rows so reading a
+ * row back doesn't need to decode its neighbours.
+ */
+
+#define CHUNK_SIZE		(64 * 1024)
+#define CHUNK_MAX_ROWS		2048
+#define MAX_WIDTH		4096
+#define CELL_SIZE		4
+
+struct chunk {
+	uint64_t first_row;
+	int nrows;
+	int used;
+	uint16_t offset[CHUNK_MAX_ROWS];
+	uint8_t data[CHUNK_SIZE];
+};
+
+struct scrollback {
+	int max_rows;
+	uint64_t next_row;	/* number of rows ever pushed */
+	uint64_t first_row;	/* oldest row still stored */
+
+	/* Ring of chunks, oldest first. */
+	struct chunk **chunks;
+	int head, nchunks, size;
+
+	struct chunk *spare;
+};
+
+static uint8_t *
+put_varint(uint8_t *p, uint32_t v)
+{
+	while (v >= 0x80) {
+		*p++ = v | 0x80;
+		v >>= 7;
+	}
+	*p++ = v;
+
+	return p;
+}
+
+static const uint8_t *
+get_varint(const uint8_t *p, uint32_t *v)
+{
+	uint32_t r = 0;
+	int shift = 0;
+
+	while (*p & 0x80) {
+		r |= (uint32_t) (*p++ & 0x7f) << shift;
+		shift += 7;
+	}
+	*v = r | (uint32_t) *p++ << shift;
+
+	return p;
+}
+
+/* Length of the UTF-8 sequence starting with 'lead', 0 for the zero
+ * byte of an empty cell, or -1 if 'lead' can't start a sequence. */
+static int
+sequence_length(uint8_t lead)
+{
+	if (lead == 0)
+		return 0;
+	else if (lead < 0x80)
+		return 1;
+	else if ((lead & 0xe0) == 0xc0)
+		return 2;
+	else if ((lead & 0xf0) == 0xe0)
+		return 3;
+	else if ((lead & 0xf8) == 0xf0)
+		return 4;
+	else
+		return -1;
+}
+
+static struct chunk *
+chunk_at(struct scrollback *sb, int i)
+{
+	return sb->chunks[(sb->head + i) % sb->size];
+}
+
+static int
+append_chunk(struct scrollback *sb)
+{
+	struct chunk **chunks, *chunk;
+	int i, size;
+
+	if (sb->nchunks == sb->size) {
+		size = sb->size ? sb->size * 2 : 16;
+		chunks = malloc(size * sizeof *chunks);
+		if (!chunks)
+			return -1;
+		for (i = 0; i < sb->nchunks; i++)
+			chunks[i] = chunk_at(sb, i);
+		free(sb->chunks);
+		sb->chunks = chunks;
+		sb->head = 0;
+		sb->size = size;
+	}
+
+	if (sb->spare) {
+		chunk = sb->spare;
+		sb->spare = NULL;
+	} else {
+		chunk = malloc(sizeof *chunk);
+		if (!chunk)
+			return -1;
+	}
+
+	chunk->first_row = sb->next_row;
+	chunk->nrows = 0;
+	chunk->used = 0;
+	sb->chunks[(sb->head + sb->nchunks) % sb->size] = chunk;
+	sb->nchunks++;
+
+	return 0;
+}
+
+/* Drop whole chunks from the front while what remains still covers
+ * max_rows.  The chunk is kept around for the next append, so a full
+ * history cycles between its chunks without allocating. */
+static void
+evict(struct scrollback *sb)
+{
+	struct chunk *oldest;
+
+	while (sb->nchunks > 1) {
+		oldest = sb->chunks[sb->head];
+		if (sb->next_row - oldest->first_row - oldest->nrows <
+		    (uint64_t) sb->max_rows)
+			break;
+
+		sb->head = (sb->head + 1) % sb->size;
+		sb->nchunks--;
+		sb->first_row = chunk_at(sb, 0)->first_row;
+
+		if (sb->spare)
+			free(oldest);
+		else
+			sb->spare = oldest;
+	}
+
+	if (sb->next_row - sb->first_row > (uint64_t) sb->max_rows)
+		sb->first_row = sb->next_row - sb->max_rows;
+}
+
+struct scrollback *
+scrollback_create(int max_rows)
+{
+	struct scrollback *sb;
+
+	sb = calloc(1, sizeof *sb);
+	if (!sb)
+		return NULL;
+
+	sb->max_rows = max_rows > 0 ? max_rows : 0;
+
+	return sb;
+}
+
+void
+scrollback_destroy(struct scrollback *sb)
+{
+	int i;
+
+	for (i = 0; i < sb->nchunks; i++)
+		free(chunk_at(sb, i));
+	free(sb->chunks);
+	free(sb->spare);
+	free(sb);
+}
+
+static int
+encode_row(uint8_t *out, const uint8_t *text, const uint8_t *attr,
+	   int width)
+{
+	static const uint8_t replacement[] = { 0xef, 0xbf, 0xbd };
+	uint8_t *p = out;
+	uint32_t nruns;
+	int i, start, ncells, n;
+
+	p = put_varint(p, width);
+
+	nruns = 0;
+	for (i = 0; i < width; i++)
+		if (i == 0 || memcmp(attr + i * CELL_SIZE,
+				     attr + (i - 1) * CELL_SIZE, CELL_SIZE))
+			nruns++;
+	p = put_varint(p, nruns);
+
+	for (start = 0; start < width; start = i) {
+		for (i = start + 1; i < width; i++)
+			if (memcmp(attr + i * CELL_SIZE,
+				   attr + start * CELL_SIZE, CELL_SIZE))
+				break;
+		p = put_varint(p, i - start);
+		memcpy(p, attr + start * CELL_SIZE, CELL_SIZE);
+		p += CELL_SIZE;
+	}
+
+	ncells = width;
+	while (ncells > 0 && text[(ncells - 1) * CELL_SIZE] == 0)
+		ncells--;
+	p = put_varint(p, ncells);
+
+	for (i = 0; i < ncells; i++) {
+		n = sequence_length(text[i * CELL_SIZE]);
+		if (n < 0) {
+			memcpy(p, replacement, sizeof replacement);
+			p += sizeof replacement;
+		} else if (n == 0) {
+			*p++ = 0;
+		} else {
+			memcpy(p, text + i * CELL_SIZE, n);
+			p += n;
+		}
+	}
+
+	return p - out;
+}
+
+void
+scrollback_push(struct scrollback *sb,
+		const void *text, const void *attr, int width)
+{
+	struct chunk *chunk = NULL;
+	int worst;
+
+	if (sb->max_rows == 0)
+		return;
+
+	if (width > MAX_WIDTH)
+		width = MAX_WIDTH;
+	if (width < 0)
+		width = 0;
+
+	/* Three varints, and per cell at most a run header and four
+	 * bytes of text. */
+	worst = 16 + width * (5 + CELL_SIZE);
+
+	if (sb->nchunks > 0)
+		chunk = chunk_at(sb, sb->nchunks - 1);
+	if (!chunk || chunk->nrows == CHUNK_MAX_ROWS ||
+	    chunk->used + worst > CHUNK_SIZE) {
+		if (append_chunk(sb) < 0)
+			return;
+		chunk = chunk_at(sb, sb->nchunks - 1);
+	}
+
+	chunk->offset[chunk->nrows++] = chunk->used;
+	chunk->used += encode_row(chunk->data + chunk->used,
+				  text, attr, width);
+	sb->next_row++;
+
+	evict(sb);
+}
+
+int
+scrollback_rows(struct scrollback *sb)
+{
+	return sb->next_row - sb->first_row;
+}
+
+static struct chunk *
+find_chunk(struct scrollback *sb, uint64_t row)
+{
+	struct chunk *chunk;
+	int lo = 0, hi = sb->nchunks - 1, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		chunk = chunk_at(sb, mid);
+		if (chunk->first_row <= row)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+
+	return chunk_at(sb, lo);
+}
+
+int
+scrollback_get(struct scrollback *sb, int n,
+	       void *text, void *attr, int width, const void *fill_attr)
+{
+	struct chunk *chunk;
+	const uint8_t *p;
+	uint8_t *t = text, *a = attr;
+	uint32_t stored, nruns, len, ncells;
+	uint64_t row;
+	int i, x, count;
+
+	if (n < 0 || n >= scrollback_rows(sb))
+		return -1;
+
+	row = sb->next_row - 1 - n;
+	chunk = find_chunk(sb, row);
+	p = chunk->data + chunk->offset[row - chunk->first_row];
+
+	p = get_varint(p, &stored);
+
+	p = get_varint(p, &nruns);
+	for (x = 0, i = 0; i < (int) nruns; i++) {
+		p = get_varint(p, &len);
+		for (; len > 0 && x < width; len--, x++)
+			memcpy(a + x * CELL_SIZE, p, CELL_SIZE);
+		p += CELL_SIZE;
+	}
+	for (; x < width; x++)
+		memcpy(a + x * CELL_SIZE, fill_attr, CELL_SIZE);
+
+	memset(t, 0, (size_t) width * CELL_SIZE);
+	p = get_varint(p, &ncells);
+	if ((int) ncells > width)
+		ncells = width;
+	for (x = 0; x < (int) ncells; x++) {
+		count = sequence_length(*p);
+		if (count <= 0)
+			count = 1;
+		if (*p != 0)
+			memcpy(t + x * CELL_SIZE, p, count);
+		p += count;
+	}
+
+	return 0;
+}
+
+size_t
+scrollback_memory(struct scrollback *sb)
+{
+	size_t size;
+
+	size = sizeof *sb + sb->size * sizeof *sb->chunks;
+	size += (sb->nchunks + (sb->spare != NULL)) * sizeof(struct chunk);
+
+	return size;
+}
@@ -0,0 +1,66 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _SCROLLBACK_H_
+#define _SCROLLBACK_H_
+
+#include <stddef.h>
+
+/*
+ * Terminal history.  Rows that scroll off the top of the terminal are
+ * packed into fixed size chunks: the attributes run length encoded,
+ * the text as plain UTF-8 with trailing empty cells dropped.  Pushing
+ * a row and dropping the oldest rows past the configured depth are
+ * constant time, and memory is bounded by the depth.
+ *
+ * Rows are passed as 'width' text cells and 'width' attribute cells
+ * of four bytes each: the text cells hold NUL padded UTF-8 sequences,
+ * the attribute cells are only compared and copied.
+ */
+
+struct scrollback;
+
+struct scrollback *
+scrollback_create(int max_rows);
+
+void
+scrollback_destroy(struct scrollback *sb);
+
+void
+scrollback_push(struct scrollback *sb,
+		const void *text, const void *attr, int width);
+
+/* The number of rows that can be read back. */
+int
+scrollback_rows(struct scrollback *sb);
+
+/* Read back row 'n', counting from 0 for the most recently pushed
+ * row.  Cells past the stored width get empty text and 'fill_attr'.
+ * Returns -1 if there is no such row. */
+int
+scrollback_get(struct scrollback *sb, int n,
+	       void *text, void *attr, int width, const void *fill_attr);
+
+size_t
+scrollback_memory(struct scrollback *sb);
+
+#endif
@@ -221,9 +221,9 @@ redraw_handler(struct widget *widget, void *data)
 
 	cairo_surface_destroy(surface);
 
+	/* The toolkit attaches, damages and commits once we return. */
 	callback = wl_surface_frame(window_get_wl_surface(smoke->window));
 	wl_callback_add_listener(callback, &listener, smoke);
-	wl_surface_commit(window_get_wl_surface(smoke->window));
 }
 
 static int
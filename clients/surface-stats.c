@@ -0,0 +1,131 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <wayland-client.h>
+#include "surface-stats-client-protocol.h"
+
+struct stats {
+	struct wl_display *display;
+	struct wl_registry *registry;
+	struct surface_stats *surface_stats;
+	int done;
+};
+
+static void
+stats_handle_surface(void *data, struct surface_stats *surface_stats,
+		     uint32_t pid, int32_t width, int32_t height,
+		     uint32_t commits, uint32_t commit_rate,
+		     uint32_t attach_rate, uint32_t damage_rate,
+		     uint32_t upload_rate, uint32_t composite_rate)
+{
+	printf("%8u %5dx%-5d %10u %8u %8u %12u %12u %12u\n",
+	       pid, width, height, commits, commit_rate, attach_rate,
+	       damage_rate, upload_rate, composite_rate);
+}
+
+static void
+stats_handle_done(void *data, struct surface_stats *surface_stats)
+{
+	struct stats *stats = data;
+
+	stats->done = 1;
+}
+
+static const struct surface_stats_listener stats_listener = {
+	stats_handle_surface,
+	stats_handle_done
+};
+
+static void
+global_handler(void *data, struct wl_registry *registry, uint32_t id,
+	       const char *interface, uint32_t version)
+{
+	struct stats *stats = data;
+
+	if (strcmp(interface, "surface_stats") == 0) {
+		stats->surface_stats =
+			wl_registry_bind(registry, id,
+					 &surface_stats_interface, 1);
+		surface_stats_add_listener(stats->surface_stats,
+					   &stats_listener, stats);
+	}
+}
+
+static void
+global_remove_handler(void *data, struct wl_registry *registry,
+		      uint32_t name)
+{
+}
+
+static const struct wl_registry_listener registry_listener = {
+	global_handler,
+	global_remove_handler
+};
+
+int
+main(int argc, char *argv[])
+{
+	struct stats stats;
+	int interval = 0;
+
+	if (argc > 1)
+		interval = atoi(argv[1]);
+
+	memset(&stats, 0, sizeof stats);
+	stats.display = wl_display_connect(NULL);
+	if (!stats.display) {
+		fprintf(stderr, "failed to create display: %m\n");
+		return -1;
+	}
+
+	stats.registry = wl_display_get_registry(stats.display);
+	wl_registry_add_listener(stats.registry, &registry_listener, &stats);
+	wl_display_roundtrip(stats.display);
+
+	if (!stats.surface_stats) {
+		fprintf(stderr, "display doesn't support surface_stats, "
+			"is weston running with --surface-stats?\n");
+		return -1;
+	}
+
+	do {
+		printf("%8s %11s %10s %8s %8s %12s %12s %12s\n",
+		       "pid", "size", "commits", "commit/s", "attach/s",
+		       "damage px/s", "upload B/s", "compos px/s");
+
+		stats.done = 0;
+		surface_stats_dump(stats.surface_stats);
+		while (!stats.done)
+			if (wl_display_dispatch(stats.display) < 0)
+				return -1;
+
+		if (interval > 0)
+			sleep(interval);
+	} while (interval > 0);
+
+	return 0;
+}
@@ -32,18 +32,27 @@
 #include <pty.h>
 #include <ctype.h>
 #include <cairo.h>
+#include <errno.h>
 #include <sys/epoll.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include <wayland-client.h>
 
 #include "../shared/config-parser.h"
+#include "../shared/timespec-util.h"
 #include "window.h"
+#include "scrollback.h"
 
 static int option_fullscreen;
 static char *option_font = "mono";
 static int option_font_size = 14;
 static char *option_term = "xterm";
 static char *option_shell;
+static char *option_benchmark;
+static int option_scrollback_lines = 10000;
 
 static struct wl_list terminal_list;
 
@@ -68,6 +77,12 @@ terminal_run(struct terminal *terminal, const char *path);
 #define MAX_RESPONSE		256
 #define MAX_ESCAPE		255
 
+#define READ_BUFFER_SIZE	(64 * 1024)
+/* How long io_handler() keeps draining the pty before going back to
+ * the main loop, so that frame callbacks and input are still handled
+ * while a program floods the terminal. */
+#define READ_BUDGET_NSEC	(8 * 1000 * 1000)
+
 /* Terminal modes */
 #define MODE_SHOW_CURSOR	0x00000001
 #define MODE_INVERSE		0x00000002
@@ -332,6 +347,10 @@ struct attr {
 			*    cilub */
 	char s;        /* in selection */
 };
+union decoded_attr {
+	struct attr attr;
+	uint32_t key;
+};
 struct color_scheme {
 	struct terminal_color palette[16];
 	char border;
@@ -418,6 +437,33 @@ struct terminal {
 	int selection_start_row, selection_start_col;
 	int selection_end_row, selection_end_col;
 	struct wl_list link;
+
+	/* The cell grid as last rendered, and a snapshot of the rows it
+	 * was rendered from, so redraw_handler() only renders the rows
+	 * that changed since.  Full screen scrolls move both along
+	 * instead of invalidating them. */
+	cairo_surface_t *cache_surface;
+	int cache_width, cache_height;
+	union utf8_char *cache_data;
+	union decoded_attr *cache_attr;
+	union decoded_attr *decoded_row;
+	char *cache_row_valid;
+	int scroll_pending;
+	int outline_row;
+
+	/* Rows scrolled off the top, and how far back the view is
+	 * scrolled into them.  history_data and history_attr hold a
+	 * row read back for rendering. */
+	struct scrollback *scrollback;
+	int view_offset;
+	union utf8_char *history_data;
+	struct attr *history_attr;
+
+	/* --benchmark accounting */
+	struct timespec benchmark_start;
+	uint64_t bytes_read;
+	int64_t parse_nsec, render_nsec;
+	int frames;
 };
 
 /* Create default tab stops, every 8 characters */
@@ -510,34 +556,14 @@ terminal_get_attr_row(struct terminal *terminal, int row)
 	return &terminal->data_attr[index * terminal->width];
 }
 
-union decoded_attr {
-	struct attr attr;
-	uint32_t key;
-};
-
 static void
-terminal_decode_attr(struct terminal *terminal, int row, int col,
-		     union decoded_attr *decoded)
+decode_attr(struct terminal *terminal, struct attr attr,
+	    int selected, int cursor, union decoded_attr *decoded)
 {
-	struct attr attr;
 	int foreground, background, tmp;
 
-	decoded->attr.s = 0;
-	if (((row == terminal->selection_start_row &&
-	      col >= terminal->selection_start_col) ||
-	     row > terminal->selection_start_row) &&
-	    ((row == terminal->selection_end_row &&
-	      col < terminal->selection_end_col) ||
-	     row < terminal->selection_end_row))
-		decoded->attr.s = 1;
-
-	/* get the attributes for this character cell */
-	attr = terminal_get_attr_row(terminal, row)[col];
-	if ((attr.a & ATTRMASK_INVERSE) ||
-	    decoded->attr.s ||
-	    ((terminal->mode & MODE_SHOW_CURSOR) &&
-	     window_has_focus(terminal->window) && terminal->row == row &&
-	     terminal->column == col)) {
+	decoded->attr.s = selected;
+	if ((attr.a & ATTRMASK_INVERSE) || selected || cursor) {
 		foreground = attr.bg;
 		background = attr.fg;
 		if (attr.a & ATTRMASK_BOLD) {
@@ -564,13 +590,97 @@ terminal_decode_attr(struct terminal *terminal, int row, int col,
 	decoded->attr.a = attr.a;
 }
 
+static int
+terminal_cursor_column(struct terminal *terminal, int row)
+{
+	if ((terminal->mode & MODE_SHOW_CURSOR) &&
+	    window_has_focus(terminal->window) && terminal->row == row)
+		return terminal->column;
+
+	return -1;
+}
+
+static void
+terminal_decode_attr(struct terminal *terminal, int row, int col,
+		     union decoded_attr *decoded)
+{
+	int selected = 0;
+
+	if (((row == terminal->selection_start_row &&
+	      col >= terminal->selection_start_col) ||
+	     row > terminal->selection_start_row) &&
+	    ((row == terminal->selection_end_row &&
+	      col < terminal->selection_end_col) ||
+	     row < terminal->selection_end_row))
+		selected = 1;
+
+	/* get the attributes for this character cell */
+	decode_attr(terminal, terminal_get_attr_row(terminal, row)[col],
+		    selected, terminal_cursor_column(terminal, row) == col,
+		    decoded);
+}
+
+/* terminal_decode_attr() for a whole row, working out the selected
+ * columns and the cursor once. */
+static void
+terminal_decode_row(struct terminal *terminal, int row,
+		    union decoded_attr *decoded)
+{
+	struct attr *attr_row = terminal_get_attr_row(terminal, row);
+	int col, cursor, sel_start, sel_end;
+
+	if (row > terminal->selection_start_row)
+		sel_start = 0;
+	else if (row == terminal->selection_start_row)
+		sel_start = terminal->selection_start_col;
+	else
+		sel_start = terminal->width;
+
+	if (row < terminal->selection_end_row)
+		sel_end = terminal->width;
+	else if (row == terminal->selection_end_row)
+		sel_end = terminal->selection_end_col;
+	else
+		sel_end = 0;
+
+	cursor = terminal_cursor_column(terminal, row);
+
+	for (col = 0; col < terminal->width; col++)
+		decode_attr(terminal, attr_row[col],
+			    col >= sel_start && col < sel_end, col == cursor,
+			    &decoded[col]);
+}
 
 static void
 terminal_scroll_buffer(struct terminal *terminal, int d)
 {
-	int i;
+	int i, view_offset;
 
 	d = d % (terminal->height + 1);
+
+	if (d > 0 && terminal->scrollback) {
+		for (i = 0; i < d; i++)
+			scrollback_push(terminal->scrollback,
+					terminal_get_row(terminal, i),
+					terminal_get_attr_row(terminal, i),
+					terminal->width);
+	}
+
+	/* Keep a view scrolled back on the same rows while output
+	 * keeps coming in, as far as the history reaches. */
+	if (terminal->view_offset > 0) {
+		view_offset = terminal->view_offset + d;
+		if (view_offset > scrollback_rows(terminal->scrollback))
+			view_offset = scrollback_rows(terminal->scrollback);
+		if (view_offset < 0)
+			view_offset = 0;
+		terminal->scroll_pending += d - (view_offset -
+						 terminal->view_offset);
+		terminal->view_offset = view_offset;
+	} else {
+		terminal->scroll_pending += d;
+	}
+
 	terminal->start = (terminal->start + d) % terminal->height;
 	if (terminal->start < 0) terminal->start = terminal->height + terminal->start;
 	if(d < 0) {
@@ -741,6 +851,7 @@ terminal_resize_cells(struct terminal *terminal, int width, int height)
 	terminal->data = data;
 	terminal->data_attr = data_attr;
 	terminal->tab_ruler = tab_ruler;
+	terminal->view_offset = 0;
 	terminal_init_tabs(terminal);
 
 	/* Update the window size */
@@ -916,97 +1027,364 @@ glyph_run_add(struct glyph_run *run, int x, int y, union utf8_char *c)
 
 
 static void
-redraw_handler(struct widget *widget, void *data)
+terminal_free_cache(struct terminal *terminal)
 {
-	struct terminal *terminal = data;
-	struct rectangle allocation;
-	cairo_t *cr;
-	int top_margin, side_margin;
-	int row, col, cursor_x, cursor_y;
-	union utf8_char *p_row;
+	if (terminal->cache_surface)
+		cairo_surface_destroy(terminal->cache_surface);
+	free(terminal->cache_data);
+	free(terminal->cache_attr);
+	free(terminal->decoded_row);
+	free(terminal->cache_row_valid);
+	free(terminal->history_data);
+	free(terminal->history_attr);
+
+	terminal->cache_surface = NULL;
+	terminal->cache_data = NULL;
+	terminal->cache_attr = NULL;
+	terminal->decoded_row = NULL;
+	terminal->cache_row_valid = NULL;
+	terminal->history_data = NULL;
+	terminal->history_attr = NULL;
+}
+
+/* Returns 1 if the whole cache was invalidated or moved, 0 if only the
+ * rows that changed need repainting, -1 on allocation failure. */
+static int
+terminal_prepare_cache(struct terminal *terminal)
+{
+	int width = terminal->width, height = terminal->height;
+	int d, row_bytes;
+	unsigned char *pixels;
+
+	if (terminal->cache_surface &&
+	    terminal->cache_width == width &&
+	    terminal->cache_height == height) {
+		d = terminal->scroll_pending;
+		terminal->scroll_pending = 0;
+
+		if (d == 0)
+			return 0;
+
+		if (d >= height || -d >= height) {
+			memset(terminal->cache_row_valid, 0, height);
+			return 1;
+		}
+
+		cairo_surface_flush(terminal->cache_surface);
+		pixels = cairo_image_surface_get_data(terminal->cache_surface);
+		row_bytes = cairo_image_surface_get_stride(terminal->cache_surface) *
+			(int) terminal->extents.height;
+
+		if (d > 0) {
+			memmove(pixels, pixels + d * row_bytes,
+				(height - d) * row_bytes);
+			memmove(terminal->cache_data,
+				terminal->cache_data + d * width,
+				(height - d) * width *
+				sizeof *terminal->cache_data);
+			memmove(terminal->cache_attr,
+				terminal->cache_attr + d * width,
+				(height - d) * width *
+				sizeof *terminal->cache_attr);
+			memmove(terminal->cache_row_valid,
+				terminal->cache_row_valid + d, height - d);
+			memset(terminal->cache_row_valid + height - d, 0, d);
+		} else {
+			d = -d;
+			memmove(pixels + d * row_bytes, pixels,
+				(height - d) * row_bytes);
+			memmove(terminal->cache_data + d * width,
+				terminal->cache_data,
+				(height - d) * width *
+				sizeof *terminal->cache_data);
+			memmove(terminal->cache_attr + d * width,
+				terminal->cache_attr,
+				(height - d) * width *
+				sizeof *terminal->cache_attr);
+			memmove(terminal->cache_row_valid + d,
+				terminal->cache_row_valid, height - d);
+			memset(terminal->cache_row_valid, 0, d);
+		}
+
+		cairo_surface_mark_dirty(terminal->cache_surface);
+
+		return 1;
+	}
+
+	terminal_free_cache(terminal);
+	terminal->scroll_pending = 0;
+	terminal->cache_width = width;
+	terminal->cache_height = height;
+
+	terminal->cache_surface =
+		cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+					   width * terminal->extents.max_x_advance,
+					   height * terminal->extents.height);
+	terminal->cache_data = malloc(width * height *
+				      sizeof *terminal->cache_data);
+	terminal->cache_attr = malloc(width * height *
+				      sizeof *terminal->cache_attr);
+	terminal->decoded_row = malloc(width * sizeof *terminal->decoded_row);
+	terminal->cache_row_valid = calloc(height, 1);
+	terminal->history_data = malloc(width *
+					sizeof *terminal->history_data);
+	terminal->history_attr = malloc(width *
+					sizeof *terminal->history_attr);
+
+	if (cairo_surface_status(terminal->cache_surface) !=
+	    CAIRO_STATUS_SUCCESS || !terminal->cache_data ||
+	    !terminal->cache_attr || !terminal->decoded_row ||
+	    !terminal->cache_row_valid || !terminal->history_data ||
+	    !terminal->history_attr) {
+		terminal_free_cache(terminal);
+		return -1;
+	}
+
+	return 1;
+}
+
+/* Render the cells 'p_row' as display row 'row' of the back store,
+ * with the attributes decoded by terminal_decode_row(). */
+static void
+terminal_draw_row(struct terminal *terminal, cairo_t *cr, int row,
+		  union utf8_char *p_row, union decoded_attr *decoded)
+{
+	cairo_font_extents_t extents = terminal->extents;
 	union decoded_attr attr;
-	int text_x, text_y;
-	cairo_surface_t *surface;
-	double d;
 	struct glyph_run run;
-	cairo_font_extents_t extents;
+	int col, end, bg, text_x, text_y;
+	double top = row * extents.height;
 
-	surface = window_get_surface(terminal->window);
-	widget_get_allocation(terminal->widget, &allocation);
-	cr = cairo_create(surface);
-	cairo_rectangle(cr, allocation.x, allocation.y,
-			allocation.width, allocation.height);
+	/* Glyphs must not spill into rows that are not redrawn. */
+	cairo_save(cr);
+	cairo_rectangle(cr, 0, top, terminal->width * extents.max_x_advance,
+			extents.height);
 	cairo_clip(cr);
-	cairo_push_group(cr);
 
+	/* paint the background, one rectangle per run of cells sharing
+	 * a colour */
 	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
 	terminal_set_color(terminal, cr, terminal->color_scheme->border);
 	cairo_paint(cr);
 
-	cairo_set_scaled_font(cr, terminal->font_normal);
-
-	extents = terminal->extents;
-	side_margin = (allocation.width - terminal->width * extents.max_x_advance) / 2;
-	top_margin = (allocation.height - terminal->height * extents.height) / 2;
-
-	cairo_set_line_width(cr, 1.0);
-	cairo_translate(cr, allocation.x + side_margin,
-			allocation.y + top_margin);
-	/* paint the background */
-	for (row = 0; row < terminal->height; row++) {
-		for (col = 0; col < terminal->width; col++) {
-			/* get the attributes for this character cell */
-			terminal_decode_attr(terminal, row, col, &attr);
+	for (col = 0; col < terminal->width; col = end) {
+		bg = decoded[col].attr.bg;
+		for (end = col + 1; end < terminal->width; end++)
+			if (decoded[end].attr.bg != bg)
+				break;
 
-			if (attr.attr.bg == terminal->color_scheme->border)
-				continue;
+		if (bg == terminal->color_scheme->border)
+			continue;
 
-			terminal_set_color(terminal, cr, attr.attr.bg);
-			cairo_move_to(cr, col * extents.max_x_advance,
-				      row * extents.height);
-			cairo_rel_line_to(cr, extents.max_x_advance, 0);
-			cairo_rel_line_to(cr, 0, extents.height);
-			cairo_rel_line_to(cr, -extents.max_x_advance, 0);
-			cairo_close_path(cr);
-			cairo_fill(cr);
-		}
+		terminal_set_color(terminal, cr, bg);
+		cairo_rectangle(cr, col * extents.max_x_advance, top,
+				(end - col) * extents.max_x_advance,
+				extents.height);
+		cairo_fill(cr);
 	}
 
 	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
 
 	/* paint the foreground */
 	glyph_run_init(&run, terminal, cr);
-	for (row = 0; row < terminal->height; row++) {
-		p_row = terminal_get_row(terminal, row);
-		for (col = 0; col < terminal->width; col++) {
-			/* get the attributes for this character cell */
-			terminal_decode_attr(terminal, row, col, &attr);
+	for (col = 0; col < terminal->width; col++) {
+		glyph_run_flush(&run, decoded[col]);
+
+		text_x = col * extents.max_x_advance;
+		text_y = extents.ascent + top;
+		if (decoded[col].attr.a & ATTRMASK_UNDERLINE) {
+			terminal_set_color(terminal, cr, decoded[col].attr.fg);
+			cairo_move_to(cr, text_x, (double)text_y + 1.5);
+			cairo_line_to(cr, text_x + extents.max_x_advance, (double) text_y + 1.5);
+			cairo_stroke(cr);
+		}
 
-			glyph_run_flush(&run, attr);
+		glyph_run_add(&run, text_x, text_y, &p_row[col]);
+	}
 
-			text_x = col * extents.max_x_advance;
-			text_y = extents.ascent + row * extents.height;
-			if (attr.attr.a & ATTRMASK_UNDERLINE) {
-				terminal_set_color(terminal, cr, attr.attr.fg);
-				cairo_move_to(cr, text_x, (double)text_y + 1.5);
-				cairo_line_to(cr, text_x + extents.max_x_advance, (double) text_y + 1.5);
-				cairo_stroke(cr);
-			}
+	attr.key = ~0;
+	glyph_run_flush(&run, attr);
 
-			glyph_run_add(&run, text_x, text_y, &p_row[col]);
+	cairo_restore(cr);
+}
+
+static void
+terminal_damage_rows(struct terminal *terminal, struct rectangle *allocation,
+		     int side_margin, int top_margin, int first, int last)
+{
+	window_damage(terminal->window, allocation->x + side_margin,
+		      allocation->y + top_margin +
+		      first * (int) terminal->extents.height,
+		      terminal->width * (int) terminal->extents.max_x_advance,
+		      (last - first + 1) * (int) terminal->extents.height);
+}
+
+/* Fetch the cells and decoded attributes shown on display row 'row',
+ * which comes from the history while the view is scrolled back. */
+static union utf8_char *
+terminal_get_display_row(struct terminal *terminal, int row,
+			 union decoded_attr *decoded)
+{
+	int src = row - terminal->view_offset, col;
+
+	if (src >= 0) {
+		terminal_decode_row(terminal, src, decoded);
+		return terminal_get_row(terminal, src);
+	}
+
+	scrollback_get(terminal->scrollback, -src - 1,
+		       terminal->history_data, terminal->history_attr,
+		       terminal->width, &terminal->color_scheme->default_attr);
+	for (col = 0; col < terminal->width; col++)
+		decode_attr(terminal, terminal->history_attr[col], 0, 0,
+			    &decoded[col]);
+
+	return terminal->history_data;
+}
+
+/* The row cache finds and damages what changed when drawing, so
+ * nothing is damaged up front. */
+static void
+terminal_schedule_redraw(struct terminal *terminal)
+{
+	widget_schedule_redraw_area(terminal->widget, 0, 0, 0, 0);
+}
+
+/* Bring the back store up to date, rendering only rows whose contents
+ * or decoded attributes differ from what it shows, and damage them. */
+static int
+terminal_update_cache(struct terminal *terminal, struct rectangle *allocation,
+		      int side_margin, int top_margin)
+{
+	union utf8_char *p_row, *cached_row;
+	union decoded_attr *cached_attr;
+	int row, first = -1, full;
+	cairo_t *cr;
+
+	full = terminal_prepare_cache(terminal);
+	if (full < 0)
+		return -1;
+
+	cr = cairo_create(terminal->cache_surface);
+	cairo_set_scaled_font(cr, terminal->font_normal);
+	cairo_set_line_width(cr, 1.0);
+
+	for (row = 0; row < terminal->height; row++) {
+		p_row = terminal_get_display_row(terminal, row,
+						 terminal->decoded_row);
+		cached_row = &terminal->cache_data[row * terminal->width];
+		cached_attr = &terminal->cache_attr[row * terminal->width];
+
+		if (terminal->cache_row_valid[row] &&
+		    memcmp(cached_row, p_row, terminal->data_pitch) == 0 &&
+		    memcmp(cached_attr, terminal->decoded_row,
+			   terminal->width * sizeof *cached_attr) == 0) {
+			if (first >= 0 && !full)
+				terminal_damage_rows(terminal, allocation,
+						     side_margin, top_margin,
+						     first, row - 1);
+			first = -1;
+			continue;
 		}
+
+		memcpy(cached_row, p_row, terminal->data_pitch);
+		memcpy(cached_attr, terminal->decoded_row,
+		       terminal->width * sizeof *cached_attr);
+		terminal->cache_row_valid[row] = 1;
+
+		terminal_draw_row(terminal, cr, row, p_row, cached_attr);
+		if (first < 0)
+			first = row;
 	}
 
-	attr.key = ~0;
-	glyph_run_flush(&run, attr);
+	if (first >= 0 && !full)
+		terminal_damage_rows(terminal, allocation,
+				     side_margin, top_margin,
+				     first, terminal->height - 1);
+
+	cairo_destroy(cr);
+
+	/* A new back store may come with new margins, and a scrolled
+	 * one has moved every row. */
+	if (full)
+		window_damage(terminal->window, allocation->x, allocation->y,
+			      allocation->width, allocation->height);
+
+	return 0;
+}
+
+static void
+redraw_handler(struct widget *widget, void *data)
+{
+	struct terminal *terminal = data;
+	struct rectangle allocation;
+	cairo_t *cr;
+	int top_margin, side_margin;
+	int cursor_x, cursor_y, outline_row;
+	double d;
+	cairo_font_extents_t extents;
+	struct timespec start, end;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	widget_get_allocation(terminal->widget, &allocation);
+
+	extents = terminal->extents;
+	side_margin = (allocation.width - terminal->width * extents.max_x_advance) / 2;
+	top_margin = (allocation.height - terminal->height * extents.height) / 2;
 
+	if (terminal_update_cache(terminal, &allocation,
+				  side_margin, top_margin) < 0)
+		return;
+
+	outline_row = -1;
 	if ((terminal->mode & MODE_SHOW_CURSOR) &&
-	    !window_has_focus(terminal->window)) {
+	    !window_has_focus(terminal->window) &&
+	    terminal->row + terminal->view_offset < terminal->height)
+		outline_row = terminal->row + terminal->view_offset;
+
+	/* The outline is drawn over the back store, so it is damaged
+	 * where it was and where it is now. */
+	if (terminal->outline_row >= 0 &&
+	    terminal->outline_row < terminal->height)
+		terminal_damage_rows(terminal, &allocation,
+				     side_margin, top_margin,
+				     terminal->outline_row,
+				     terminal->outline_row);
+	if (outline_row >= 0 && outline_row != terminal->outline_row)
+		terminal_damage_rows(terminal, &allocation,
+				     side_margin, top_margin,
+				     outline_row, outline_row);
+	terminal->outline_row = outline_row;
+
+	/* Clipped to what was damaged above; the rest of the buffer is
+	 * carried over from the last frame. */
+	cr = widget_cairo_create(terminal->widget);
+	cairo_rectangle(cr, allocation.x, allocation.y,
+			allocation.width, allocation.height);
+	cairo_clip(cr);
+
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	terminal_set_color(terminal, cr, terminal->color_scheme->border);
+	cairo_paint(cr);
+
+	cairo_translate(cr, allocation.x + side_margin,
+			allocation.y + top_margin);
+	cairo_set_source_surface(cr, terminal->cache_surface, 0, 0);
+	cairo_rectangle(cr, 0, 0,
+			terminal->width * extents.max_x_advance,
+			terminal->height * extents.height);
+	cairo_fill(cr);
+
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+	if (outline_row >= 0) {
 		d = 0.5;
 
+		terminal_set_color(terminal, cr, terminal->color_scheme->default_attr.fg);
 		cairo_set_line_width(cr, 1);
 		cairo_move_to(cr, terminal->column * extents.max_x_advance + d,
-			      terminal->row * extents.height + d);
+			      outline_row * extents.height + d);
 		cairo_rel_line_to(cr, extents.max_x_advance - 2 * d, 0);
 		cairo_rel_line_to(cr, 0, extents.height - 2 * d);
 		cairo_rel_line_to(cr, -extents.max_x_advance + 2 * d, 0);
@@ -1015,20 +1393,22 @@ redraw_handler(struct widget *widget, void *data)
 		cairo_stroke(cr);
 	}
 
-	cairo_pop_group_to_source(cr);
-	cairo_paint(cr);
 	cairo_destroy(cr);
-	cairo_surface_destroy(surface);
 
 	if (terminal->send_cursor_position) {
 		cursor_x = side_margin + allocation.x +
 				terminal->column * extents.max_x_advance;
 		cursor_y = top_margin + allocation.y +
-				terminal->row * extents.height;
+				(terminal->row + terminal->view_offset) *
+				extents.height;
 		window_set_text_cursor_position(terminal->window,
 						cursor_x, cursor_y);
 		terminal->send_cursor_position = 0;
 	}
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	terminal->render_nsec += timespec_sub_to_nsec(&end, &start);
+	terminal->frames++;
 }
 
 static void
@@ -1882,14 +2262,109 @@ escape_append_utf8(struct terminal *terminal, union utf8_char utf8)
 	}
 }
 
+/* Length of the run of printable ASCII at the start of 'data', which
+ * goes straight into the cells without going through the UTF-8 and
+ * escape parsers. */
+static size_t
+ascii_run_length(const char *data, size_t length)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	__m128i v, special;
+	int mask;
+
+	/* As signed bytes, everything from 0x80 up is below ' ' too. */
+	for (; i + 16 <= length; i += 16) {
+		v = _mm_loadu_si128((const __m128i *) (data + i));
+		special = _mm_or_si128(_mm_cmplt_epi8(v, _mm_set1_epi8(' ')),
+				       _mm_cmpeq_epi8(v, _mm_set1_epi8(0x7f)));
+		mask = _mm_movemask_epi8(special);
+		if (mask)
+			return i + __builtin_ctz(mask);
+	}
+#endif
+
+	for (; i < length; i++)
+		if ((unsigned char) data[i] < ' ' ||
+		    (unsigned char) data[i] >= 0x7f)
+			break;
+
+	return i;
+}
+
+/* Write a run of printable ASCII as handle_char() would, a row at a
+ * time. */
+static void
+terminal_write_ascii(struct terminal *terminal, const char *data,
+		     size_t length)
+{
+	union utf8_char *row;
+	struct attr *attr_row;
+	size_t i, n;
+
+	while (length > 0) {
+		if (terminal->column >= terminal->width) {
+			if (terminal->mode & MODE_AUTOWRAP) {
+				terminal->column = 0;
+				terminal->row += 1;
+				if (terminal->row > terminal->margin_bottom) {
+					terminal->row = terminal->margin_bottom;
+					terminal_scroll(terminal, +1);
+				}
+			} else {
+				terminal->column--;
+			}
+		}
+
+		n = terminal->width - terminal->column;
+		if (n > length)
+			n = length;
+
+		row = terminal_get_row(terminal, terminal->row) +
+			terminal->column;
+		attr_row = terminal_get_attr_row(terminal, terminal->row) +
+			terminal->column;
+		for (i = 0; i < n; i++) {
+			row[i].ch = 0;
+			row[i].byte[0] = data[i];
+			attr_row[i] = terminal->curr_attr;
+		}
+
+		terminal->column += n;
+		data += n;
+		length -= n;
+	}
+
+	terminal->last_char.ch = 0;
+	terminal->last_char.byte[0] = data[-1];
+}
+
 static void
 terminal_data(struct terminal *terminal, const char *data, size_t length)
 {
 	unsigned int i;
 	union utf8_char utf8;
 	enum utf8_state parser_state;
+	size_t run;
 
 	for (i = 0; i < length; i++) {
+		/* Plain text outside of escape sequences and UTF-8
+		 * sequences, with no character set translation or
+		 * insert mode, takes the fast path. */
+		if (terminal->state == escape_state_normal &&
+		    terminal->cs == CS_US &&
+		    !(terminal->mode & MODE_IRM) &&
+		    (terminal->state_machine.state == utf8state_start ||
+		     terminal->state_machine.state == utf8state_accept ||
+		     terminal->state_machine.state == utf8state_reject)) {
+			run = ascii_run_length(data + i, length - i);
+			if (run > 0) {
+				terminal_write_ascii(terminal, data + i, run);
+				i += run - 1;
+				continue;
+			}
+		}
+
 		parser_state =
 			utf8_next_char(&terminal->state_machine, data[i]);
 		switch(parser_state) {
@@ -2028,8 +2503,6 @@ terminal_data(struct terminal *terminal, const char *data, size_t length)
 			handle_char(terminal, utf8);
 		} /* if */
 	} /* for */
-
-	window_schedule_redraw(terminal->window);
 }
 
 static void
@@ -2116,6 +2589,26 @@ handle_bound_key(struct terminal *terminal,
 	}
 }
 
+/* Scroll the view 'offset' rows back into the history. */
+static void
+terminal_set_view_offset(struct terminal *terminal, int offset)
+{
+	int rows = 0;
+
+	if (terminal->scrollback)
+		rows = scrollback_rows(terminal->scrollback);
+	if (offset > rows)
+		offset = rows;
+	if (offset < 0)
+		offset = 0;
+	if (offset == terminal->view_offset)
+		return;
+
+	terminal->scroll_pending += terminal->view_offset - offset;
+	terminal->view_offset = offset;
+	terminal_schedule_redraw(terminal);
+}
+
 static void
 key_handler(struct window *window, struct input *input, uint32_t time,
 	    uint32_t key, uint32_t sym, enum wl_keyboard_key_state state,
@@ -2134,6 +2627,18 @@ key_handler(struct window *window, struct input *input, uint32_t time,
 	    handle_bound_key(terminal, input, sym, time))
 		return;
 
+	if ((modifiers & MOD_SHIFT_MASK) &&
+	    !(modifiers & (MOD_CONTROL_MASK | MOD_ALT_MASK)) &&
+	    (sym == XKB_KEY_Page_Up || sym == XKB_KEY_Page_Down)) {
+		if (state == WL_KEYBOARD_KEY_STATE_PRESSED)
+			terminal_set_view_offset(terminal,
+						 terminal->view_offset +
+						 (sym == XKB_KEY_Page_Up ?
+						  terminal->height :
+						  -terminal->height));
+		return;
+	}
+
 	/* Map keypad symbols to 'normal' equivalents before processing */
 	switch (sym) {
 	case XKB_KEY_KP_Space:
@@ -2328,6 +2833,7 @@ key_handler(struct window *window, struct input *input, uint32_t time,
 	}
 
 	if (state == WL_KEYBOARD_KEY_STATE_PRESSED && len > 0) {
+		terminal_set_view_offset(terminal, 0);
 		terminal_write(terminal, ch, len);
 
 		/* Hide cursor, except if this was coming from a
@@ -2379,8 +2885,13 @@ recompute_selection(struct terminal *terminal)
 	side_margin = allocation.x + (allocation.width - width) / 2;
 	top_margin = allocation.y + (allocation.height - height) / 2;
 
-	start_row = (terminal->selection_start_y - top_margin + ch) / ch - 1;
-	end_row = (terminal->selection_end_y - top_margin + ch) / ch - 1;
+	/* Selection rows are screen rows, so that the selection stays on
+	 * the same text as the view scrolls; rows up in the history
+	 * can't be selected. */
+	start_row = (terminal->selection_start_y - top_margin + ch) / ch - 1 -
+		terminal->view_offset;
+	end_row = (terminal->selection_end_y - top_margin + ch) / ch - 1 -
+		terminal->view_offset;
 
 	if (start_row < end_row ||
 	    (start_row == end_row &&
@@ -2427,7 +2938,10 @@ recompute_selection(struct terminal *terminal)
 		}
 	}
 
-	if (terminal->selection_end_row >= terminal->height) {
+	if (terminal->selection_end_row < 0) {
+		terminal->selection_end_row = 0;
+		terminal->selection_end_col = 0;
+	} else if (terminal->selection_end_row >= terminal->height) {
 		terminal->selection_end_row = terminal->height;
 		terminal->selection_end_col = 0;
 	} else {
@@ -2483,7 +2997,7 @@ button_handler(struct widget *widget,
 			terminal->selection_end_x = terminal->selection_start_x;
 			terminal->selection_end_y = terminal->selection_start_y;
 			if (recompute_selection(terminal))
-				widget_schedule_redraw(widget);
+				terminal_schedule_redraw(terminal);
 		} else {
 			terminal->dragging = SELECT_NONE;
 		}
@@ -2511,7 +3025,7 @@ motion_handler(struct widget *widget,
 				   &terminal->selection_end_y);
 
 		if (recompute_selection(terminal))
-			widget_schedule_redraw(widget);
+			terminal_schedule_redraw(terminal);
 	}
 
 	return CURSOR_IBEAM;
@@ -2576,6 +3090,16 @@ terminal_create(struct display *display)
 	cairo_destroy(cr);
 	cairo_surface_destroy(surface);
 
+	/* Whole pixel cells, so a scroll can move rows of the back store
+	 * by whole pixel lines. */
+	terminal->extents.height = ceil(terminal->extents.height);
+	terminal->extents.max_x_advance = ceil(terminal->extents.max_x_advance);
+	terminal->outline_row = -1;
+
+	if (option_scrollback_lines > 0)
+		terminal->scrollback =
+			scrollback_create(option_scrollback_lines);
+
 	terminal_resize(terminal, 20, 5); /* Set minimum size first */
 	terminal_resize(terminal, 80, 25);
 
@@ -2591,6 +3115,9 @@ terminal_destroy(struct terminal *terminal)
 	window_destroy(terminal->window);
 	close(terminal->master);
 	wl_list_remove(&terminal->link);
+	terminal_free_cache(terminal);
+	if (terminal->scrollback)
+		scrollback_destroy(terminal->scrollback);
 
 	if (wl_list_empty(&terminal_list))
 		display_exit(terminal->display);
@@ -2598,24 +3125,66 @@ terminal_destroy(struct terminal *terminal)
 	free(terminal);
 }
 
+static void
+terminal_report_benchmark(struct terminal *terminal)
+{
+	struct timespec now;
+	double seconds;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	seconds = timespec_sub_to_nsec(&now, &terminal->benchmark_start) /
+		(double) NSEC_PER_SEC;
+
+	printf("%llu bytes in %.3f s: %.1f MiB/s, "
+	       "%.1f ms parsing, %.1f ms rendering %d frames\n",
+	       (unsigned long long) terminal->bytes_read, seconds,
+	       terminal->bytes_read / seconds / (1024 * 1024),
+	       terminal->parse_nsec / 1e6, terminal->render_nsec / 1e6,
+	       terminal->frames);
+}
+
+/* Read the pty in large chunks until it is drained or the budget is
+ * used up, and leave the drawing to a single redraw on the next
+ * frame, however much was parsed in between. */
 static void
 io_handler(struct task *task, uint32_t events)
 {
 	struct terminal *terminal =
 		container_of(task, struct terminal, io_task);
-	char buffer[256];
-	int len;
+	static char buffer[READ_BUFFER_SIZE];
+	struct timespec start, read_done, now;
+	int len, parsed = 0;
 
-	if (events & EPOLLHUP) {
-		terminal_destroy(terminal);
-		return;
-	}
+	clock_gettime(CLOCK_MONOTONIC, &start);
 
-	len = read(terminal->master, buffer, sizeof buffer);
-	if (len < 0)
-		terminal_destroy(terminal);
-	else
+	while (1) {
+		len = read(terminal->master, buffer, sizeof buffer);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len < 0 && errno == EAGAIN)
+			break;
+		if (len <= 0) {
+			/* EOF, or EIO once the child is gone */
+			if (option_benchmark)
+				terminal_report_benchmark(terminal);
+			terminal_destroy(terminal);
+			return;
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &read_done);
 		terminal_data(terminal, buffer, len);
+		clock_gettime(CLOCK_MONOTONIC, &now);
+
+		terminal->bytes_read += len;
+		terminal->parse_nsec += timespec_sub_to_nsec(&now, &read_done);
+		parsed = 1;
+
+		if (timespec_sub_to_nsec(&now, &start) > READ_BUDGET_NSEC)
+			break;
+	}
+
+	if (parsed)
+		terminal_schedule_redraw(terminal);
 }
 
 static int
@@ -2628,16 +3197,19 @@ terminal_run(struct terminal *terminal, const char *path)
 	if (pid == 0) {
 		setenv("TERM", option_term, 1);
 		setenv("COLORTERM", option_term, 1);
-		if (execl(path, path, NULL)) {
-			printf("exec failed: %m\n");
-			exit(EXIT_FAILURE);
-		}
+		if (option_benchmark)
+			execlp("cat", "cat", option_benchmark, NULL);
+		else
+			execl(path, path, NULL);
+		printf("exec failed: %m\n");
+		exit(EXIT_FAILURE);
 	} else if (pid < 0) {
 		fprintf(stderr, "failed to fork and create pty (%m).\n");
 		return -1;
 	}
 
 	terminal->master = master;
+	clock_gettime(CLOCK_MONOTONIC, &terminal->benchmark_start);
 	fcntl(master, F_SETFL, O_NONBLOCK);
 	terminal->io_task.run = io_handler;
 	display_watch_fd(terminal->display, terminal->master,
@@ -2654,6 +3226,7 @@ static const struct config_key terminal_config_keys[] = {
 	{ "font", CONFIG_KEY_STRING, &option_font },
 	{ "font-size", CONFIG_KEY_INTEGER, &option_font_size },
 	{ "term", CONFIG_KEY_STRING, &option_term },
+	{ "scrollback-lines", CONFIG_KEY_INTEGER, &option_scrollback_lines },
 };
 
 static const struct config_section config_sections[] = {
@@ -2665,6 +3238,9 @@ static const struct weston_option terminal_options[] = {
 	{ WESTON_OPTION_BOOLEAN, "fullscreen", 'f', &option_fullscreen },
 	{ WESTON_OPTION_STRING, "font", 0, &option_font },
 	{ WESTON_OPTION_STRING, "shell", 0, &option_shell },
+	{ WESTON_OPTION_STRING, "benchmark", 0, &option_benchmark },
+	{ WESTON_OPTION_INTEGER, "scrollback-lines", 0,
+	  &option_scrollback_lines },
 };
 
 int main(int argc, char *argv[])
@@ -153,17 +153,23 @@ struct toysurface {
 	 * width,height are the new surface size.
 	 * If flags has SURFACE_HINT_RESIZE set, the user is
 	 * doing continuous resizing.
+	 * damage is the area that is going to be redrawn, or NULL if
+	 * everything is. Everything outside it must show what the last
+	 * posted buffer did; whatever cannot be brought back is added
+	 * to damage, and then has to be redrawn too.
 	 * Returns the Cairo surface to draw to.
 	 */
 	cairo_surface_t *(*prepare)(struct toysurface *base, int dx, int dy,
-				    int width, int height, uint32_t flags);
+				    int width, int height, uint32_t flags,
+				    cairo_region_t *damage);
 
 	/*
-	 * Post the surface to the server, returning the server allocation
-	 * rectangle. The Cairo surface from prepare() must be destroyed
-	 * after calling this.
+	 * Post the surface to the server, with the area that changed
+	 * since the last buffer (NULL for all of it), returning the
+	 * server allocation rectangle. The Cairo surface from prepare()
+	 * must be destroyed after calling this.
 	 */
-	void (*swap)(struct toysurface *base,
+	void (*swap)(struct toysurface *base, cairo_region_t *damage,
 		     struct rectangle *server_allocation);
 
 	/*
@@ -199,9 +205,17 @@ struct surface {
 	struct wl_region *opaque_region;
 
 	enum window_buffer_type buffer_type;
+	int buffer_depth;
 	enum wl_output_transform buffer_transform;
 
 	cairo_surface_t *cairo_surface;
+
+	/* Areas scheduled for redraw on the next frame, and what the
+	 * buffer being drawn changes: those areas plus what redraw
+	 * handlers report with window_damage().  Both are in surface
+	 * coordinates. */
+	cairo_region_t *redraw_region;
+	cairo_region_t *damage;
 };
 
 struct window {
@@ -216,6 +230,7 @@ struct window {
 	int resize_edges;
 	int redraw_scheduled;
 	int redraw_needed;
+	int redraw_full;
 	struct task redraw_task;
 	int resize_needed;
 	int type;
@@ -260,6 +275,7 @@ struct widget {
 	int opaque;
 	int tooltip_count;
 	int default_cursor;
+	int redraw_needed;
 };
 
 struct input {
@@ -425,9 +441,15 @@ to_egl_window_surface(struct toysurface *base)
 
 static cairo_surface_t *
 egl_window_surface_prepare(struct toysurface *base, int dx, int dy,
-			   int width, int height, uint32_t flags)
+			   int width, int height, uint32_t flags,
+			   cairo_region_t *damage)
 {
 	struct egl_window_surface *surface = to_egl_window_surface(base);
+	cairo_rectangle_int_t rect = { 0, 0, width, height };
+
+	/* The back buffer comes with undefined contents. */
+	if (damage)
+		cairo_region_union_rectangle(damage, &rect);
 
 	wl_egl_window_resize(surface->egl_window, width, height, dx, dy);
 	cairo_gl_surface_set_size(surface->cairo_surface, width, height);
@@ -436,7 +458,7 @@ egl_window_surface_prepare(struct toysurface *base, int dx, int dy,
 }
 
 static void
-egl_window_surface_swap(struct toysurface *base,
+egl_window_surface_swap(struct toysurface *base, cairo_region_t *damage,
 			struct rectangle *server_allocation)
 {
 	struct egl_window_surface *surface = to_egl_window_surface(base);
@@ -725,27 +747,12 @@ display_create_shm_surface_from_pool(struct display *display,
 
 static cairo_surface_t *
 display_create_shm_surface(struct display *display,
-			   struct rectangle *rectangle, uint32_t flags,
-			   struct shm_pool *alternate_pool,
-			   struct shm_surface_data **data_ret)
+			   struct rectangle *rectangle, uint32_t flags)
 {
 	struct shm_surface_data *data;
 	struct shm_pool *pool;
 	cairo_surface_t *surface;
 
-	if (alternate_pool) {
-		shm_pool_reset(alternate_pool);
-		surface = display_create_shm_surface_from_pool(display,
-							       rectangle,
-							       flags,
-							       alternate_pool);
-		if (surface) {
-			data = cairo_surface_get_user_data(surface,
-							   &shm_surface_data_key);
-			goto out;
-		}
-	}
-
 	pool = shm_pool_create(display,
 			       data_length_for_shm_surface(rectangle));
 	if (!pool)
@@ -764,10 +771,6 @@ display_create_shm_surface(struct display *display,
 	data = cairo_surface_get_user_data(surface, &shm_surface_data_key);
 	data->pool = pool;
 
-out:
-	if (data_ret)
-		*data_ret = data;
-
 	return surface;
 }
 
@@ -792,31 +795,26 @@ display_create_surface(struct display *display,
 		return NULL;
 
 	assert(flags & SURFACE_SHM);
-	return display_create_shm_surface(display, rectangle, flags,
-					  NULL, NULL);
+	return display_create_shm_surface(display, rectangle, flags);
 }
 
 struct shm_surface_leaf {
+	struct shm_surface *surface;
+	struct wl_list link;
+
 	cairo_surface_t *cairo_surface;
 	/* 'data' is automatically destroyed, when 'cairo_surface' is */
 	struct shm_surface_data *data;
 
-	struct shm_pool *resize_pool;
+	/* Backing memory, kept across size changes while it is big
+	 * enough, so resizing only needs a new wl_buffer. */
+	struct shm_pool *pool;
 	int busy;
-};
-
-static void
-shm_surface_leaf_release(struct shm_surface_leaf *leaf)
-{
-	if (leaf->cairo_surface)
-		cairo_surface_destroy(leaf->cairo_surface);
-	/* leaf->data already destroyed via cairo private */
 
-	if (leaf->resize_pool)
-		shm_pool_destroy(leaf->resize_pool);
-
-	memset(leaf, 0, sizeof *leaf);
-}
+	/* The parts of the buffer that frames posted from other leaves
+	 * have changed since this one was posted. */
+	cairo_region_t *stale;
+};
 
 struct shm_surface {
 	struct toysurface base;
@@ -825,8 +823,14 @@ struct shm_surface {
 	uint32_t flags;
 	int dx, dy;
 
-	struct shm_surface_leaf leaf[2];
+	/* Leaves kept while the server holds none of them; more are
+	 * added while it holds them all, so no frame is ever dropped,
+	 * and freed again as they come back. */
+	int depth;
+	int nleaves;
+	struct wl_list leaf_list;
 	struct shm_surface_leaf *current;
+	struct shm_surface_leaf *last;	/* the leaf posted last */
 };
 
 static struct shm_surface *
@@ -835,102 +839,264 @@ to_shm_surface(struct toysurface *base)
 	return container_of(base, struct shm_surface, base);
 }
 
+static void
+shm_surface_leaf_destroy(struct shm_surface_leaf *leaf)
+{
+	struct shm_surface *surface = leaf->surface;
+
+	if (leaf->cairo_surface)
+		cairo_surface_destroy(leaf->cairo_surface);
+	/* leaf->data already destroyed via cairo private */
+
+	if (leaf->pool)
+		shm_pool_destroy(leaf->pool);
+
+	if (leaf->stale)
+		cairo_region_destroy(leaf->stale);
+
+	if (surface->last == leaf)
+		surface->last = NULL;
+	wl_list_remove(&leaf->link);
+	surface->nleaves--;
+
+	free(leaf);
+}
+
 static void
 shm_surface_buffer_release(void *data, struct wl_buffer *buffer)
 {
-	struct shm_surface *surface = data;
+	struct shm_surface_leaf *leaf = data;
+	struct shm_surface *surface = leaf->surface;
 
-	if (surface->leaf[0].data->buffer == buffer)
-		surface->leaf[0].busy = 0;
-	else if (surface->leaf[1].data->buffer == buffer)
-		surface->leaf[1].busy = 0;
-	else
-		assert(0 && "shm_surface_buffer_release: unknown buffer");
+	leaf->busy = 0;
 
-	if (!surface->leaf[0].busy && !surface->leaf[1].busy)
-		shm_surface_leaf_release(&surface->leaf[1]);
+	/* Drop what was added while the server held everything, but
+	 * keep the leaf posted last: the next frame can reuse it as
+	 * is. */
+	if (surface->nleaves > surface->depth && leaf != surface->last)
+		shm_surface_leaf_destroy(leaf);
 }
 
 static const struct wl_buffer_listener shm_surface_buffer_listener = {
 	shm_surface_buffer_release
 };
 
-static cairo_surface_t *
-shm_surface_prepare(struct toysurface *base, int dx, int dy,
-		    int width, int height, uint32_t flags)
+/* The size of the largest output's frame buffer in ARGB32, which is
+ * as big as a window gets in practice. */
+static size_t
+display_get_max_output_size(struct display *display)
 {
-	int resize_hint = !!(flags & SURFACE_HINT_RESIZE);
-	struct shm_surface *surface = to_shm_surface(base);
-	struct rectangle rect = { 0, 0, width, height };
-	struct shm_surface_leaf *leaf;
-
-	surface->dx = dx;
-	surface->dy = dy;
+	struct output *output;
+	size_t size, max = 0;
 
-	/* See shm_surface_buffer_release() */
-	if (!surface->leaf[0].busy && !surface->leaf[1].busy &&
-	    surface->leaf[1].cairo_surface) {
-		fprintf(stderr, "window.c:%s: TODO: release leaf[1]\n",
-			__func__);
+	wl_list_for_each(output, &display->output_list, link) {
+		size = (size_t) cairo_format_stride_for_width(
+			CAIRO_FORMAT_ARGB32, output->allocation.width) *
+			output->allocation.height;
+		if (size > max)
+			max = size;
 	}
 
-	/* pick a free buffer from the two */
-	if (!surface->leaf[0].busy)
-		leaf = &surface->leaf[0];
-	else if (!surface->leaf[1].busy)
-		leaf = &surface->leaf[1];
-	else {
-		fprintf(stderr, "%s: both buffers are held by the server.\n",
-			__func__);
-		return NULL;
-	}
+	return max;
+}
 
-	if (!resize_hint && leaf->resize_pool) {
-		cairo_surface_destroy(leaf->cairo_surface);
-		leaf->cairo_surface = NULL;
-		shm_pool_destroy(leaf->resize_pool);
-		leaf->resize_pool = NULL;
-	}
+static int
+shm_surface_leaf_resize(struct shm_surface_leaf *leaf,
+			int width, int height, int resize_hint)
+{
+	struct shm_surface *surface = leaf->surface;
+	struct rectangle rect = { 0, 0, width, height };
+	cairo_rectangle_int_t full = { 0, 0, width, height };
+	size_t size, pool_size;
 
 	if (leaf->cairo_surface &&
 	    cairo_image_surface_get_width(leaf->cairo_surface) == width &&
 	    cairo_image_surface_get_height(leaf->cairo_surface) == height)
-		goto out;
+		return 0;
 
-	if (leaf->cairo_surface)
+	if (leaf->cairo_surface) {
 		cairo_surface_destroy(leaf->cairo_surface);
+		leaf->cairo_surface = NULL;
+	}
 
-	if (resize_hint && !leaf->resize_pool) {
-		/* Create a big pool to allocate from, while continuously
-		 * resizing. Mmapping a new pool in the server
-		 * is relatively expensive, so reusing a pool performs
-		 * better, but may temporarily reserve unneeded memory.
-		 */
-		/* We should probably base this number on the output size. */
-		leaf->resize_pool = shm_pool_create(surface->display,
-						    6 * 1024 * 1024);
+	/* Grow the pool when the buffer no longer fits, straight to
+	 * the size of the biggest output while the user is resizing,
+	 * as mapping a new pool in the server is relatively expensive.
+	 * Give back what a past resize left over once it is done. */
+	size = data_length_for_shm_surface(&rect);
+	if (leaf->pool &&
+	    (leaf->pool->size < size ||
+	     (!resize_hint && leaf->pool->size > 2 * size))) {
+		shm_pool_destroy(leaf->pool);
+		leaf->pool = NULL;
 	}
 
+	if (!leaf->pool) {
+		pool_size = size;
+		if (resize_hint &&
+		    display_get_max_output_size(surface->display) > size)
+			pool_size =
+				display_get_max_output_size(surface->display);
+
+		leaf->pool = shm_pool_create(surface->display, pool_size);
+		if (!leaf->pool)
+			return -1;
+	}
+
+	shm_pool_reset(leaf->pool);
 	leaf->cairo_surface =
-		display_create_shm_surface(surface->display, &rect,
-					   surface->flags,
-					   leaf->resize_pool,
-					   &leaf->data);
+		display_create_shm_surface_from_pool(surface->display, &rect,
+						     surface->flags,
+						     leaf->pool);
+	if (!leaf->cairo_surface)
+		return -1;
+
+	leaf->data = cairo_surface_get_user_data(leaf->cairo_surface,
+						 &shm_surface_data_key);
 	wl_buffer_add_listener(leaf->data->buffer,
-			       &shm_surface_buffer_listener, surface);
+			       &shm_surface_buffer_listener, leaf);
+
+	/* A new buffer has nothing in it yet. */
+	if (leaf->stale)
+		cairo_region_destroy(leaf->stale);
+	leaf->stale = cairo_region_create_rectangle(&full);
+	if (surface->last == leaf)
+		surface->last = NULL;
+
+	return 0;
+}
+
+/* Pick a leaf the server is not holding: the one posted last if it is
+ * free, as it needs nothing copied forward, else one of the right size
+ * so its buffer can be reused, else any.  If the server holds them all,
+ * add one. */
+static struct shm_surface_leaf *
+shm_surface_get_leaf(struct shm_surface *surface, int width, int height)
+{
+	struct shm_surface_leaf *leaf, *found = NULL;
+
+	if (surface->last && !surface->last->busy)
+		return surface->last;
+
+	wl_list_for_each(leaf, &surface->leaf_list, link) {
+		if (leaf->busy)
+			continue;
+		if (leaf->cairo_surface &&
+		    cairo_image_surface_get_width(leaf->cairo_surface) ==
+		    width &&
+		    cairo_image_surface_get_height(leaf->cairo_surface) ==
+		    height)
+			return leaf;
+		if (!found)
+			found = leaf;
+	}
+
+	if (found)
+		return found;
+
+	leaf = calloc(1, sizeof *leaf);
+	if (!leaf)
+		return NULL;
+
+	leaf->surface = surface;
+	wl_list_insert(surface->leaf_list.prev, &leaf->link);
+	surface->nleaves++;
+
+	return leaf;
+}
+
+/* Copy what the leaf misses from the last posted one, except for what
+ * is about to be redrawn anyway. */
+static void
+shm_surface_leaf_copy_forward(struct shm_surface *surface,
+			      struct shm_surface_leaf *leaf,
+			      cairo_region_t *damage)
+{
+	struct shm_surface_leaf *last = surface->last;
+	cairo_surface_t *dst = leaf->cairo_surface;
+	cairo_rectangle_int_t full, rect;
+	cairo_region_t *copy;
+	unsigned char *src_data, *dst_data;
+	int stride, i, n, y;
+
+	if (!damage || leaf == last)
+		return;
+
+	full.x = 0;
+	full.y = 0;
+	full.width = cairo_image_surface_get_width(dst);
+	full.height = cairo_image_surface_get_height(dst);
+
+	if (!last || !last->cairo_surface ||
+	    cairo_image_surface_get_width(last->cairo_surface) != full.width ||
+	    cairo_image_surface_get_height(last->cairo_surface) !=
+	    full.height) {
+		cairo_region_union_rectangle(damage, &full);
+		return;
+	}
+
+	copy = cairo_region_copy(leaf->stale);
+	cairo_region_subtract(copy, damage);
+	cairo_region_intersect_rectangle(copy, &full);
+
+	n = cairo_region_num_rectangles(copy);
+	if (n > 0) {
+		src_data = cairo_image_surface_get_data(last->cairo_surface);
+		dst_data = cairo_image_surface_get_data(dst);
+		stride = cairo_image_surface_get_stride(dst);
+
+		cairo_surface_flush(dst);
+		for (i = 0; i < n; i++) {
+			cairo_region_get_rectangle(copy, i, &rect);
+			for (y = rect.y; y < rect.y + rect.height; y++)
+				memcpy(dst_data + y * stride + rect.x * 4,
+				       src_data + y * stride + rect.x * 4,
+				       rect.width * 4);
+		}
+		cairo_surface_mark_dirty(dst);
+	}
+
+	cairo_region_destroy(copy);
+}
+
+static cairo_surface_t *
+shm_surface_prepare(struct toysurface *base, int dx, int dy,
+		    int width, int height, uint32_t flags,
+		    cairo_region_t *damage)
+{
+	int resize_hint = !!(flags & SURFACE_HINT_RESIZE);
+	struct shm_surface *surface = to_shm_surface(base);
+	struct shm_surface_leaf *leaf;
+
+	surface->dx = dx;
+	surface->dy = dy;
+
+	leaf = shm_surface_get_leaf(surface, width, height);
+	if (!leaf)
+		return NULL;
+
+	if (shm_surface_leaf_resize(leaf, width, height, resize_hint) < 0) {
+		fprintf(stderr, "%s: failed to allocate a %dx%d buffer\n",
+			__func__, width, height);
+		shm_surface_leaf_destroy(leaf);
+		return NULL;
+	}
 
-out:
 	surface->current = leaf;
+	shm_surface_leaf_copy_forward(surface, leaf, damage);
 
 	return cairo_surface_reference(leaf->cairo_surface);
 }
 
 static void
-shm_surface_swap(struct toysurface *base,
+shm_surface_swap(struct toysurface *base, cairo_region_t *damage,
 		 struct rectangle *server_allocation)
 {
 	struct shm_surface *surface = to_shm_surface(base);
 	struct shm_surface_leaf *leaf = surface->current;
+	struct shm_surface_leaf *other;
+	cairo_rectangle_int_t rect;
+	int i, n;
 
 	server_allocation->width =
 		cairo_image_surface_get_width(leaf->cairo_surface);
@@ -939,12 +1105,41 @@ shm_surface_swap(struct toysurface *base,
 
 	wl_surface_attach(surface->surface, leaf->data->buffer,
 			  surface->dx, surface->dy);
-	wl_surface_damage(surface->surface, 0, 0,
-			  server_allocation->width, server_allocation->height);
+
+	if (damage) {
+		n = cairo_region_num_rectangles(damage);
+		for (i = 0; i < n; i++) {
+			cairo_region_get_rectangle(damage, i, &rect);
+			wl_surface_damage(surface->surface, rect.x, rect.y,
+					  rect.width, rect.height);
+		}
+	} else {
+		wl_surface_damage(surface->surface, 0, 0,
+				  server_allocation->width,
+				  server_allocation->height);
+	}
+
 	wl_surface_commit(surface->surface);
 
+	rect.x = 0;
+	rect.y = 0;
+	rect.width = server_allocation->width;
+	rect.height = server_allocation->height;
+	wl_list_for_each(other, &surface->leaf_list, link) {
+		if (other == leaf || !other->stale)
+			continue;
+		if (damage)
+			cairo_region_union(other->stale, damage);
+		else
+			cairo_region_union_rectangle(other->stale, &rect);
+	}
+
+	cairo_region_destroy(leaf->stale);
+	leaf->stale = cairo_region_create();
+
 	leaf->busy = 1;
 	surface->current = NULL;
+	surface->last = leaf;
 }
 
 static int
@@ -962,16 +1157,17 @@ static void
 shm_surface_destroy(struct toysurface *base)
 {
 	struct shm_surface *surface = to_shm_surface(base);
+	struct shm_surface_leaf *leaf, *next;
 
-	shm_surface_leaf_release(&surface->leaf[0]);
-	shm_surface_leaf_release(&surface->leaf[1]);
+	wl_list_for_each_safe(leaf, next, &surface->leaf_list, link)
+		shm_surface_leaf_destroy(leaf);
 
 	free(surface);
 }
 
 static struct toysurface *
 shm_surface_create(struct display *display, struct wl_surface *wl_surface,
-		   uint32_t flags, struct rectangle *rectangle)
+		   uint32_t flags, struct rectangle *rectangle, int depth)
 {
 	struct shm_surface *surface;
 
@@ -988,6 +1184,8 @@ shm_surface_create(struct display *display, struct wl_surface *wl_surface,
 	surface->display = display;
 	surface->surface = wl_surface;
 	surface->flags = flags;
+	surface->depth = depth;
+	wl_list_init(&surface->leaf_list);
 
 	return &surface->base;
 }
@@ -1141,6 +1339,18 @@ display_get_pointer_image(struct display *display, int pointer)
 	return cursor ? cursor->images[0] : NULL;
 }
 
+/* The damage to hand to the toysurface, NULL meaning all of it.  With a
+ * buffer transform the damage would need transforming too, so those
+ * surfaces are always redrawn and posted whole. */
+static cairo_region_t *
+surface_get_damage(struct surface *surface)
+{
+	if (surface->buffer_transform != WL_OUTPUT_TRANSFORM_NORMAL)
+		return NULL;
+
+	return surface->damage;
+}
+
 static void
 surface_flush(struct surface *surface)
 {
@@ -1162,10 +1372,14 @@ surface_flush(struct surface *surface)
 	}
 
 	surface->toysurface->swap(surface->toysurface,
+				  surface_get_damage(surface),
 				  &surface->server_allocation);
 
 	cairo_surface_destroy(surface->cairo_surface);
 	surface->cairo_surface = NULL;
+
+	cairo_region_destroy(surface->damage);
+	surface->damage = cairo_region_create();
 }
 
 int
@@ -1222,11 +1436,13 @@ surface_create_surface(struct surface *surface, int dx, int dy, uint32_t flags)
 	if (!surface->toysurface)
 		surface->toysurface = shm_surface_create(display,
 							 surface->surface,
-							 flags, &allocation);
+							 flags, &allocation,
+							 surface->buffer_depth);
 
 	surface->cairo_surface = surface->toysurface->prepare(
 		surface->toysurface, dx, dy,
-		allocation.width, allocation.height, flags);
+		allocation.width, allocation.height, flags,
+		surface_get_damage(surface));
 }
 
 static void
@@ -1284,6 +1500,8 @@ surface_destroy(struct surface *surface)
 	if (surface->toysurface)
 		surface->toysurface->destroy(surface->toysurface);
 
+	cairo_region_destroy(surface->redraw_region);
+	cairo_region_destroy(surface->damage);
 	free(surface);
 }
 
@@ -1475,15 +1693,29 @@ widget_get_cairo_surface(struct widget *widget)
 	return surface->cairo_surface;
 }
 
+/* The returned context is clipped to what is being redrawn. */
 cairo_t *
 widget_cairo_create(struct widget *widget)
 {
+	struct surface *surface = widget->surface;
 	cairo_surface_t *cairo_surface;
+	cairo_rectangle_int_t rect;
 	cairo_t *cr;
+	int i, n;
 
 	cairo_surface = widget_get_cairo_surface(widget);
 	cr = cairo_create(cairo_surface);
 
+	if (surface_get_damage(surface)) {
+		n = cairo_region_num_rectangles(surface->damage);
+		for (i = 0; i < n; i++) {
+			cairo_region_get_rectangle(surface->damage, i, &rect);
+			cairo_rectangle(cr, rect.x, rect.y,
+					rect.width, rect.height);
+		}
+		cairo_clip(cr);
+	}
+
 	return cr;
 }
 
@@ -1540,6 +1772,23 @@ widget_schedule_redraw(struct widget *widget)
 	window_schedule_redraw(widget->window);
 }
 
+static void
+window_schedule_frame(struct window *window);
+
+void
+widget_schedule_redraw_area(struct widget *widget, int32_t x, int32_t y,
+			    int32_t width, int32_t height)
+{
+	cairo_rectangle_int_t rect = { x, y, width, height };
+
+	if (width > 0 && height > 0)
+		cairo_region_union_rectangle(widget->surface->redraw_region,
+					     &rect);
+
+	widget->redraw_needed = 1;
+	window_schedule_frame(widget->window);
+}
+
 cairo_surface_t *
 window_get_surface(struct window *window)
 {
@@ -3326,15 +3575,32 @@ window_get_allocation(struct window *window,
 	*allocation = window->main_surface->allocation;
 }
 
+/* Run the redraw handlers of the widgets that asked for a redraw or
+ * overlap what is being redrawn, or of all of them for a full redraw. */
 static void
-widget_redraw(struct widget *widget)
+widget_redraw(struct widget *widget, int full)
 {
 	struct widget *child;
-
-	if (widget->redraw_handler)
+	cairo_rectangle_int_t rect;
+	int needed;
+
+	rect.x = widget->allocation.x;
+	rect.y = widget->allocation.y;
+	rect.width = widget->allocation.width;
+	rect.height = widget->allocation.height;
+
+	/* A handler may schedule its next redraw right away. */
+	needed = widget->redraw_needed;
+	widget->redraw_needed = 0;
+
+	if (widget->redraw_handler &&
+	    (full || needed ||
+	     cairo_region_contains_rectangle(widget->surface->damage, &rect) !=
+	     CAIRO_REGION_OVERLAP_OUT))
 		widget->redraw_handler(widget, widget->user_data);
+
 	wl_list_for_each(child, &widget->child_list, link)
-		widget_redraw(child);
+		widget_redraw(child, full);
 }
 
 static void
@@ -3347,7 +3613,7 @@ frame_callback(void *data, struct wl_callback *callback, uint32_t time)
 	window->frame_cb = 0;
 	window->redraw_scheduled = 0;
 	if (window->redraw_needed)
-		window_schedule_redraw(window);
+		window_schedule_frame(window);
 }
 
 static const struct wl_callback_listener listener = {
@@ -3358,11 +3624,36 @@ static void
 idle_redraw(struct task *task, uint32_t events)
 {
 	struct window *window = container_of(task, struct window, redraw_task);
+	struct surface *surface = window->main_surface;
+	cairo_rectangle_int_t full;
+	int full_redraw;
 
 	if (window->resize_needed)
 		idle_resize(window);
 
-	widget_redraw(window->main_surface->widget);
+	full.x = 0;
+	full.y = 0;
+	full.width = surface->allocation.width;
+	full.height = surface->allocation.height;
+
+	cairo_region_union(surface->damage, surface->redraw_region);
+	cairo_region_destroy(surface->redraw_region);
+	surface->redraw_region = cairo_region_create();
+
+	if (window->redraw_full)
+		cairo_region_union_rectangle(surface->damage, &full);
+	window->redraw_full = 0;
+
+	/* Pick the buffer up front, so that what it cannot bring
+	 * forward from the last frame is redrawn as well. */
+	if (surface->toysurface)
+		widget_get_cairo_surface(surface->widget);
+
+	full_redraw = !surface_get_damage(surface) ||
+		cairo_region_contains_rectangle(surface->damage, &full) ==
+		CAIRO_REGION_OVERLAP_IN;
+
+	widget_redraw(surface->widget, full_redraw);
 	window->redraw_needed = 0;
 	wl_list_init(&window->redraw_task.link);
 
@@ -3371,8 +3662,8 @@ idle_redraw(struct task *task, uint32_t events)
 	window_flush(window);
 }
 
-void
-window_schedule_redraw(struct window *window)
+static void
+window_schedule_frame(struct window *window)
 {
 	window->redraw_needed = 1;
 	if (!window->redraw_scheduled) {
@@ -3382,6 +3673,13 @@ window_schedule_redraw(struct window *window)
 	}
 }
 
+void
+window_schedule_redraw(struct window *window)
+{
+	window->redraw_full = 1;
+	window_schedule_frame(window);
+}
+
 int
 window_is_fullscreen(struct window *window)
 {
@@ -3540,7 +3838,9 @@ void
 window_damage(struct window *window, int32_t x, int32_t y,
 	      int32_t width, int32_t height)
 {
-	wl_surface_damage(window->main_surface->surface, x, y, width, height);
+	cairo_rectangle_int_t rect = { x, y, width, height };
+
+	cairo_region_union_rectangle(window->main_surface->damage, &rect);
 }
 
 static void
@@ -3616,6 +3916,10 @@ surface_create(struct window *window)
 	surface->window = window;
 	surface->surface = wl_compositor_create_surface(display->compositor);
 	wl_surface_add_listener(surface->surface, &surface_listener, window);
+	/* One buffer on screen, one queued and one to draw into */
+	surface->buffer_depth = 3;
+	surface->redraw_region = cairo_region_create();
+	surface->damage = cairo_region_create();
 
 	return surface;
 }
@@ -3881,6 +4185,12 @@ window_set_buffer_type(struct window *window, enum window_buffer_type type)
 	window->main_surface->buffer_type = type;
 }
 
+void
+window_set_buffer_depth(struct window *window, int depth)
+{
+	window->main_surface->buffer_depth = depth > 1 ? depth : 1;
+}
+
 
 static void
 display_handle_geometry(void *data,
@@ -272,6 +272,8 @@ window_schedule_redraw(struct window *window);
 void
 window_schedule_resize(struct window *window, int width, int height);
 
+/* Add to the damage posted with the buffer being drawn; only
+ * meaningful from a redraw handler. */
 void
 window_damage(struct window *window, int32_t x, int32_t y,
 	      int32_t width, int32_t height);
@@ -297,6 +299,13 @@ display_surface_damage(struct display *display, cairo_surface_t *cairo_surface,
 void
 window_set_buffer_type(struct window *window, enum window_buffer_type type);
 
+/* The number of shm buffers kept around for the window.  More are
+ * allocated while the compositor holds all of them, and freed again
+ * once released.  Like the buffer type, this takes effect when the
+ * window is first drawn. */
+void
+window_set_buffer_depth(struct window *window, int depth);
+
 int
 window_is_fullscreen(struct window *window);
 
@@ -410,6 +419,14 @@ widget_set_axis_handler(struct widget *widget,
 void
 widget_schedule_redraw(struct widget *widget);
 
+/* Redraw only the given area of the window, in the coordinates of
+ * widget allocations.  Redraw handlers can add to what gets damaged
+ * with window_damage() as they draw, so an empty area just runs the
+ * widget's redraw handler on the next frame. */
+void
+widget_schedule_redraw_area(struct widget *widget, int32_t x, int32_t y,
+			    int32_t width, int32_t height);
+
 struct widget *
 frame_create(struct window *window, void *data);
 
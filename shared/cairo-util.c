@@ -46,88 +46,106 @@ surface_flush_device(cairo_surface_t *surface)
 		cairo_device_flush(device);
 }
 
+/* Blur a line of n premultiplied ARGB pixels with a box of width w,
+ * which must be odd, treating pixels beyond the ends as transparent.
+ * Keeps a running sum per channel, so the cost does not depend on w. */
+static void
+box_blur_line(uint32_t *dst, const uint32_t *src, int n, int w)
+{
+	uint32_t sa = 0, sr = 0, sg = 0, sb = 0, p;
+	/* Dividing by w is a multiply and shift; exact for these sums */
+	uint32_t scale = (1 << 24) / w + 1;
+	int i, r = w / 2;
+
+	for (i = 0; i < r && i < n; i++) {
+		p = src[i];
+		sa += p >> 24;
+		sr += (p >> 16) & 0xff;
+		sg += (p >> 8) & 0xff;
+		sb += p & 0xff;
+	}
+
+	for (i = 0; i < n; i++) {
+		if (i + r < n) {
+			p = src[i + r];
+			sa += p >> 24;
+			sr += (p >> 16) & 0xff;
+			sg += (p >> 8) & 0xff;
+			sb += p & 0xff;
+		}
+
+		dst[i] = ((sa + r) * scale >> 24) << 24 |
+			((sr + r) * scale >> 24) << 16 |
+			((sg + r) * scale >> 24) << 8 |
+			((sb + r) * scale >> 24);
+
+		if (i - r >= 0) {
+			p = src[i - r];
+			sa -= p >> 24;
+			sr -= (p >> 16) & 0xff;
+			sg -= (p >> 8) & 0xff;
+			sb -= p & 0xff;
+		}
+	}
+}
+
+/* Three box blurs in a row come within a few percent of a Gaussian.
+ * These widths give a variance of 34, against 35.5 for the 71 tap
+ * kernel exp(-x^2 / 71) that blur_surface() used to apply. */
+static const int blur_boxes[] = { 11, 11, 13 };
+
+/* Blur line in place, using tmp as scratch space of the same size. */
+static void
+blur_line(uint32_t *line, uint32_t *tmp, int n)
+{
+	box_blur_line(tmp, line, n, blur_boxes[0]);
+	box_blur_line(line, tmp, n, blur_boxes[1]);
+	box_blur_line(tmp, line, n, blur_boxes[2]);
+	memcpy(line, tmp, n * sizeof *line);
+}
+
 void
 blur_surface(cairo_surface_t *surface, int margin)
 {
-	int32_t width, height, stride, x, y, z, w;
-	uint8_t *src, *dst;
-	uint32_t *s, *d, a, p;
-	int i, j, k, size, half;
-	uint32_t kernel[71];
-	double f;
-
-	size = ARRAY_LENGTH(kernel);
+	int32_t width, height, stride;
+	uint8_t *data;
+	uint32_t *s, *line, *tmp;
+	int i, j, size;
+
+	cairo_surface_flush(surface);
 	width = cairo_image_surface_get_width(surface);
 	height = cairo_image_surface_get_height(surface);
 	stride = cairo_image_surface_get_stride(surface);
-	src = cairo_image_surface_get_data(surface);
-
-	dst = malloc(height * stride);
+	data = cairo_image_surface_get_data(surface);
 
-	half = size / 2;
-	a = 0;
-	for (i = 0; i < size; i++) {
-		f = (i - half);
-		kernel[i] = exp(- f * f / ARRAY_LENGTH(kernel)) * 10000;
-		a += kernel[i];
-	}
+	size = width > height ? width : height;
+	line = malloc(2 * size * sizeof *line);
+	if (!line)
+		return;
+	tmp = line + size;
 
+	/* Only the pixels within margin of the edges are blurred, in
+	 * each direction. */
 	for (i = 0; i < height; i++) {
-		s = (uint32_t *) (src + i * stride);
-		d = (uint32_t *) (dst + i * stride);
-		for (j = 0; j < width; j++) {
-			if (margin < j && j < width - margin) {
-				d[j] = s[j];
-				continue;
-			}
-
-			x = 0;
-			y = 0;
-			z = 0;
-			w = 0;
-			for (k = 0; k < size; k++) {
-				if (j - half + k < 0 || j - half + k >= width)
-					continue;
-				p = s[j - half + k];
-
-				x += (p >> 24) * kernel[k];
-				y += ((p >> 16) & 0xff) * kernel[k];
-				z += ((p >> 8) & 0xff) * kernel[k];
-				w += (p & 0xff) * kernel[k];
-			}
-			d[j] = (x / a << 24) | (y / a << 16) | (z / a << 8) | w / a;
-		}
+		s = (uint32_t *) (data + i * stride);
+		memcpy(line, s, width * sizeof *line);
+		blur_line(line, tmp, width);
+		for (j = 0; j < width; j++)
+			if (j <= margin || width - margin <= j)
+				s[j] = line[j];
 	}
 
-	for (i = 0; i < height; i++) {
-		s = (uint32_t *) (dst + i * stride);
-		d = (uint32_t *) (src + i * stride);
-		for (j = 0; j < width; j++) {
-			if (margin <= i && i < height - margin) {
-				d[j] = s[j];
-				continue;
-			}
-
-			x = 0;
-			y = 0;
-			z = 0;
-			w = 0;
-			for (k = 0; k < size; k++) {
-				if (i - half + k < 0 || i - half + k >= height)
-					continue;
-				s = (uint32_t *) (dst + (i - half + k) * stride);
-				p = s[j];
-
-				x += (p >> 24) * kernel[k];
-				y += ((p >> 16) & 0xff) * kernel[k];
-				z += ((p >> 8) & 0xff) * kernel[k];
-				w += (p & 0xff) * kernel[k];
-			}
-			d[j] = (x / a << 24) | (y / a << 16) | (z / a << 8) | w / a;
-		}
+	for (j = 0; j < width; j++) {
+		for (i = 0; i < height; i++)
+			line[i] = *(uint32_t *) (data + i * stride + j * 4);
+		blur_line(line, tmp, height);
+		for (i = 0; i < height; i++)
+			if (i < margin || height - margin <= i)
+				*(uint32_t *) (data + i * stride + j * 4) =
+					line[i];
 	}
 
-	free(dst);
+	free(line);
 	cairo_surface_mark_dirty(surface);
 }
 
@@ -297,12 +315,18 @@ rounded_rect(cairo_t *cr, int x0, int y0, int x1, int y1, int radius)
 
 cairo_surface_t *
 load_cairo_surface(const char *filename)
+{
+	return load_cairo_surface_at_size(filename, 0, 0);
+}
+
+cairo_surface_t *
+load_cairo_surface_at_size(const char *filename, int width, int height)
 {
 	pixman_image_t *image;
-	int width, height, stride;
+	int stride;
 	void *data;
 
-	image = load_image(filename);
+	image = load_image_at_size(filename, width, height);
 	if (image == NULL) {
 		return NULL;
 	}
@@ -316,6 +340,60 @@ load_cairo_surface(const char *filename)
 						   width, height, stride);
 }
 
+/* Shadows already rendered, by frame radius.  The entries hold no
+ * reference; a shadow drops out when the last theme using it is
+ * destroyed. */
+static struct {
+	int radius;
+	cairo_surface_t *surface;
+} shadow_cache[4];
+
+static const cairo_user_data_key_t shadow_cache_key;
+
+static void
+shadow_cache_remove(void *data)
+{
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_LENGTH(shadow_cache); i++)
+		if (shadow_cache[i].surface == data)
+			shadow_cache[i].surface = NULL;
+}
+
+static cairo_surface_t *
+theme_get_shadow(int radius)
+{
+	cairo_surface_t *shadow;
+	cairo_t *cr;
+	unsigned int i;
+
+	for (i = 0; i < ARRAY_LENGTH(shadow_cache); i++)
+		if (shadow_cache[i].surface &&
+		    shadow_cache[i].radius == radius)
+			return cairo_surface_reference(shadow_cache[i].surface);
+
+	shadow = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 128, 128);
+	cr = cairo_create(shadow);
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+	cairo_set_source_rgba(cr, 0, 0, 0, 1);
+	rounded_rect(cr, 32, 32, 96, 96, radius);
+	cairo_fill(cr);
+	cairo_destroy(cr);
+	blur_surface(shadow, 64);
+
+	for (i = 0; i < ARRAY_LENGTH(shadow_cache); i++) {
+		if (shadow_cache[i].surface)
+			continue;
+		shadow_cache[i].radius = radius;
+		shadow_cache[i].surface = shadow;
+		cairo_surface_set_user_data(shadow, &shadow_cache_key,
+					    shadow, shadow_cache_remove);
+		break;
+	}
+
+	return shadow;
+}
+
 struct theme *
 theme_create(void)
 {
@@ -328,14 +406,9 @@ theme_create(void)
 	t->width = 6;
 	t->titlebar_height = 27;
 	t->frame_radius = 3;
-	t->shadow = cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 128, 128);
-	cr = cairo_create(t->shadow);
-	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
-	cairo_set_source_rgba(cr, 0, 0, 0, 1);
-	rounded_rect(cr, 32, 32, 96, 96, t->frame_radius);
-	cairo_fill(cr);
-	cairo_destroy(cr);
-	blur_surface(t->shadow, 64);
+	t->shadow = theme_get_shadow(t->frame_radius);
+	t->decoration[0] = NULL;
+	t->decoration[1] = NULL;
 
 	t->active_frame =
 		cairo_image_surface_create (CAIRO_FORMAT_ARGB32, 128, 128);
@@ -370,18 +443,20 @@ theme_destroy(struct theme *t)
 	cairo_surface_destroy(t->active_frame);
 	cairo_surface_destroy(t->inactive_frame);
 	cairo_surface_destroy(t->shadow);
+	if (t->decoration[0])
+		cairo_surface_destroy(t->decoration[0]);
+	if (t->decoration[1])
+		cairo_surface_destroy(t->decoration[1]);
 	free(t);
 }
 
-void
-theme_render_frame(struct theme *t,
-		   cairo_t *cr, int width, int height,
-		   const char *title, uint32_t flags)
+/* Shadow and frame, everything but the title. */
+static void
+theme_render_decoration(struct theme *t, cairo_t *cr,
+			int width, int height, uint32_t flags)
 {
-	cairo_text_extents_t extents;
-	cairo_font_extents_t font_extents;
 	cairo_surface_t *source;
-	int x, y, margin;
+	int margin;
 
 	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
 	cairo_set_source_rgba(cr, 0, 0, 0, 0);
@@ -406,6 +481,108 @@ theme_render_frame(struct theme *t,
 		    margin, margin,
 		    width - margin * 2, height - margin * 2,
 		    t->width, t->titlebar_height);
+}
+
+/*
+ * A decoration that is not maximized is the same for every window
+ * size, except that the middle of each edge gets longer, and the
+ * middle of every edge is uniform along it.  So it is rendered once
+ * per state at DECORATION_SIZE and then put together from nine slices
+ * of that: the corners as they are, the middle DECORATION_STRETCH
+ * pixels of the edges stretched.  The corners must take in the 64
+ * pixel corners of the shadow, drawn from (2, 2) and 8 pixels larger
+ * than the window, and with that the frame corners.
+ */
+#define DECORATION_LEFT		(2 + 64)
+#define DECORATION_RIGHT	(64 - 8 - 2)
+#define DECORATION_STRETCH	8
+#define DECORATION_SIZE		\
+	(DECORATION_LEFT + DECORATION_STRETCH + DECORATION_RIGHT)
+
+static cairo_surface_t *
+theme_get_decoration(struct theme *t, uint32_t flags)
+{
+	int active = !!(flags & THEME_FRAME_ACTIVE);
+	cairo_t *cr;
+
+	if (t->decoration[active])
+		return t->decoration[active];
+
+	t->decoration[active] =
+		cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+					   DECORATION_SIZE, DECORATION_SIZE);
+	cr = cairo_create(t->decoration[active]);
+	theme_render_decoration(t, cr, DECORATION_SIZE, DECORATION_SIZE,
+				flags & THEME_FRAME_ACTIVE);
+	cairo_destroy(cr);
+
+	return t->decoration[active];
+}
+
+static void
+theme_blit_decoration(struct theme *t, cairo_t *cr,
+		      int width, int height, uint32_t flags)
+{
+	static const int src[] = {
+		0, DECORATION_LEFT, DECORATION_LEFT + DECORATION_STRETCH,
+		DECORATION_SIZE
+	};
+	int dst_x[] = {
+		0, DECORATION_LEFT, width - DECORATION_RIGHT, width
+	};
+	int dst_y[] = {
+		0, DECORATION_LEFT, height - DECORATION_RIGHT, height
+	};
+	cairo_pattern_t *pattern;
+	cairo_matrix_t matrix;
+	int i, j, w, h;
+
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	pattern = cairo_pattern_create_for_surface(
+		theme_get_decoration(t, flags));
+	cairo_pattern_set_filter(pattern, CAIRO_FILTER_NEAREST);
+	cairo_set_source(cr, pattern);
+	cairo_pattern_destroy(pattern);
+
+	for (i = 0; i < 3; i++) {
+		for (j = 0; j < 3; j++) {
+			w = dst_x[j + 1] - dst_x[j];
+			h = dst_y[i + 1] - dst_y[i];
+
+			cairo_matrix_init_translate(&matrix, src[j], src[i]);
+			cairo_matrix_scale(&matrix,
+					   (double) (src[j + 1] - src[j]) / w,
+					   (double) (src[i + 1] - src[i]) / h);
+			cairo_matrix_translate(&matrix, -dst_x[j], -dst_y[i]);
+			cairo_pattern_set_matrix(pattern, &matrix);
+
+			cairo_rectangle(cr, dst_x[j], dst_y[i], w, h);
+			cairo_fill(cr);
+		}
+	}
+}
+
+void
+theme_render_frame(struct theme *t,
+		   cairo_t *cr, int width, int height,
+		   const char *title, uint32_t flags)
+{
+	cairo_text_extents_t extents;
+	cairo_font_extents_t font_extents;
+	int x, y, margin;
+
+	/* Any smaller and the slices would overlap. */
+	if (!(flags & THEME_FRAME_MAXIMIZED) &&
+	    width >= DECORATION_SIZE &&
+	    height >= DECORATION_SIZE)
+		theme_blit_decoration(t, cr, width, height, flags);
+	else
+		theme_render_decoration(t, cr, width, height, flags);
+
+	if (flags & THEME_FRAME_MAXIMIZED)
+		margin = 0;
+	else
+		margin = t->margin;
 
 	cairo_rectangle (cr, margin + t->width, margin,
 			 width - (margin + t->width) * 2,
@@ -45,10 +45,14 @@ rounded_rect(cairo_t *cr, int x0, int y0, int x1, int y1, int radius);
 cairo_surface_t *
 load_cairo_surface(const char *filename);
 
+cairo_surface_t *
+load_cairo_surface_at_size(const char *filename, int width, int height);
+
 struct theme {
 	cairo_surface_t *active_frame;
 	cairo_surface_t *inactive_frame;
 	cairo_surface_t *shadow;
+	cairo_surface_t *decoration[2];	/* inactive, active */
 	int frame_radius;
 	int margin;
 	int width;
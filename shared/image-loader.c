@@ -25,10 +25,16 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+#include <endian.h>
 #include <jpeglib.h>
 #include <png.h>
 #include <pixman.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "image-loader.h"
 
 #define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
@@ -43,6 +49,23 @@ stride_for_width(int width)
 	return width * 4;
 }
 
+/* The integer factor to shrink a width x height image by while keeping
+ * it at least target_width x target_height; a target of 0 leaves that
+ * direction unconstrained. */
+static int
+downscale_factor(int width, int height, int target_width, int target_height)
+{
+	int factor = 0;
+
+	if (target_width > 0)
+		factor = width / target_width;
+	if (target_height > 0 && (factor == 0 || height / target_height < factor))
+		factor = height / target_height;
+
+	return factor > 1 ? factor : 1;
+}
+
+#ifndef JCS_EXTENSIONS
 static void
 swizzle_row(JSAMPLE *row, JDIMENSION width)
 {
@@ -57,6 +80,7 @@ swizzle_row(JSAMPLE *row, JDIMENSION width)
 		d--;
 	}
 }
+#endif
 
 static void
 error_exit(j_common_ptr cinfo)
@@ -71,13 +95,13 @@ pixman_image_destroy_func(pixman_image_t *image, void *data)
 }
 
 static pixman_image_t *
-load_jpeg(FILE *fp)
+load_jpeg(FILE *fp, int target_width, int target_height)
 {
 	struct jpeg_decompress_struct cinfo;
 	struct jpeg_error_mgr jerr;
 	pixman_image_t *pixman_image = NULL;
 	unsigned int i;
-	int stride, first;
+	int stride, first, factor;
 	JSAMPLE *data, *rows[4];
 	jmp_buf env;
 
@@ -93,7 +117,27 @@ load_jpeg(FILE *fp)
 
 	jpeg_read_header(&cinfo, TRUE);
 
+	/* Let the IDCT do the downscaling: decoding at 1/2, 1/4 or 1/8
+	 * scale skips most of the work, not just the memory. */
+	factor = downscale_factor(cinfo.image_width, cinfo.image_height,
+				  target_width, target_height);
+	cinfo.scale_num = 1;
+	cinfo.scale_denom = 1;
+	while (cinfo.scale_denom < 8 &&
+	       cinfo.scale_denom * 2 <= (unsigned int) factor)
+		cinfo.scale_denom *= 2;
+
+#ifdef JCS_EXTENSIONS
+	/* libjpeg-turbo writes pixman's layout directly, with alpha set
+	 * to 0xff. */
+#if __BYTE_ORDER == __LITTLE_ENDIAN
+	cinfo.out_color_space = JCS_EXT_BGRA;
+#else
+	cinfo.out_color_space = JCS_EXT_ARGB;
+#endif
+#else
 	cinfo.out_color_space = JCS_RGB;
+#endif
 	jpeg_start_decompress(&cinfo);
 
 	stride = cinfo.output_width * 4;
@@ -109,8 +153,10 @@ load_jpeg(FILE *fp)
 			rows[i] = data + (first + i) * stride;
 
 		jpeg_read_scanlines(&cinfo, rows, ARRAY_LENGTH(rows));
+#ifndef JCS_EXTENSIONS
 		for (i = 0; first + i < cinfo.output_scanline; i++)
 			swizzle_row(rows[i], cinfo.output_width);
+#endif
 	}
 
 	jpeg_finish_decompress(&cinfo);
@@ -136,15 +182,58 @@ multiply_alpha(int alpha, int color)
     return ((temp + (temp >> 8)) >> 8);
 }
 
+#ifdef __SSE2__
+/* Premultiply four RGBA pixels at a time into native ARGB, with the
+ * same rounding as multiply_alpha(). */
+static png_bytep
+premultiply_sse2(png_bytep p, png_bytep end)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(0x80);
+	const __m128i color_mask = _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1);
+	const __m128i alpha_one = _mm_set_epi16(0xff, 0, 0, 0, 0xff, 0, 0, 0);
+	__m128i v, lo, hi;
+
+#define PREMULTIPLY(x) do {						\
+	__m128i a = _mm_shufflehi_epi16(				\
+		_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 3, 3, 3)),	\
+		_MM_SHUFFLE(3, 3, 3, 3));				\
+	a = _mm_or_si128(_mm_and_si128(a, color_mask), alpha_one);	\
+	x = _mm_add_epi16(_mm_mullo_epi16(x, a), round);		\
+	x = _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);	\
+	/* RGBA to BGRA, that is ARGB in a little endian word */	\
+	x = _mm_shufflehi_epi16(					\
+		_mm_shufflelo_epi16(x, _MM_SHUFFLE(3, 0, 1, 2)),	\
+		_MM_SHUFFLE(3, 0, 1, 2));				\
+} while (0)
+
+	for (; p + 16 <= end; p += 16) {
+		v = _mm_loadu_si128((__m128i *) p);
+		lo = _mm_unpacklo_epi8(v, zero);
+		hi = _mm_unpackhi_epi8(v, zero);
+		PREMULTIPLY(lo);
+		PREMULTIPLY(hi);
+		_mm_storeu_si128((__m128i *) p, _mm_packus_epi16(lo, hi));
+	}
+
+#undef PREMULTIPLY
+
+	return p;
+}
+#endif
+
 static void
 premultiply_data(png_structp   png,
 		 png_row_infop row_info,
 		 png_bytep     data)
 {
-    unsigned int i;
-    png_bytep p;
+    png_bytep p = data, end = data + row_info->rowbytes;
 
-    for (i = 0, p = data; i < row_info->rowbytes; i += 4, p += 4) {
+#ifdef __SSE2__
+    p = premultiply_sse2(p, end);
+#endif
+
+    for (; p < end; p += 4) {
 	png_byte  alpha = p[3];
 	uint32_t w;
 
@@ -182,15 +271,60 @@ png_error_callback(png_structp png, png_const_charp error_msg)
     longjmp (png_jmpbuf (png), 1);
 }
 
+/* Largest factor downscale_row() handles, keeping the sums of a
+ * factor x factor block of 8 bit channels within 32 bits. */
+#define MAX_DOWNSCALE_FACTOR 1024
+
+/* Add a row of width pixels to the per channel sums of its blocks of
+ * factor pixels. */
+static void
+downscale_add_row(uint32_t *sums, const uint32_t *row, int width, int factor)
+{
+	uint32_t p;
+	int x, end;
+
+	for (x = 0; x < width; sums += 4) {
+		end = x + factor < width ? x + factor : width;
+		for (; x < end; x++) {
+			p = row[x];
+			sums[0] += p >> 24;
+			sums[1] += (p >> 16) & 0xff;
+			sums[2] += (p >> 8) & 0xff;
+			sums[3] += p & 0xff;
+		}
+	}
+}
+
+/* Average the blocks summed up from rows rows, and clear the sums for
+ * the next row of blocks. */
+static void
+downscale_store_row(uint32_t *dst, uint32_t *sums,
+		    int width, int factor, int rows)
+{
+	uint32_t n;
+	int x;
+
+	for (x = 0; x < width; x += factor, sums += 4) {
+		n = (x + factor < width ? factor : width - x) * rows;
+		*dst++ = (sums[0] + n / 2) / n << 24 |
+			(sums[1] + n / 2) / n << 16 |
+			(sums[2] + n / 2) / n << 8 |
+			(sums[3] + n / 2) / n;
+		memset(sums, 0, 4 * sizeof *sums);
+	}
+}
+
 static pixman_image_t *
-load_png(FILE *fp)
+load_png(FILE *fp, int target_width, int target_height)
 {
 	png_struct *png;
 	png_info *info;
 	png_byte *data = NULL;
 	png_byte **row_pointers = NULL;
-	png_uint_32 width, height;
-	int depth, color_type, interlace, stride;
+	png_byte *row = NULL;
+	uint32_t *sums = NULL;
+	png_uint_32 width, height, out_width, out_height, y;
+	int depth, color_type, interlace, stride, factor;
 	unsigned int i;
 	pixman_image_t *pixman_image = NULL;
 
@@ -210,6 +344,8 @@ load_png(FILE *fp)
 			free(data);
 		if (row_pointers)
 			free(row_pointers);
+		free(row);
+		free(sums);
 		png_destroy_read_struct(&png, &info, NULL);
 		return NULL;
 	}
@@ -250,13 +386,56 @@ load_png(FILE *fp)
 		     &color_type, &interlace, NULL, NULL);
 
 
-	stride = stride_for_width(width);
-	data = malloc(stride * height);
+	/* Interlaced images come in several passes over the whole
+	 * image, so only progressive ones can be scaled row by row. */
+	factor = 1;
+	if (interlace == PNG_INTERLACE_NONE)
+		factor = downscale_factor(width, height,
+					  target_width, target_height);
+	if (factor > MAX_DOWNSCALE_FACTOR)
+		factor = MAX_DOWNSCALE_FACTOR;
+	out_width = (width + factor - 1) / factor;
+	out_height = (height + factor - 1) / factor;
+
+	stride = stride_for_width(out_width);
+	data = malloc(stride * out_height);
 	if (!data) {
 		png_destroy_read_struct(&png, &info, NULL);
 		return NULL;
 	}
 
+	if (factor > 1) {
+		row = malloc(stride_for_width(width));
+		sums = calloc(out_width * 4, sizeof *sums);
+		if (!row || !sums) {
+			free(row);
+			free(sums);
+			free(data);
+			png_destroy_read_struct(&png, &info, NULL);
+			return NULL;
+		}
+
+		for (y = 0; y < height; y++) {
+			png_read_row(png, row, NULL);
+			downscale_add_row(sums, (uint32_t *) row,
+					  width, factor);
+			if ((y + 1) % factor == 0 || y + 1 == height)
+				downscale_store_row((uint32_t *)
+						    (data + y / factor * stride),
+						    sums, width, factor,
+						    y % factor + 1);
+		}
+		png_read_end(png, info);
+
+		free(row);
+		free(sums);
+		png_destroy_read_struct(&png, &info, NULL);
+
+		width = out_width;
+		height = out_height;
+		goto out;
+	}
+
 	row_pointers = malloc(height * sizeof row_pointers[0]);
 	if (row_pointers == NULL) {
 		free(data);
@@ -273,6 +452,7 @@ load_png(FILE *fp)
 	free(row_pointers);
 	png_destroy_read_struct(&png, &info, NULL);
 
+out:
 	pixman_image = pixman_image_create_bits(PIXMAN_a8r8g8b8,
 				width, height, (uint32_t *) data, stride);
 
@@ -285,11 +465,11 @@ load_png(FILE *fp)
 #ifdef HAVE_WEBP
 
 static pixman_image_t *
-load_webp(FILE *fp)
+load_webp(FILE *fp, int target_width, int target_height)
 {
 	WebPDecoderConfig config;
 	uint8_t buffer[16 * 1024];
-	int len;
+	int len, factor, width, height;
 	VP8StatusCode status;
 	WebPIDecoder *idec;
 
@@ -308,12 +488,24 @@ load_webp(FILE *fp)
 		return NULL;
 	}
 
+	/* The decoder scales while it outputs rows. */
+	width = config.input.width;
+	height = config.input.height;
+	factor = downscale_factor(width, height, target_width, target_height);
+	if (factor > 1) {
+		width = (width + factor - 1) / factor;
+		height = (height + factor - 1) / factor;
+		config.options.use_scaling = 1;
+		config.options.scaled_width = width;
+		config.options.scaled_height = height;
+	}
+
 	config.output.colorspace = MODE_BGRA;
-	config.output.u.RGBA.stride = stride_for_width(config.input.width);
+	config.output.u.RGBA.stride = stride_for_width(width);
 	config.output.u.RGBA.size =
-		config.output.u.RGBA.stride * config.input.height;
+		config.output.u.RGBA.stride * height;
 	config.output.u.RGBA.rgba =
-		malloc(config.output.u.RGBA.stride * config.input.height);
+		malloc(config.output.u.RGBA.stride * height);
 	config.output.is_external_memory = 1;
 	if (!config.output.u.RGBA.rgba) {
 		WebPFreeDecBuffer(&config.output);
@@ -321,7 +513,7 @@ load_webp(FILE *fp)
 	}
 
 	rewind(fp);
-	idec = WebPINewDecoder(&config.output);
+	idec = WebPIDecode(NULL, 0, &config);
 	if (!idec) {
 		WebPFreeDecBuffer(&config.output);
 		return NULL;
@@ -342,8 +534,7 @@ load_webp(FILE *fp)
 	WebPFreeDecBuffer(&config.output);
 
 	return pixman_image_create_bits(PIXMAN_a8r8g8b8,
-					config.input.width,
-					config.input.height,
+					width, height,
 					(uint32_t *) config.output.u.RGBA.rgba,
 					config.output.u.RGBA.stride);
 }
@@ -354,7 +545,7 @@ load_webp(FILE *fp)
 struct image_loader {
 	unsigned char header[4];
 	int header_size;
-	pixman_image_t *(*load)(FILE *fp);
+	pixman_image_t *(*load)(FILE *fp, int width, int height);
 };
 
 static const struct image_loader loaders[] = {
@@ -366,7 +557,7 @@ static const struct image_loader loaders[] = {
 };
 
 pixman_image_t *
-load_image(const char *filename)
+load_image_at_size(const char *filename, int width, int height)
 {
 	pixman_image_t *image;
 	unsigned char header[4];
@@ -386,7 +577,7 @@ load_image(const char *filename)
 	for (i = 0; i < ARRAY_LENGTH(loaders); i++) {
 		if (memcmp(header, loaders[i].header,
 			   loaders[i].header_size) == 0) {
-			image = loaders[i].load(fp);
+			image = loaders[i].load(fp, width, height);
 			break;
 		}
 	}
@@ -402,3 +593,9 @@ load_image(const char *filename)
 
 	return image;
 }
+
+pixman_image_t *
+load_image(const char *filename)
+{
+	return load_image_at_size(filename, 0, 0);
+}
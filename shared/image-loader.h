@@ -28,4 +28,12 @@
 pixman_image_t *
 load_image(const char *filename);
 
+/* Load an image for display at width x height.  Where the format allows
+ * it, the image is shrunk by an integer factor while it is decoded, so
+ * the result keeps its aspect ratio and is at least width x height, or
+ * the full size if that is smaller.  The caller does any final scaling.
+ * A width or height of 0 leaves that direction unconstrained. */
+pixman_image_t *
+load_image_at_size(const char *filename, int width, int height);
+
 #endif
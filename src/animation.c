@@ -29,6 +29,7 @@
 #include <fcntl.h>
 
 #include "compositor.h"
+#include "../shared/timespec-util.h"
 
 WL_EXPORT void
 weston_spring_init(struct weston_spring *spring,
@@ -42,23 +43,26 @@ weston_spring_init(struct weston_spring *spring,
 }
 
 WL_EXPORT void
-weston_spring_update(struct weston_spring *spring, uint32_t msec)
+weston_spring_update(struct weston_spring *spring,
+		     const struct timespec *time)
 {
 	double force, v, current, step;
 
 	/* Limit the number of executions of the loop below by ensuring that
 	 * the timestamp for last update of the spring is no more than 1s ago.
-	 * This handles the case where time moves backwards or forwards in
-	 * large jumps.
+	 * The clock is monotonic, but a frame can still be delayed by a
+	 * long time, for example across a VT switch.
 	 */
-	if (msec - spring->timestamp > 1000) {
-		weston_log("unexpectedly large timestamp jump (from %u to %u)\n",
-			   spring->timestamp, msec);
-		spring->timestamp = msec - 1000;
+	if (timespec_sub_to_msec(time, &spring->timestamp) > 1000) {
+		weston_log("unexpectedly large timestamp jump "
+			   "(from %u to %u)\n",
+			   timespec_to_msec(&spring->timestamp),
+			   timespec_to_msec(time));
+		timespec_add_msec(&spring->timestamp, time, -1000);
 	}
 
 	step = 0.01;
-	while (4 < msec - spring->timestamp) {
+	while (timespec_sub_to_msec(time, &spring->timestamp) > 4) {
 		current = spring->current;
 		v = current - spring->previous;
 		force = spring->k * (spring->target - current) / 10.0 +
@@ -85,7 +89,8 @@ weston_spring_update(struct weston_spring *spring, uint32_t msec)
 			spring->previous = 0.0;
 		}
 #endif
-		spring->timestamp += 4;
+		timespec_add_msec(&spring->timestamp,
+				  &spring->timestamp, 4);
 	}
 }
 
@@ -134,16 +139,17 @@ handle_animation_surface_destroy(struct wl_listener *listener, void *data)
 
 static void
 weston_surface_animation_frame(struct weston_animation *base,
-			       struct weston_output *output, uint32_t msecs)
+			       struct weston_output *output,
+			       const struct timespec *time)
 {
 	struct weston_surface_animation *animation =
 		container_of(base,
 			     struct weston_surface_animation, animation);
 
 	if (base->frame_counter <= 1)
-		animation->spring.timestamp = msecs;
+		animation->spring.timestamp = *time;
 
-	weston_spring_update(&animation->spring, msecs);
+	weston_spring_update(&animation->spring, time);
 
 	if (weston_spring_done(&animation->spring)) {
 		weston_surface_animation_destroy(animation);
@@ -165,6 +171,7 @@ weston_surface_animation_run(struct weston_surface *surface,
 			     void *data)
 {
 	struct weston_surface_animation *animation;
+	struct timespec now;
 
 	animation = malloc(sizeof *animation);
 	if (!animation)
@@ -183,7 +190,8 @@ weston_surface_animation_run(struct weston_surface *surface,
 	animation->spring.friction = 700;
 	animation->animation.frame_counter = 0;
 	animation->animation.frame = weston_surface_animation_frame;
-	weston_surface_animation_frame(&animation->animation, NULL, 0);
+	weston_compositor_read_clock(&now);
+	weston_surface_animation_frame(&animation->animation, NULL, &now);
 
 	animation->listener.notify = handle_animation_surface_destroy;
 	wl_signal_add(&surface->surface.resource.destroy_signal,
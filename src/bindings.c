@@ -32,8 +32,105 @@ struct weston_binding {
 	void *handler;
 	void *data;
 	struct wl_list link;
+
+	/* Lookup table this binding is in, 'code' is whichever of key,
+	 * button or axis the table is keyed on and 'seq' preserves the
+	 * list order among bindings with equal keys. */
+	struct weston_binding_index *index;
+	uint32_t code;
+	uint32_t seq;
 };
 
+WL_EXPORT void
+weston_binding_index_init(struct weston_binding_index *index)
+{
+	wl_array_init(&index->bindings);
+	index->serial = 1;
+	index->built_serial = 0;
+	index->next_seq = 0;
+}
+
+WL_EXPORT void
+weston_binding_index_release(struct weston_binding_index *index)
+{
+	wl_array_release(&index->bindings);
+}
+
+static int
+binding_compare(const void *a, const void *b)
+{
+	const struct weston_binding *ba = *(struct weston_binding * const *) a;
+	const struct weston_binding *bb = *(struct weston_binding * const *) b;
+
+	if (ba->code != bb->code)
+		return ba->code < bb->code ? -1 : 1;
+	if (ba->modifier != bb->modifier)
+		return ba->modifier < bb->modifier ? -1 : 1;
+	if (ba->seq != bb->seq)
+		return ba->seq < bb->seq ? -1 : 1;
+
+	return 0;
+}
+
+static void
+binding_index_rebuild(struct weston_binding_index *index,
+		      struct wl_list *list)
+{
+	struct weston_binding *binding, **p;
+
+	index->bindings.size = 0;
+	wl_list_for_each(binding, list, link) {
+		p = wl_array_add(&index->bindings, sizeof *p);
+		if (p == NULL) {
+			index->bindings.size = 0;
+			return;
+		}
+		*p = binding;
+	}
+
+	qsort(index->bindings.data,
+	      index->bindings.size / sizeof *p, sizeof *p, binding_compare);
+	index->built_serial = index->serial;
+}
+
+/* Find the run of bindings matching (code, modifier), in the order
+ * they were added. Returns the number of matches and sets *first. */
+static int
+binding_index_lookup(struct weston_binding_index *index,
+		     struct wl_list *list,
+		     uint32_t code, uint32_t modifier,
+		     struct weston_binding ***first)
+{
+	struct weston_binding **bindings;
+	int lo, hi, mid, end;
+
+	if (index->built_serial != index->serial)
+		binding_index_rebuild(index, list);
+
+	bindings = index->bindings.data;
+	lo = 0;
+	hi = index->bindings.size / sizeof *bindings;
+	while (lo < hi) {
+		mid = (lo + hi) / 2;
+		if (bindings[mid]->code < code ||
+		    (bindings[mid]->code == code &&
+		     bindings[mid]->modifier < modifier))
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	end = lo;
+	while (end < (int) (index->bindings.size / sizeof *bindings) &&
+	       bindings[end]->code == code &&
+	       bindings[end]->modifier == modifier)
+		end++;
+
+	*first = &bindings[lo];
+
+	return end - lo;
+}
+
 static struct weston_binding *
 weston_compositor_add_binding(struct weston_compositor *compositor,
 			      uint32_t key, uint32_t button, uint32_t axis,
@@ -55,6 +152,18 @@ weston_compositor_add_binding(struct weston_compositor *compositor,
 	return binding;
 }
 
+static void
+binding_insert(struct weston_binding *binding, struct wl_list *list,
+	       struct weston_binding_index *index, uint32_t code)
+{
+	wl_list_insert(list->prev, &binding->link);
+
+	binding->index = index;
+	binding->code = code;
+	binding->seq = index->next_seq++;
+	index->serial++;
+}
+
 WL_EXPORT struct weston_binding *
 weston_compositor_add_key_binding(struct weston_compositor *compositor,
 				  uint32_t key, uint32_t modifier,
@@ -68,7 +177,8 @@ weston_compositor_add_key_binding(struct weston_compositor *compositor,
 	if (binding == NULL)
 		return NULL;
 
-	wl_list_insert(compositor->key_binding_list.prev, &binding->link);
+	binding_insert(binding, &compositor->key_binding_list,
+		       &compositor->key_binding_index, key);
 
 	return binding;
 }
@@ -86,7 +196,8 @@ weston_compositor_add_button_binding(struct weston_compositor *compositor,
 	if (binding == NULL)
 		return NULL;
 
-	wl_list_insert(compositor->button_binding_list.prev, &binding->link);
+	binding_insert(binding, &compositor->button_binding_list,
+		       &compositor->button_binding_index, button);
 
 	return binding;
 }
@@ -104,7 +215,8 @@ weston_compositor_add_axis_binding(struct weston_compositor *compositor,
 	if (binding == NULL)
 		return NULL;
 
-	wl_list_insert(compositor->axis_binding_list.prev, &binding->link);
+	binding_insert(binding, &compositor->axis_binding_list,
+		       &compositor->axis_binding_index, axis);
 
 	return binding;
 }
@@ -119,8 +231,11 @@ weston_compositor_add_debug_binding(struct weston_compositor *compositor,
 
 	binding = weston_compositor_add_binding(compositor, key, 0, 0, 0,
 						handler, data);
+	if (binding == NULL)
+		return NULL;
 
-	wl_list_insert(compositor->debug_binding_list.prev, &binding->link);
+	binding_insert(binding, &compositor->debug_binding_list,
+		       &compositor->debug_binding_index, key);
 
 	return binding;
 }
@@ -128,6 +243,7 @@ weston_compositor_add_debug_binding(struct weston_compositor *compositor,
 WL_EXPORT void
 weston_binding_destroy(struct weston_binding *binding)
 {
+	binding->index->serial++;
 	wl_list_remove(&binding->link);
 	free(binding);
 }
@@ -211,23 +327,33 @@ weston_compositor_run_key_binding(struct weston_compositor *compositor,
 				  uint32_t time, uint32_t key,
 				  enum wl_keyboard_key_state state)
 {
-	struct weston_binding *b;
+	struct weston_binding_index *index = &compositor->key_binding_index;
+	struct weston_binding **b;
+	weston_key_binding_handler_t handler;
+	uint32_t serial;
+	int i, count;
 
 	if (state == WL_KEYBOARD_KEY_STATE_RELEASED)
 		return;
 
-	wl_list_for_each(b, &compositor->key_binding_list, link) {
-		if (b->key == key && b->modifier == seat->modifier_state) {
-			weston_key_binding_handler_t handler = b->handler;
-			handler(&seat->seat, time, key, b->data);
-
-			/* If this was a key binding and it didn't
-			 * install a keyboard grab, install one now to
-			 * swallow the key release. */
-			if (seat->seat.keyboard->grab ==
-			    &seat->seat.keyboard->default_grab)
-				install_binding_grab(&seat->seat, time, key);
-		}
+	count = binding_index_lookup(index, &compositor->key_binding_list,
+				     key, seat->modifier_state, &b);
+	serial = index->serial;
+	for (i = 0; i < count; i++) {
+		handler = b[i]->handler;
+		handler(&seat->seat, time, key, b[i]->data);
+
+		/* If this was a key binding and it didn't
+		 * install a keyboard grab, install one now to
+		 * swallow the key release. */
+		if (seat->seat.keyboard->grab ==
+		    &seat->seat.keyboard->default_grab)
+			install_binding_grab(&seat->seat, time, key);
+
+		/* The handler added or removed bindings, the
+		 * remaining entries may be stale. */
+		if (index->serial != serial)
+			break;
 	}
 }
 
@@ -237,16 +363,21 @@ weston_compositor_run_button_binding(struct weston_compositor *compositor,
 				     uint32_t time, uint32_t button,
 				     enum wl_pointer_button_state state)
 {
-	struct weston_binding *b;
+	struct weston_binding_index *index = &compositor->button_binding_index;
+	struct weston_binding **b;
+	weston_button_binding_handler_t handler;
+	uint32_t serial;
+	int i, count;
 
 	if (state == WL_POINTER_BUTTON_STATE_RELEASED)
 		return;
 
-	wl_list_for_each(b, &compositor->button_binding_list, link) {
-		if (b->button == button && b->modifier == seat->modifier_state) {
-			weston_button_binding_handler_t handler = b->handler;
-			handler(&seat->seat, time, button, b->data);
-		}
+	count = binding_index_lookup(index, &compositor->button_binding_list,
+				     button, seat->modifier_state, &b);
+	serial = index->serial;
+	for (i = 0; i < count && index->serial == serial; i++) {
+		handler = b[i]->handler;
+		handler(&seat->seat, time, button, b[i]->data);
 	}
 }
 
@@ -256,13 +387,18 @@ weston_compositor_run_axis_binding(struct weston_compositor *compositor,
 				   uint32_t time, uint32_t axis,
 				   wl_fixed_t value)
 {
-	struct weston_binding *b;
-
-	wl_list_for_each(b, &compositor->axis_binding_list, link) {
-		if (b->axis == axis && b->modifier == seat->modifier_state) {
-			weston_axis_binding_handler_t handler = b->handler;
-			handler(&seat->seat, time, axis, value, b->data);
-		}
+	struct weston_binding_index *index = &compositor->axis_binding_index;
+	struct weston_binding **b;
+	weston_axis_binding_handler_t handler;
+	uint32_t serial;
+	int i, count;
+
+	count = binding_index_lookup(index, &compositor->axis_binding_list,
+				     axis, seat->modifier_state, &b);
+	serial = index->serial;
+	for (i = 0; i < count && index->serial == serial; i++) {
+		handler = b[i]->handler;
+		handler(&seat->seat, time, axis, value, b[i]->data);
 	}
 }
 
@@ -272,17 +408,19 @@ weston_compositor_run_debug_binding(struct weston_compositor *compositor,
 				    uint32_t time, uint32_t key,
 				    enum wl_keyboard_key_state state)
 {
+	struct weston_binding_index *index = &compositor->debug_binding_index;
 	weston_key_binding_handler_t handler;
-	struct weston_binding *binding;
-	int count = 0;
-
-	wl_list_for_each(binding, &compositor->debug_binding_list, link) {
-		if (key != binding->key)
-			continue;
-
-		count++;
-		handler = binding->handler;
-		handler(&seat->seat, time, key, binding->data);
+	struct weston_binding **b;
+	uint32_t serial;
+	int i, count;
+
+	/* Debug bindings are always added with no modifier. */
+	count = binding_index_lookup(index, &compositor->debug_binding_list,
+				     key, 0, &b);
+	serial = index->serial;
+	for (i = 0; i < count && index->serial == serial; i++) {
+		handler = b[i]->handler;
+		handler(&seat->seat, time, key, b[i]->data);
 	}
 
 	return count;
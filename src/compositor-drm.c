@@ -46,6 +46,10 @@
 #include "udev-seat.h"
 #include "launcher-util.h"
 
+#ifndef DRM_CAP_TIMESTAMP_MONOTONIC
+#define DRM_CAP_TIMESTAMP_MONOTONIC 0x6
+#endif
+
 static int option_current_mode = 0;
 static char *output_name;
 static char *output_mode;
@@ -106,6 +110,7 @@ struct drm_compositor {
 	int cursors_are_broken;
 
 	int use_pixman;
+	int clock_monotonic;
 
 	uint32_t prev_state;
 };
@@ -622,13 +627,33 @@ drm_output_repaint(struct weston_output *output_base,
 	return;
 }
 
+static void
+drm_compositor_convert_timestamp(struct drm_output *output,
+				 unsigned int sec, unsigned int usec,
+				 struct timespec *ts)
+{
+	struct drm_compositor *c =
+		(struct drm_compositor *) output->base.compositor;
+
+	/* Old kernels report vblank timestamps in CLOCK_REALTIME, which is
+	 * not comparable with our internal clock. Use the time of the
+	 * event delivery instead in that case. */
+	if (!c->clock_monotonic) {
+		weston_compositor_read_clock(ts);
+		return;
+	}
+
+	ts->tv_sec = sec;
+	ts->tv_nsec = usec * 1000;
+}
+
 static void
 vblank_handler(int fd, unsigned int frame, unsigned int sec, unsigned int usec,
 	       void *data)
 {
 	struct drm_sprite *s = (struct drm_sprite *)data;
 	struct drm_output *output = s->output;
-	uint32_t msecs;
+	struct timespec ts;
 
 	output->vblank_pending = 0;
 
@@ -637,8 +662,8 @@ vblank_handler(int fd, unsigned int frame, unsigned int sec, unsigned int usec,
 	s->next = NULL;
 
 	if (!output->page_flip_pending) {
-		msecs = sec * 1000 + usec / 1000;
-		weston_output_finish_frame(&output->base, msecs);
+		drm_compositor_convert_timestamp(output, sec, usec, &ts);
+		weston_output_finish_frame(&output->base, &ts);
 	}
 }
 
@@ -647,7 +672,7 @@ page_flip_handler(int fd, unsigned int frame,
 		  unsigned int sec, unsigned int usec, void *data)
 {
 	struct drm_output *output = (struct drm_output *) data;
-	uint32_t msecs;
+	struct timespec ts;
 
 	output->page_flip_pending = 0;
 
@@ -656,8 +681,8 @@ page_flip_handler(int fd, unsigned int frame,
 	output->next = NULL;
 
 	if (!output->vblank_pending) {
-		msecs = sec * 1000 + usec / 1000;
-		weston_output_finish_frame(&output->base, msecs);
+		drm_compositor_convert_timestamp(output, sec, usec, &ts);
+		weston_output_finish_frame(&output->base, &ts);
 	}
 }
 
@@ -1143,7 +1168,8 @@ static int
 init_drm(struct drm_compositor *ec, struct udev_device *device)
 {
 	const char *filename, *sysnum;
-	int fd;
+	uint64_t cap;
+	int fd, ret;
 
 	sysnum = udev_device_get_sysnum(device);
 	if (sysnum)
@@ -1166,6 +1192,8 @@ init_drm(struct drm_compositor *ec, struct udev_device *device)
 
 	ec->drm.fd = fd;
 
+	ret = drmGetCap(fd, DRM_CAP_TIMESTAMP_MONOTONIC, &cap);
+	ec->clock_monotonic = ret == 0 && cap == 1;
 
 	return 0;
 }
@@ -1436,7 +1464,7 @@ drm_output_init_pixman(struct drm_output *output, struct drm_compositor *c)
 			goto err;
 	}
 
-	if (pixman_renderer_output_create(&output->base) < 0)
+	if (pixman_renderer_output_create(&output->base, 0) < 0)
 		goto err;
 
 	pixman_region32_init_rect(&output->previous_damage,
@@ -42,6 +42,7 @@
 #include "config.h"
 
 #include "compositor.h"
+#include "fbdev-copy.h"
 #include "launcher-util.h"
 #include "pixman-renderer.h"
 #include "udev-seat.h"
@@ -75,6 +76,7 @@ struct fbdev_output {
 
 	struct weston_mode mode;
 	struct wl_event_source *finish_frame_timer;
+	struct timespec frame_deadline;
 
 	/* Frame buffer details. */
 	const char *device; /* ownership shared with fbdev_parameters */
@@ -130,10 +132,22 @@ fbdev_output_repaint(struct weston_output *base, pixman_region32_t *damage)
 	pixman_box32_t *rects;
 	int nrects, i, src_x, src_y, x1, y1, x2, y2, width, height;
 
-	/* Repaint the damaged region onto the back buffer. */
+	/* Repaint the damaged region onto the back buffer. When it is in
+	 * a format the renderer can draw into, it does so directly and
+	 * skips its own shadow copy. */
 	pixman_renderer_output_set_buffer(base, output->shadow_surface);
 	ec->renderer->repaint_output(base, damage);
 
+	/* Untransformed outputs are copied into the frame buffer with
+	 * long streaming writes that never read it back; see
+	 * fbdev-copy.h.  The output always sits at 0,0, so the damage is
+	 * already in shadow coordinates. */
+	if (base->transform == WL_OUTPUT_TRANSFORM_NORMAL) {
+		fbdev_copy_region(output->fb, output->fb_info.line_length,
+				  output->shadow_surface, damage);
+		goto done;
+	}
+
 	/* Transform and composite onto the frame buffer. */
 	width = pixman_image_get_width(output->shadow_surface);
 	height = pixman_image_get_height(output->shadow_surface);
@@ -181,6 +195,7 @@ fbdev_output_repaint(struct weston_output *base, pixman_region32_t *damage)
 			y2 - y1 /* height */);
 	}
 
+done:
 	/* Update the damage region. */
 	pixman_region32_subtract(&ec->primary_plane.damage,
 	                         &ec->primary_plane.damage, damage);
@@ -190,22 +205,20 @@ fbdev_output_repaint(struct weston_output *base, pixman_region32_t *damage)
 	 * compositor. FBIO_WAITFORVSYNC blocks and FB_ACTIVATE_VBL requires
 	 * panning, which is broken in most kernel drivers.
 	 *
-	 * Finish the frame synchronised to the specified refresh rate. The
-	 * refresh rate is given in mHz and the interval in ms. */
+	 * Finish the frame synchronised to the specified refresh rate, on
+	 * a steady cadence that doesn't count the repaint time. */
 	wl_event_source_timer_update(output->finish_frame_timer,
-	                             1000000 / output->mode.refresh);
+		weston_output_next_frame_deadline(&output->frame_deadline,
+						  output->mode.refresh));
 }
 
 static int
 finish_frame_handler(void *data)
 {
 	struct fbdev_output *output = data;
-	uint32_t msec;
-	struct timeval tv;
+	struct timespec ts = output->frame_deadline;
 
-	gettimeofday(&tv, NULL);
-	msec = tv.tv_sec * 1000 + tv.tv_usec / 1000;
-	weston_output_finish_frame(&output->base, msec);
+	weston_output_finish_frame(&output->base, &ts);
 
 	return 1;
 }
@@ -593,7 +606,7 @@ fbdev_output_create(struct fbdev_compositor *compositor,
 	if (output->base.transform != WL_OUTPUT_TRANSFORM_NORMAL)
 		pixman_image_set_transform(output->shadow_surface, &transform);
 
-	if (pixman_renderer_output_create(&output->base) < 0)
+	if (pixman_renderer_output_create(&output->base, 0) < 0)
 		goto out_shadow_surface;
 
 	loop = wl_display_get_event_loop(compositor->base.wl_display);
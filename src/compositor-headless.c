@@ -27,7 +27,6 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <sys/time.h>
 
 #include "compositor.h"
 
@@ -40,19 +39,17 @@ struct headless_output {
 	struct weston_output base;
 	struct weston_mode mode;
 	struct wl_event_source *finish_frame_timer;
+	struct timespec frame_deadline;
 };
 
 
 static int
 finish_frame_handler(void *data)
 {
-	struct weston_output *output = data;
-	uint32_t msec;
-	struct timeval tv;
+	struct headless_output *output = data;
+	struct timespec ts = output->frame_deadline;
 
-	gettimeofday(&tv, NULL);
-	msec = tv.tv_sec * 1000 + tv.tv_usec / 1000;
-	weston_output_finish_frame(output, msec);
+	weston_output_finish_frame(&output->base, &ts);
 
 	return 1;
 }
@@ -69,7 +66,9 @@ headless_output_repaint(struct weston_output *output_base,
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
 
-	wl_event_source_timer_update(output->finish_frame_timer, 16);
+	wl_event_source_timer_update(output->finish_frame_timer,
+		weston_output_next_frame_deadline(&output->frame_deadline,
+						  output->mode.refresh));
 
 	return;
 }
@@ -101,7 +100,7 @@ headless_compositor_create_output(struct headless_compositor *c,
 		WL_OUTPUT_MODE_CURRENT | WL_OUTPUT_MODE_PREFERRED;
 	output->mode.width = width;
 	output->mode.height = height;
-	output->mode.refresh = 60;
+	output->mode.refresh = 60000;
 	wl_list_init(&output->base.mode_list);
 	wl_list_insert(&output->base.mode_list, &output->mode.link);
 
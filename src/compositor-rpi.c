@@ -617,14 +617,11 @@ rpi_flippipe_update_complete(DISPMANX_UPDATE_HANDLE_T update, void *data)
 {
 	/* This function runs in a different thread. */
 	struct rpi_flippipe *flippipe = data;
-	struct timeval tv;
-	uint64_t time;
+	struct timespec time;
 	ssize_t ret;
 
 	/* manufacture flip completion timestamp */
-	/* XXX: use CLOCK_MONOTONIC instead? */
-	gettimeofday(&tv, NULL);
-	time = (uint64_t)tv.tv_sec * 1000 + tv.tv_usec / 1000;
+	weston_compositor_read_clock(&time);
 
 	ret = write(flippipe->writefd, &time, sizeof time);
 	if (ret != sizeof time)
@@ -651,14 +648,15 @@ rpi_dispmanx_update_submit(DISPMANX_UPDATE_HANDLE_T update,
 }
 
 static void
-rpi_output_update_complete(struct rpi_output *output, uint64_t time);
+rpi_output_update_complete(struct rpi_output *output,
+			   const struct timespec *stamp);
 
 static int
 rpi_flippipe_handler(int fd, uint32_t mask, void *data)
 {
 	struct rpi_output *output = data;
 	ssize_t ret;
-	uint64_t time;
+	struct timespec time;
 
 	if (mask != WL_EVENT_READABLE)
 		weston_log("ERROR: unexpected mask 0x%x in %s\n",
@@ -670,7 +668,7 @@ rpi_flippipe_handler(int fd, uint32_t mask, void *data)
 			   __func__, ret, errno);
 	}
 
-	rpi_output_update_complete(output, time);
+	rpi_output_update_complete(output, &time);
 
 	return 1;
 }
@@ -927,10 +925,11 @@ rpi_output_repaint(struct weston_output *base, pixman_region32_t *damage)
 }
 
 static void
-rpi_output_update_complete(struct rpi_output *output, uint64_t time)
+rpi_output_update_complete(struct rpi_output *output,
+			   const struct timespec *stamp)
 {
 	rpi_output_destroy_old_elements(output);
-	weston_output_finish_frame(&output->base, time);
+	weston_output_finish_frame(&output->base, stamp);
 }
 
 static void
@@ -34,11 +34,15 @@
 #include <sys/mman.h>
 
 #include <wayland-client.h>
+#ifdef ENABLE_EGL
 #include <wayland-egl.h>
+#endif
 
 #include "compositor.h"
 #include "gl-renderer.h"
+#include "pixman-renderer.h"
 #include "../shared/image-loader.h"
+#include "../shared/os-compatibility.h"
 
 struct wayland_compositor {
 	struct weston_compositor	 base;
@@ -49,6 +53,7 @@ struct wayland_compositor {
 		struct wl_compositor *compositor;
 		struct wl_shell *shell;
 		struct wl_output *output;
+		struct wl_shm *shm;
 
 		struct {
 			int32_t x, y, width, height;
@@ -63,6 +68,8 @@ struct wayland_compositor {
 	} border;
 
 	struct wl_list input_list;
+
+	int use_pixman;
 };
 
 struct wayland_output {
@@ -73,6 +80,25 @@ struct wayland_output {
 		struct wl_egl_window	*egl_window;
 	} parent;
 	struct weston_mode	mode;
+
+	/* pixman only: shm buffers shared with the parent */
+	struct wl_list		shm_buffer_list;
+};
+
+struct wayland_shm_buffer {
+	struct wayland_output *output;
+	struct wl_list link;
+	struct wl_buffer *buffer;
+	void *data;
+	size_t size;
+	pixman_image_t *image;
+
+	/* Damage accumulated since this buffer was last drawn, in
+	 * global coordinates. */
+	pixman_region32_t damage;
+
+	/* Attached to the parent surface and not released yet. */
+	int busy;
 };
 
 struct wayland_input {
@@ -89,6 +115,8 @@ struct wayland_input {
 	struct wayland_output *output;
 };
 
+#ifdef ENABLE_EGL
+
 static void
 create_border(struct wayland_compositor *c)
 {
@@ -113,13 +141,72 @@ create_border(struct wayland_compositor *c)
 	pixman_image_unref(image);
 }
 
+static int
+wayland_output_init_gl(struct wayland_compositor *c,
+		       struct wayland_output *output)
+{
+	output->parent.egl_window =
+		wl_egl_window_create(output->parent.surface,
+				     output->mode.width +
+				     c->border.left + c->border.right,
+				     output->mode.height +
+				     c->border.top + c->border.bottom);
+	if (!output->parent.egl_window) {
+		weston_log("failure to create wl_egl_window\n");
+		return -1;
+	}
+
+	if (gl_renderer_output_create(&output->base,
+				      output->parent.egl_window) < 0) {
+		wl_egl_window_destroy(output->parent.egl_window);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+wayland_output_fini_gl(struct wayland_output *output)
+{
+	gl_renderer_output_destroy(&output->base);
+	wl_egl_window_destroy(output->parent.egl_window);
+}
+
+#else
+
+/* Built without EGL: only the pixman renderer is there to draw. */
+
+static void
+create_border(struct wayland_compositor *c)
+{
+}
+
+static int
+wayland_output_init_gl(struct wayland_compositor *c,
+		       struct wayland_output *output)
+{
+	return -1;
+}
+
+static void
+wayland_output_fini_gl(struct wayland_output *output)
+{
+}
+
+#endif
+
 static void
 frame_done(void *data, struct wl_callback *callback, uint32_t time)
 {
 	struct weston_output *output = data;
+	struct timespec ts;
 
 	wl_callback_destroy(callback);
-	weston_output_finish_frame(output, time);
+
+	/* The parent compositor's frame time is in an unknown time base,
+	 * so stamp the frame with our own clock. */
+	weston_compositor_read_clock(&ts);
+	weston_output_finish_frame(output, &ts);
 }
 
 static const struct wl_callback_listener frame_listener = {
@@ -145,13 +232,168 @@ wayland_output_repaint(struct weston_output *output_base,
 }
 
 static void
-wayland_output_destroy(struct weston_output *output_base)
+shm_buffer_release(void *data, struct wl_buffer *buffer)
+{
+	struct wayland_shm_buffer *sb = data;
+
+	sb->busy = 0;
+}
+
+static const struct wl_buffer_listener shm_buffer_listener = {
+	shm_buffer_release
+};
+
+static void
+wayland_shm_buffer_destroy(struct wayland_shm_buffer *sb)
+{
+	pixman_image_unref(sb->image);
+	wl_buffer_destroy(sb->buffer);
+	munmap(sb->data, sb->size);
+	pixman_region32_fini(&sb->damage);
+	wl_list_remove(&sb->link);
+	free(sb);
+}
+
+static struct wayland_shm_buffer *
+wayland_shm_buffer_create(struct wayland_output *output)
+{
+	struct wayland_compositor *c =
+		(struct wayland_compositor *) output->base.compositor;
+	struct wayland_shm_buffer *sb;
+	struct wl_shm_pool *pool;
+	int width, height, stride, fd;
+
+	width = output->mode.width;
+	height = output->mode.height;
+	stride = width * 4;
+
+	sb = malloc(sizeof *sb);
+	if (sb == NULL)
+		return NULL;
+	memset(sb, 0, sizeof *sb);
+
+	sb->output = output;
+	sb->size = stride * height;
+
+	fd = os_create_anonymous_file(sb->size);
+	if (fd < 0) {
+		weston_log("creating a buffer file for %zu B failed: %m\n",
+			   sb->size);
+		free(sb);
+		return NULL;
+	}
+
+	sb->data = mmap(NULL, sb->size, PROT_READ | PROT_WRITE,
+			MAP_SHARED, fd, 0);
+	if (sb->data == MAP_FAILED) {
+		weston_log("mmap failed: %m\n");
+		close(fd);
+		free(sb);
+		return NULL;
+	}
+
+	pool = wl_shm_create_pool(c->parent.shm, fd, sb->size);
+	sb->buffer = wl_shm_pool_create_buffer(pool, 0, width, height, stride,
+					       WL_SHM_FORMAT_XRGB8888);
+	wl_buffer_add_listener(sb->buffer, &shm_buffer_listener, sb);
+	wl_shm_pool_destroy(pool);
+	close(fd);
+
+	sb->image = pixman_image_create_bits(PIXMAN_x8r8g8b8, width, height,
+					     sb->data, stride);
+	if (sb->image == NULL) {
+		wl_buffer_destroy(sb->buffer);
+		munmap(sb->data, sb->size);
+		free(sb);
+		return NULL;
+	}
+
+	/* A new buffer has never been drawn into. */
+	pixman_region32_init(&sb->damage);
+	pixman_region32_copy(&sb->damage, &output->base.region);
+
+	wl_list_insert(&output->shm_buffer_list, &sb->link);
+
+	return sb;
+}
+
+static struct wayland_shm_buffer *
+wayland_output_get_shm_buffer(struct wayland_output *output)
+{
+	struct wayland_shm_buffer *sb;
+
+	wl_list_for_each(sb, &output->shm_buffer_list, link)
+		if (!sb->busy)
+			return sb;
+
+	/* Normally the parent releases the previous buffer by the time
+	 * it sends the frame event, so this only grows past two buffers
+	 * when the parent holds on to them. */
+	return wayland_shm_buffer_create(output);
+}
+
+static void
+wayland_output_repaint_pixman(struct weston_output *output_base,
+			      pixman_region32_t *damage)
 {
 	struct wayland_output *output = (struct wayland_output *) output_base;
+	struct weston_compositor *ec = output->base.compositor;
+	struct wayland_shm_buffer *sb;
+	struct wl_callback *callback;
+	pixman_box32_t *rects;
+	int i, n;
 
-	gl_renderer_output_destroy(output_base);
+	/* Each buffer has to catch up with everything that changed
+	 * since it was last drawn, not just this frame's damage. */
+	wl_list_for_each(sb, &output->shm_buffer_list, link)
+		pixman_region32_union(&sb->damage, &sb->damage, damage);
+
+	sb = wayland_output_get_shm_buffer(output);
+	if (sb == NULL) {
+		weston_log("no shm buffer to repaint into\n");
+		return;
+	}
+
+	pixman_renderer_output_set_buffer(output_base, sb->image);
+	ec->renderer->repaint_output(output_base, &sb->damage);
+	pixman_region32_clear(&sb->damage);
+
+	/* The parent still has the previous frame, so it only needs to
+	 * know about this frame's damage. */
+	wl_surface_attach(output->parent.surface, sb->buffer, 0, 0);
+	rects = pixman_region32_rectangles(damage, &n);
+	for (i = 0; i < n; i++)
+		wl_surface_damage(output->parent.surface,
+				  rects[i].x1 - output->base.x,
+				  rects[i].y1 - output->base.y,
+				  rects[i].x2 - rects[i].x1,
+				  rects[i].y2 - rects[i].y1);
+	sb->busy = 1;
+
+	callback = wl_surface_frame(output->parent.surface);
+	wl_callback_add_listener(callback, &frame_listener, output);
+	wl_surface_commit(output->parent.surface);
+
+	pixman_region32_subtract(&ec->primary_plane.damage,
+				 &ec->primary_plane.damage, damage);
+}
+
+static void
+wayland_output_destroy(struct weston_output *output_base)
+{
+	struct wayland_output *output = (struct wayland_output *) output_base;
+	struct wayland_compositor *c =
+		(struct wayland_compositor *) output->base.compositor;
+	struct wayland_shm_buffer *sb, *next;
+
+	if (c->use_pixman) {
+		pixman_renderer_output_destroy(output_base);
+		wl_list_for_each_safe(sb, next, &output->shm_buffer_list, link)
+			wayland_shm_buffer_destroy(sb);
+	} else {
+		wayland_output_fini_gl(output);
+	}
 
-	wl_egl_window_destroy(output->parent.egl_window);
 	free(output);
 
 	return;
@@ -159,6 +401,41 @@ wayland_output_destroy(struct weston_output *output_base)
 
 static const struct wl_shell_surface_listener shell_surface_listener;
 
+static int
+wayland_output_init_pixman(struct wayland_compositor *c,
+			   struct wayland_output *output)
+{
+	struct wl_region *region;
+	int i;
+
+	wl_list_init(&output->shm_buffer_list);
+
+	/* Start out with a pair, so that the next frame can be drawn
+	 * while the parent is still using the last one. */
+	for (i = 0; i < 2; i++)
+		if (!wayland_shm_buffer_create(output))
+			goto err;
+
+	if (pixman_renderer_output_create(&output->base, 0) < 0)
+		goto err;
+
+	/* XRGB8888 is opaque; tell the parent so it doesn't blend us. */
+	region = wl_compositor_create_region(c->parent.compositor);
+	wl_region_add(region, 0, 0, output->mode.width, output->mode.height);
+	wl_surface_set_opaque_region(output->parent.surface, region);
+	wl_region_destroy(region);
+
+	return 0;
+
+err:
+	while (!wl_list_empty(&output->shm_buffer_list))
+		wayland_shm_buffer_destroy(
+			container_of(output->shm_buffer_list.next,
+				     struct wayland_shm_buffer, link));
+
+	return -1;
+}
+
 static int
 wayland_compositor_create_output(struct wayland_compositor *c,
 				 int width, int height)
@@ -191,19 +468,14 @@ wayland_compositor_create_output(struct wayland_compositor *c,
 		wl_compositor_create_surface(c->parent.compositor);
 	wl_surface_set_user_data(output->parent.surface, output);
 
-	output->parent.egl_window =
-		wl_egl_window_create(output->parent.surface,
-				     width + c->border.left + c->border.right,
-				     height + c->border.top + c->border.bottom);
-	if (!output->parent.egl_window) {
-		weston_log("failure to create wl_egl_window\n");
-		goto cleanup_output;
+	if (c->use_pixman) {
+		if (wayland_output_init_pixman(c, output) < 0)
+			goto cleanup_output;
+	} else {
+		if (wayland_output_init_gl(c, output) < 0)
+			goto cleanup_output;
 	}
 
-	if (gl_renderer_output_create(&output->base,
-			output->parent.egl_window) < 0)
-		goto cleanup_window;
-
 	output->parent.shell_surface =
 		wl_shell_get_shell_surface(c->parent.shell,
 					   output->parent.surface);
@@ -212,7 +484,10 @@ wayland_compositor_create_output(struct wayland_compositor *c,
 	wl_shell_surface_set_toplevel(output->parent.shell_surface);
 
 	output->base.origin = output->base.current;
-	output->base.repaint = wayland_output_repaint;
+	if (c->use_pixman)
+		output->base.repaint = wayland_output_repaint_pixman;
+	else
+		output->base.repaint = wayland_output_repaint;
 	output->base.destroy = wayland_output_destroy;
 	output->base.assign_planes = NULL;
 	output->base.set_backlight = NULL;
@@ -223,8 +498,6 @@ wayland_compositor_create_output(struct wayland_compositor *c,
 
 	return 0;
 
-cleanup_window:
-	wl_egl_window_destroy(output->parent.egl_window);
 cleanup_output:
 	/* FIXME: cleanup weston_output */
 	free(output);
@@ -580,6 +853,9 @@ registry_handle_global(void *data, struct wl_registry *registry, uint32_t name,
 					 &wl_shell_interface, 1);
 	} else if (strcmp(interface, "wl_seat") == 0) {
 		display_add_seat(c, name);
+	} else if (strcmp(interface, "wl_shm") == 0) {
+		c->parent.shm =
+			wl_registry_bind(registry, name, &wl_shm_interface, 1);
 	}
 }
 
@@ -624,6 +900,7 @@ wayland_destroy(struct weston_compositor *ec)
 static struct weston_compositor *
 wayland_compositor_create(struct wl_display *display,
 			  int width, int height, const char *display_name,
+			  int use_pixman,
 			  int *argc, char *argv[], const char *config_file)
 {
 	struct wayland_compositor *c;
@@ -653,26 +930,39 @@ wayland_compositor_create(struct wl_display *display,
 	wl_display_dispatch(c->parent.wl_display);
 
 	c->base.wl_display = display;
-	if (gl_renderer_create(&c->base, c->parent.wl_display,
-			gl_renderer_alpha_attribs,
-			NULL) < 0)
-		goto err_display;
+	c->use_pixman = use_pixman;
+	if (c->use_pixman) {
+		if (c->parent.shm == NULL) {
+			weston_log("parent compositor has no wl_shm\n");
+			goto err_display;
+		}
+		if (pixman_renderer_init(&c->base) < 0)
+			goto err_display;
+	} else {
+		if (gl_renderer_create(&c->base, c->parent.wl_display,
+				gl_renderer_alpha_attribs,
+				NULL) < 0)
+			goto err_display;
+
+		/* The border is drawn by the gl renderer only. */
+		c->border.top = 30;
+		c->border.bottom = 24;
+		c->border.left = 25;
+		c->border.right = 26;
+	}
+	weston_log("Using %s renderer\n", use_pixman ? "pixman" : "gl");
 
 	c->base.destroy = wayland_destroy;
 	c->base.restore = wayland_restore;
 
-	c->border.top = 30;
-	c->border.bottom = 24;
-	c->border.left = 25;
-	c->border.right = 26;
-
 	/* requires border fields */
 	if (wayland_compositor_create_output(c, width, height) < 0)
 		goto err_gl;
 
 	/* requires gl_renderer_output_state_create called
 	 * by wayland_compositor_create_output */
-	create_border(c);
+	if (!c->use_pixman)
+		create_border(c);
 
 	loop = wl_display_get_event_loop(c->base.wl_display);
 
@@ -704,16 +994,22 @@ backend_init(struct wl_display *display, int *argc, char *argv[],
 {
 	int width = 1024, height = 640;
 	char *display_name = NULL;
+#ifdef ENABLE_EGL
+	int use_pixman = 0;
+#else
+	int use_pixman = 1;
+#endif
 
 	const struct weston_option wayland_options[] = {
 		{ WESTON_OPTION_INTEGER, "width", 0, &width },
 		{ WESTON_OPTION_INTEGER, "height", 0, &height },
 		{ WESTON_OPTION_STRING, "display", 0, &display_name },
+		{ WESTON_OPTION_BOOLEAN, "use-pixman", 0, &use_pixman },
 	};
 
 	parse_options(wayland_options,
 		      ARRAY_LENGTH(wayland_options), argc, argv);
 
 	return wayland_compositor_create(display, width, height, display_name,
-					 argc, argv, config_file);
+					 use_pixman, argc, argv, config_file);
 }
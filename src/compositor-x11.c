@@ -33,7 +33,6 @@
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
-#include <sys/time.h>
 #include <sys/shm.h>
 #include <linux/input.h>
 
@@ -53,6 +52,18 @@
 #include "pixman-renderer.h"
 #include "../shared/config-parser.h"
 #include "../shared/image-loader.h"
+#include "../shared/timespec-util.h"
+
+/* Minimum frame period in ms; the X server gives us no vblank. */
+#define FRAME_INTERVAL 10
+
+/* Past this many damage rects, one put of the extents is cheaper than
+ * a request per rect. */
+#define MAX_PUT_RECTS 32
+
+/* How long to wait for a ShmCompletion before finishing the frame
+ * anyway; a failed put never sends one. */
+#define SHM_COMPLETION_TIMEOUT 100
 
 #define DEFAULT_AXIS_STEP_DISTANCE wl_fixed_from_int(10)
 
@@ -84,6 +95,7 @@ struct x11_compositor {
 	unsigned int		 has_xkb;
 	uint8_t			 xkb_event_base;
 	int			 use_pixman;
+	uint8_t			 shm_event_base;
 
 	int			 has_net_wm_state_fullscreen;
 
@@ -125,6 +137,8 @@ struct x11_output {
 	int			shm_id;
 	void		       *buf;
 	uint8_t			depth;
+	struct timespec		frame_start;
+	int			shm_pending;
 };
 
 static struct xkb_keymap *
@@ -337,7 +351,8 @@ x11_output_repaint_gl(struct weston_output *output_base,
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
 
-	wl_event_source_timer_update(output->finish_frame_timer, 10);
+	wl_event_source_timer_update(output->finish_frame_timer,
+				     FRAME_INTERVAL);
 }
 
 static void
@@ -347,41 +362,96 @@ x11_output_repaint_shm(struct weston_output *output_base,
 	struct x11_output *output = (struct x11_output *)output_base;
 	struct weston_compositor *ec = output->base.compositor;
 	struct x11_compositor *c = (struct x11_compositor *)ec;
-	xcb_void_cookie_t cookie;
-	xcb_generic_error_t *err;
+	pixman_box32_t *rects, rect;
+	int i, n, width, height;
+
+	weston_compositor_read_clock(&output->frame_start);
 
 	pixman_renderer_output_set_buffer(output_base, output->hw_surface);
 	ec->renderer->repaint_output(output_base, damage);
 
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
-	cookie = xcb_shm_put_image_checked(c->conn, output->window, output->gc,
-					pixman_image_get_width(output->hw_surface),
-					pixman_image_get_height(output->hw_surface),
-					0, 0,
-					pixman_image_get_width(output->hw_surface),
-					pixman_image_get_height(output->hw_surface),
-					0, 0, output->depth, XCB_IMAGE_FORMAT_Z_PIXMAP,
-					0, output->segment, 0);
-	err = xcb_request_check(c->conn, cookie);
-	if (err != NULL) {
-		weston_log("Failed to put shm image, err: %d\n", err->error_code);
-		free(err);
+
+	rects = pixman_region32_rectangles(damage, &n);
+	if (n == 0) {
+		/* Nothing to put, so no completion event to wait for. */
+		wl_event_source_timer_update(output->finish_frame_timer,
+					     FRAME_INTERVAL);
+		return;
+	}
+	if (n > MAX_PUT_RECTS) {
+		rects = pixman_region32_extents(damage);
+		n = 1;
+	}
+
+	width = pixman_image_get_width(output->hw_surface);
+	height = pixman_image_get_height(output->hw_surface);
+
+	/* Errors come back asynchronously through the event loop, and
+	 * the last put asks for a completion event, which finishes the
+	 * frame; see x11_output_shm_completion().  The timer is the
+	 * fallback for when that event never comes. */
+	for (i = 0; i < n; i++) {
+		rect.x1 = rects[i].x1 - output->base.x;
+		rect.y1 = rects[i].y1 - output->base.y;
+		rect.x2 = rects[i].x2 - output->base.x;
+		rect.y2 = rects[i].y2 - output->base.y;
+		rect = weston_transformed_rect(output->base.width,
+					       output->base.height,
+					       output->base.transform, rect);
+
+		xcb_shm_put_image(c->conn, output->window, output->gc,
+				  width, height,
+				  rect.x1, rect.y1,
+				  rect.x2 - rect.x1, rect.y2 - rect.y1,
+				  rect.x1, rect.y1,
+				  output->depth, XCB_IMAGE_FORMAT_Z_PIXMAP,
+				  i == n - 1, output->segment, 0);
+	}
+
+	output->shm_pending = 1;
+	wl_event_source_timer_update(output->finish_frame_timer,
+				     SHM_COMPLETION_TIMEOUT);
+
+	xcb_flush(c->conn);
+}
+
+static void
+x11_output_shm_completion(struct x11_output *output)
+{
+	struct timespec now;
+	int64_t elapsed;
+
+	/* Late completion after the fallback timer already fired. */
+	if (!output->shm_pending)
+		return;
+	output->shm_pending = 0;
+
+	weston_compositor_read_clock(&now);
+
+	/* The server can be much faster than the display; don't let a
+	 * continuously animating client run us past the frame rate. */
+	elapsed = timespec_sub_to_nsec(&now, &output->frame_start) / 1000000;
+	if (elapsed < FRAME_INTERVAL) {
+		wl_event_source_timer_update(output->finish_frame_timer,
+					     FRAME_INTERVAL - elapsed);
+		return;
 	}
 
-	wl_event_source_timer_update(output->finish_frame_timer, 10);
+	wl_event_source_timer_update(output->finish_frame_timer, 0);
+	weston_output_finish_frame(&output->base, &now);
 }
 
 static int
 finish_frame_handler(void *data)
 {
 	struct x11_output *output = data;
-	uint32_t msec;
-	struct timeval tv;
-	
-	gettimeofday(&tv, NULL);
-	msec = tv.tv_sec * 1000 + tv.tv_usec / 1000;
-	weston_output_finish_frame(&output->base, msec);
+	struct timespec ts;
+
+	output->shm_pending = 0;
+	weston_compositor_read_clock(&ts);
+	weston_output_finish_frame(&output->base, &ts);
 
 	return 1;
 }
@@ -594,6 +664,7 @@ x11_output_init_shm(struct x11_compositor *c, struct x11_output *output,
 		errno = ENOENT;
 		return -1;
 	}
+	c->shm_event_base = ext->first_event;
 
 	iter = xcb_setup_roots_iterator(xcb_get_setup(c->conn));
 	visual_type = find_visual_by_id(iter.data, iter.data->root_visual);
@@ -791,7 +862,7 @@ x11_compositor_create_output(struct x11_compositor *c, int x, int y,
 	if (c->use_pixman) {
 		if (x11_output_init_shm(c, output, width, height) < 0)
 			return NULL;
-		if (pixman_renderer_output_create(&output->base) < 0) {
+		if (pixman_renderer_output_create(&output->base, 0) < 0) {
 			x11_output_deinit_shm(c, output);
 			return NULL;
 		}
@@ -1071,6 +1142,8 @@ x11_compositor_handle_event(int fd, uint32_t mask, void *data)
 	xcb_keymap_notify_event_t *keymap_notify;
 	xcb_focus_in_event_t *focus_in;
 	xcb_expose_event_t *expose;
+	xcb_shm_completion_event_t *completion;
+	xcb_generic_error_t *error;
 	xcb_atom_t atom;
 	uint32_t *k;
 	uint32_t i, set;
@@ -1219,10 +1292,27 @@ x11_compositor_handle_event(int fd, uint32_t mask, void *data)
 			notify_keyboard_focus_out(&c->core_seat);
 			break;
 
+		case 0:
+			/* Errors for requests we didn't check. */
+			error = (xcb_generic_error_t *) event;
+			weston_log("X11 error %d, request %d.%d\n",
+				   error->error_code, error->major_code,
+				   error->minor_code);
+			break;
+
 		default:
 			break;
 		}
 
+		if (c->use_pixman &&
+		    response_type == c->shm_event_base + XCB_SHM_COMPLETION) {
+			completion = (xcb_shm_completion_event_t *) event;
+			output = x11_compositor_find_output(c,
+							   completion->drawable);
+			if (output)
+				x11_output_shm_completion(output);
+		}
+
 #ifdef HAVE_XCB_XKB
 		if (c->has_xkb &&
 		    response_type == c->xkb_event_base) {
@@ -57,6 +57,7 @@
 #include <wayland-server.h>
 #include "compositor.h"
 #include "../shared/os-compatibility.h"
+#include "../shared/timespec-util.h"
 #include "git-version.h"
 #include "version.h"
 
@@ -292,6 +293,8 @@ weston_surface_create(struct weston_compositor *compositor)
 	surface->plane = &compositor->primary_plane;
 	surface->pending.newly_attached = 0;
 
+	weston_compositor_read_clock(&surface->stats.window_start);
+
 	pixman_region32_init(&surface->damage);
 	pixman_region32_init(&surface->opaque);
 	pixman_region32_init(&surface->clip);
@@ -828,14 +831,24 @@ weston_surface_buffer_height(struct weston_surface *surface)
 	}
 }
 
+WL_EXPORT void
+weston_compositor_read_clock(struct timespec *ts)
+{
+	if (clock_gettime(CLOCK_MONOTONIC, ts) < 0) {
+		weston_log("clock_gettime failed: %m\n");
+		ts->tv_sec = 0;
+		ts->tv_nsec = 0;
+	}
+}
+
 WL_EXPORT uint32_t
 weston_compositor_get_time(void)
 {
-       struct timeval tv;
+	struct timespec ts;
 
-       gettimeofday(&tv, NULL);
+	weston_compositor_read_clock(&ts);
 
-       return tv.tv_sec * 1000 + tv.tv_usec / 1000;
+	return timespec_to_msec(&ts);
 }
 
 static struct weston_surface *
@@ -1097,7 +1110,8 @@ surface_accumulate_damage(struct weston_surface *surface,
 }
 
 static void
-weston_output_repaint(struct weston_output *output, uint32_t msecs)
+weston_output_repaint(struct weston_output *output,
+		      const struct timespec *stamp)
 {
 	struct weston_compositor *ec = output->compositor;
 	struct weston_surface *es;
@@ -1169,13 +1183,13 @@ weston_output_repaint(struct weston_output *output, uint32_t msecs)
 	wl_event_loop_dispatch(ec->input_loop, 0);
 
 	wl_list_for_each_safe(cb, cnext, &frame_callback_list, link) {
-		wl_callback_send_done(&cb->resource, msecs);
+		wl_callback_send_done(&cb->resource, timespec_to_msec(stamp));
 		wl_resource_destroy(&cb->resource);
 	}
 
 	wl_list_for_each_safe(animation, next, &output->animation_list, link) {
 		animation->frame_counter++;
-		animation->frame(animation, output, msecs);
+		animation->frame(animation, output, stamp);
 	}
 }
 
@@ -1190,16 +1204,17 @@ weston_compositor_read_input(int fd, uint32_t mask, void *data)
 }
 
 WL_EXPORT void
-weston_output_finish_frame(struct weston_output *output, uint32_t msecs)
+weston_output_finish_frame(struct weston_output *output,
+			   const struct timespec *stamp)
 {
 	struct weston_compositor *compositor = output->compositor;
 	struct wl_event_loop *loop =
 		wl_display_get_event_loop(compositor->wl_display);
 	int fd;
 
-	output->frame_time = msecs;
+	output->frame_time = *stamp;
 	if (output->repaint_needed) {
-		weston_output_repaint(output, msecs);
+		weston_output_repaint(output, stamp);
 		return;
 	}
 
@@ -1213,12 +1228,47 @@ weston_output_finish_frame(struct weston_output *output, uint32_t msecs)
 				     weston_compositor_read_input, compositor);
 }
 
+/* For backends that have no vblank event and finish frames from a
+ * timer.  Advances *deadline, the previous frame's deadline, by whole
+ * refresh periods (refresh is in mHz) to the first one in the future,
+ * and returns the delay until then in ms for
+ * wl_event_source_timer_update().  Because the deadline doesn't depend
+ * on when the repaint finished, repaint time doesn't lower the frame
+ * rate, and after an idle stretch the timer stays in phase the way a
+ * real display would.
+ */
+WL_EXPORT int
+weston_output_next_frame_deadline(struct timespec *deadline,
+				  int32_t refresh)
+{
+	struct timespec now;
+	int64_t period, behind, delay;
+
+	period = (int64_t) NSEC_PER_SEC * 1000 / refresh;
+	weston_compositor_read_clock(&now);
+
+	if (timespec_is_zero(deadline)) {
+		timespec_add_nsec(deadline, &now, period);
+	} else {
+		behind = timespec_sub_to_nsec(&now, deadline);
+		if (behind >= 0)
+			timespec_add_nsec(deadline, deadline,
+					  (behind / period + 1) * period);
+	}
+
+	delay = (timespec_sub_to_nsec(deadline, &now) + 999999) / 1000000;
+
+	return delay > 0 ? delay : 1;
+}
+
 static void
 idle_repaint(void *data)
 {
 	struct weston_output *output = data;
+	struct timespec ts;
 
-	weston_output_finish_frame(output, weston_compositor_get_time());
+	weston_compositor_read_clock(&ts);
+	weston_output_finish_frame(output, &ts);
 }
 
 WL_EXPORT void
@@ -1402,9 +1452,16 @@ surface_commit(struct wl_client *client, struct wl_resource *resource)
 {
 	struct weston_surface *surface = resource->data;
 	pixman_region32_t opaque;
+	struct timespec now;
 	int buffer_width = 0;
 	int buffer_height = 0;
 
+	weston_compositor_read_clock(&now);
+	weston_surface_stats_update(surface, &now);
+	surface->stats.total.commits++;
+	if (surface->pending.buffer)
+		surface->stats.total.attaches++;
+
 	if (surface->pending.sx || surface->pending.sy ||
 	    (surface->pending.buffer &&
 	     surface_pending_buffer_has_different_size(surface)))
@@ -1434,6 +1491,13 @@ surface_commit(struct wl_client *client, struct wl_resource *resource)
 	surface->pending.newly_attached = 0;
 
 	/* wl_surface.damage */
+	pixman_region32_intersect_rect(&surface->pending.damage,
+				       &surface->pending.damage,
+				       0, 0,
+				       surface->geometry.width,
+				       surface->geometry.height);
+	surface->stats.total.damage_pixels +=
+		weston_region_area(&surface->pending.damage);
 	pixman_region32_union(&surface->damage, &surface->damage,
 			      &surface->pending.damage);
 	pixman_region32_intersect_rect(&surface->damage, &surface->damage,
@@ -3026,6 +3090,7 @@ weston_compositor_init(struct weston_compositor *ec,
 {
 	struct wl_event_loop *loop;
 	struct xkb_rule_names xkb_names;
+	int coalesce_motion = 0;
         const struct config_key keyboard_config_keys[] = {
 		{ "keymap_rules", CONFIG_KEY_STRING, &xkb_names.rules },
 		{ "keymap_model", CONFIG_KEY_STRING, &xkb_names.model },
@@ -3033,15 +3098,21 @@ weston_compositor_init(struct weston_compositor *ec,
 		{ "keymap_variant", CONFIG_KEY_STRING, &xkb_names.variant },
 		{ "keymap_options", CONFIG_KEY_STRING, &xkb_names.options },
         };
+	const struct config_key input_config_keys[] = {
+		{ "coalesce_motion", CONFIG_KEY_BOOLEAN, &coalesce_motion },
+	};
 	const struct config_section cs[] = {
                 { "keyboard",
                   keyboard_config_keys, ARRAY_LENGTH(keyboard_config_keys) },
+		{ "input",
+		  input_config_keys, ARRAY_LENGTH(input_config_keys) },
 	};
 
 	memset(&xkb_names, 0, sizeof(xkb_names));
 	parse_config_file(config_file, cs, ARRAY_LENGTH(cs), ec);
 
 	ec->wl_display = display;
+	ec->coalesce_motion = coalesce_motion;
 	wl_signal_init(&ec->destroy_signal);
 	wl_signal_init(&ec->activate_signal);
 	wl_signal_init(&ec->kill_signal);
@@ -3066,6 +3137,10 @@ weston_compositor_init(struct weston_compositor *ec,
 	wl_list_init(&ec->button_binding_list);
 	wl_list_init(&ec->axis_binding_list);
 	wl_list_init(&ec->debug_binding_list);
+	weston_binding_index_init(&ec->key_binding_index);
+	weston_binding_index_init(&ec->button_binding_index);
+	weston_binding_index_init(&ec->axis_binding_index);
+	weston_binding_index_init(&ec->debug_binding_index);
 
 	weston_plane_init(&ec->primary_plane, 0, 0);
 
@@ -3113,6 +3188,10 @@ weston_compositor_shutdown(struct weston_compositor *ec)
 	weston_binding_list_destroy_all(&ec->button_binding_list);
 	weston_binding_list_destroy_all(&ec->axis_binding_list);
 	weston_binding_list_destroy_all(&ec->debug_binding_list);
+	weston_binding_index_release(&ec->key_binding_index);
+	weston_binding_index_release(&ec->button_binding_index);
+	weston_binding_index_release(&ec->axis_binding_index);
+	weston_binding_index_release(&ec->debug_binding_index);
 
 	weston_plane_release(&ec->primary_plane);
 
@@ -3365,6 +3444,7 @@ usage(int error_code)
 		"  -i, --idle-time=SECS\tIdle time in seconds\n"
 		"  --modules\t\tLoad the comma-separated list of modules\n"
 		"  --log==FILE\t\tLog to the given file\n"
+		"  --surface-stats\tLet clients read surface statistics\n"
 		"  -h, --help\t\tThis help message\n\n");
 
 	fprintf(stderr,
@@ -3388,7 +3468,8 @@ usage(int error_code)
 		"Options for wayland-backend.so:\n\n"
 		"  --width=WIDTH\t\tWidth of Wayland surface\n"
 		"  --height=HEIGHT\tHeight of Wayland surface\n"
-		"  --display=DISPLAY\tWayland display to connect to\n\n");
+		"  --display=DISPLAY\tWayland display to connect to\n"
+		"  --use-pixman\t\tUse the pixman (CPU) renderer\n\n");
 
 	exit(error_code);
 }
@@ -3412,6 +3493,7 @@ int main(int argc, char *argv[])
 	int32_t help = 0;
 	char *socket_name = "wayland-0";
 	int32_t version = 0;
+	int32_t surface_stats = 0;
 	char *config_file;
 
 	const struct config_key core_config_keys[] = {
@@ -3431,6 +3513,7 @@ int main(int argc, char *argv[])
 		{ WESTON_OPTION_STRING, "log", 0, &log },
 		{ WESTON_OPTION_BOOLEAN, "help", 'h', &help },
 		{ WESTON_OPTION_BOOLEAN, "version", 0, &version },
+		{ WESTON_OPTION_BOOLEAN, "surface-stats", 0, &surface_stats },
 	};
 
 	parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
@@ -3500,6 +3583,8 @@ int main(int argc, char *argv[])
 	ec->option_idle_time = idle_time;
 	ec->idle_time = idle_time;
 
+	surface_stats_create(ec, surface_stats);
+
 	setenv("WAYLAND_DISPLAY", socket_name, 1);
 
 	if (load_modules(ec, modules, &argc, argv, config_file) < 0)
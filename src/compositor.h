@@ -24,6 +24,7 @@
 #ifndef _WAYLAND_SYSTEM_COMPOSITOR_H_
 #define _WAYLAND_SYSTEM_COMPOSITOR_H_
 
+#include <time.h>
 #include <pixman.h>
 #include <xkbcommon/xkbcommon.h>
 #include <wayland-server.h>
@@ -102,7 +103,8 @@ struct weston_border {
 
 struct weston_animation {
 	void (*frame)(struct weston_animation *animation,
-		      struct weston_output *output, uint32_t msecs);
+		      struct weston_output *output,
+		      const struct timespec *time);
 	int frame_counter;
 	struct wl_list link;
 };
@@ -113,7 +115,7 @@ struct weston_spring {
 	double current;
 	double target;
 	double previous;
-	uint32_t timestamp;
+	struct timespec timestamp;
 };
 
 enum {
@@ -171,7 +173,7 @@ struct weston_output {
 	struct weston_output_zoom zoom;
 	int dirty;
 	struct wl_signal frame_signal;
-	uint32_t frame_time;
+	struct timespec frame_time;
 	int disable_planes;
 
 	char *make, *model;
@@ -288,6 +290,16 @@ struct weston_renderer {
 	void (*destroy)(struct weston_compositor *ec);
 };
 
+/* Sorted lookup table over one of the binding lists, keyed by
+ * (key/button/axis, modifier). It is rebuilt lazily on the first lookup
+ * after a binding has been added or removed. */
+struct weston_binding_index {
+	struct wl_array bindings;	/* struct weston_binding * */
+	uint32_t serial;
+	uint32_t built_serial;
+	uint32_t next_seq;
+};
+
 struct weston_compositor {
 	struct wl_signal destroy_signal;
 
@@ -306,6 +318,7 @@ struct weston_compositor {
 
 	struct wl_event_loop *input_loop;
 	struct wl_event_source *input_loop_source;
+	int coalesce_motion;
 
 	struct weston_layer fade_layer;
 	struct weston_layer cursor_layer;
@@ -318,6 +331,10 @@ struct weston_compositor {
 	struct wl_list button_binding_list;
 	struct wl_list axis_binding_list;
 	struct wl_list debug_binding_list;
+	struct weston_binding_index key_binding_index;
+	struct weston_binding_index button_binding_index;
+	struct weston_binding_index axis_binding_index;
+	struct weston_binding_index debug_binding_index;
 
 	uint32_t state;
 	struct wl_event_source *idle_source;
@@ -363,6 +380,15 @@ struct weston_region {
 	pixman_region32_t region;
 };
 
+struct weston_surface_stats {
+	uint64_t commits;
+	uint64_t attaches;
+	uint64_t damage_pixels;
+	uint64_t upload_bytes;
+	uint64_t composited_pixels;
+	uint64_t texture_allocs;
+};
+
 /* Using weston_surface transformations
  *
  * To add a transformation to a surface, create a struct weston_transform, and
@@ -452,6 +478,19 @@ struct weston_surface {
 	uint32_t buffer_transform;
 	int keep_buffer; /* bool for backends to prevent early release */
 
+	/*
+	 * Load accounting, updated by the core and the renderers.
+	 * 'total' counts since surface creation; 'rate' holds per second
+	 * values for the last completed window, see
+	 * weston_surface_stats_update().
+	 */
+	struct {
+		struct weston_surface_stats total;
+		struct weston_surface_stats window;
+		struct weston_surface_stats rate;
+		struct timespec window_start;
+	} stats;
+
 	/* All the pending state, that wl_surface.commit will apply. */
 	struct {
 		/* wl_surface.attach */
@@ -531,7 +570,8 @@ void
 weston_spring_init(struct weston_spring *spring,
 		   double k, double current, double target);
 void
-weston_spring_update(struct weston_spring *spring, uint32_t msec);
+weston_spring_update(struct weston_spring *spring,
+		     const struct timespec *time);
 int
 weston_spring_done(struct weston_spring *spring);
 
@@ -577,7 +617,11 @@ void
 weston_plane_release(struct weston_plane *plane);
 
 void
-weston_output_finish_frame(struct weston_output *output, uint32_t msecs);
+weston_output_finish_frame(struct weston_output *output,
+			   const struct timespec *stamp);
+int
+weston_output_next_frame_deadline(struct timespec *deadline,
+				  int32_t refresh);
 void
 weston_output_schedule_repaint(struct weston_output *output);
 void
@@ -639,6 +683,11 @@ weston_binding_destroy(struct weston_binding *binding);
 void
 weston_binding_list_destroy_all(struct wl_list *list);
 
+void
+weston_binding_index_init(struct weston_binding_index *index);
+void
+weston_binding_index_release(struct weston_binding_index *index);
+
 void
 weston_compositor_run_key_binding(struct weston_compositor *compositor,
 				  struct weston_seat *seat, uint32_t time,
@@ -697,12 +746,20 @@ weston_surface_move_to_plane(struct weston_surface *surface,
 void
 weston_surface_unmap(struct weston_surface *surface);
 
+void
+weston_surface_stats_update(struct weston_surface *surface,
+			    const struct timespec *now);
+uint64_t
+weston_region_area(pixman_region32_t *region);
+
 void
 weston_buffer_reference(struct weston_buffer_reference *ref,
 			struct wl_buffer *buffer);
 
 uint32_t
 weston_compositor_get_time(void);
+void
+weston_compositor_read_clock(struct timespec *ts);
 
 int
 weston_compositor_init(struct weston_compositor *ec, struct wl_display *display,
@@ -775,6 +832,9 @@ tty_activate_vt(struct tty *tty, int vt);
 void
 screenshooter_create(struct weston_compositor *ec);
 
+void
+surface_stats_create(struct weston_compositor *ec, int add_global);
+
 struct clipboard *
 clipboard_create(struct weston_seat *seat);
 
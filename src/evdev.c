@@ -32,6 +32,10 @@
 
 #define DEFAULT_AXIS_STEP_DISTANCE wl_fixed_from_int(10)
 
+#ifndef EVIOCSCLOCKID
+#define EVIOCSCLOCKID _IOW('E', 0xa0, int)
+#endif
+
 void
 evdev_led_update(struct evdev_device *device, enum weston_led leds)
 {
@@ -255,6 +259,7 @@ evdev_flush_motion(struct evdev_device *device, uint32_t time)
 	device->pending_events &= ~EVDEV_SYN;
 	if (device->pending_events & EVDEV_RELATIVE_MOTION) {
 		notify_motion(master, time, device->rel.dx, device->rel.dy);
+		device->stats.motion_delivered++;
 		device->pending_events &= ~EVDEV_RELATIVE_MOTION;
 		device->rel.dx = 0;
 		device->rel.dy = 0;
@@ -274,6 +279,7 @@ evdev_flush_motion(struct evdev_device *device, uint32_t time)
 			     wl_fixed_from_int(device->mt.x[device->mt.slot]),
 			     wl_fixed_from_int(device->mt.y[device->mt.slot]),
 			     WL_TOUCH_MOTION);
+		device->stats.motion_delivered++;
 		device->pending_events &= ~EVDEV_ABSOLUTE_MT_DOWN;
 		device->pending_events &= ~EVDEV_ABSOLUTE_MT_MOTION;
 	}
@@ -287,6 +293,7 @@ evdev_flush_motion(struct evdev_device *device, uint32_t time)
 		notify_motion(master, time,
 			      wl_fixed_from_int(device->abs.x),
 			      wl_fixed_from_int(device->abs.y));
+		device->stats.motion_delivered++;
 		device->pending_events &= ~EVDEV_ABSOLUTE_MOTION;
 	}
 }
@@ -336,6 +343,20 @@ fallback_dispatch_create(void)
 	return dispatch;
 }
 
+/* In coalescing mode a SYN_REPORT does not force out the motion
+ * accumulated so far, unless a touch point went down or up in the
+ * report, which has to be delivered at the position it happened at.
+ */
+static int
+evdev_can_coalesce(struct evdev_device *device, struct input_event *e)
+{
+	if (!device->coalesce_motion || e->type != EV_SYN)
+		return 0;
+
+	return !(device->pending_events &
+		 (EVDEV_ABSOLUTE_MT_DOWN | EVDEV_ABSOLUTE_MT_UP));
+}
+
 static void
 evdev_process_events(struct evdev_device *device,
 		     struct input_event *ev, int count)
@@ -344,23 +365,37 @@ evdev_process_events(struct evdev_device *device,
 	struct input_event *e, *end;
 	uint32_t time = 0;
 
-	device->pending_events = 0;
+	if (!device->coalesce_motion)
+		device->pending_events = 0;
+
+	device->stats.events += count;
 
 	e = ev;
 	end = e + count;
 	for (e = ev; e < end; e++) {
 		time = e->time.tv_sec * 1000 + e->time.tv_usec / 1000;
 
+		if (is_motion_event(e)) {
+			device->report_has_motion = 1;
+		} else if (e->type == EV_SYN && e->code == SYN_REPORT &&
+			   device->report_has_motion) {
+			device->stats.motion_reports++;
+			device->report_has_motion = 0;
+		}
+
 		/* we try to minimize the amount of notifications to be
 		 * forwarded to the compositor, so we accumulate motion
 		 * events and send as a bunch */
-		if (!is_motion_event(e))
+		if (!is_motion_event(e) && !evdev_can_coalesce(device, e))
 			evdev_flush_motion(device, time);
 
 		dispatch->interface->process(dispatch, device, e, time);
 	}
 
-	evdev_flush_motion(device, time);
+	if (count > 0)
+		device->motion_time = time;
+	if (!device->coalesce_motion)
+		evdev_flush_motion(device, time);
 }
 
 static int
@@ -368,7 +403,7 @@ evdev_device_data(int fd, uint32_t mask, void *data)
 {
 	struct weston_compositor *ec;
 	struct evdev_device *device = data;
-	struct input_event ev[32];
+	struct input_event ev[128];
 	int len;
 
 	ec = device->seat->compositor;
@@ -388,13 +423,20 @@ evdev_device_data(int fd, uint32_t mask, void *data)
 
 		if (len < 0 || len % sizeof ev[0] != 0) {
 			/* FIXME: call evdev_device_destroy when errno is ENODEV. */
-			return 1;
+			break;
 		}
 
+		device->stats.reads++;
 		evdev_process_events(device, ev, len / sizeof ev[0]);
 
 	} while (len > 0);
 
+	/* While the compositor is repainting the input loop is only
+	 * dispatched once per frame, so everything read above arrived
+	 * since the last repaint and one motion event is enough. */
+	if (device->coalesce_motion)
+		evdev_flush_motion(device, device->motion_time);
+
 	return 1;
 }
 
@@ -524,6 +566,7 @@ evdev_device_create(struct weston_seat *seat, const char *path, int device_fd)
 	struct evdev_device *device;
 	struct weston_compositor *ec;
 	char devname[256] = "unknown";
+	int clockid = CLOCK_MONOTONIC;
 
 	device = malloc(sizeof *device);
 	if (device == NULL)
@@ -547,6 +590,12 @@ evdev_device_create(struct weston_seat *seat, const char *path, int device_fd)
 	ioctl(device->fd, EVIOCGNAME(sizeof(devname)), devname);
 	device->devname = strdup(devname);
 
+	/* Have the kernel stamp events with the same clock as
+	 * weston_compositor_get_time() so that the touchpad timers and
+	 * frame times can be compared against event times. */
+	if (ioctl(device->fd, EVIOCSCLOCKID, &clockid) < 0)
+		weston_log("failed to set monotonic clock for %s\n", path);
+
 	if (!evdev_handle_device(device)) {
 		free(device->devnode);
 		free(device->devname);
@@ -557,9 +606,13 @@ evdev_device_create(struct weston_seat *seat, const char *path, int device_fd)
 	if (evdev_configure_device(device) == -1)
 		goto err1;
 
-	/* If the dispatch was not set up use the fallback. */
-	if (device->dispatch == NULL)
+	/* If the dispatch was not set up use the fallback.  The touchpad
+	 * dispatch generates its own motion and button events from the
+	 * finger state, so only the fallback coalesces motion. */
+	if (device->dispatch == NULL) {
 		device->dispatch = fallback_dispatch_create();
+		device->coalesce_motion = ec->coalesce_motion;
+	}
 	if (device->dispatch == NULL)
 		goto err1;
 
@@ -606,6 +659,19 @@ evdev_device_destroy(struct evdev_device *device)
 	free(device);
 }
 
+void
+evdev_device_log_stats(struct evdev_device *device)
+{
+	weston_log_continue(STAMP_SPACE "%s: %llu reads, %llu events, "
+			    "%llu motion reports, %llu motion delivered%s\n",
+			    device->devname,
+			    (unsigned long long) device->stats.reads,
+			    (unsigned long long) device->stats.events,
+			    (unsigned long long) device->stats.motion_reports,
+			    (unsigned long long) device->stats.motion_delivered,
+			    device->coalesce_motion ? " (coalescing)" : "");
+}
+
 void
 evdev_notify_keyboard_focus(struct weston_seat *seat,
 			    struct wl_list *evdev_devices)
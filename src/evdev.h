@@ -77,6 +77,20 @@ struct evdev_device {
 	enum evdev_device_capability caps;
 
 	int is_mt;
+
+	/* When set, motion is accumulated across SYN_REPORTs and only
+	 * delivered before the next non-motion event or once the fd has
+	 * been drained, see evdev_device_data(). */
+	int coalesce_motion;
+	int report_has_motion;
+	uint32_t motion_time;
+
+	struct {
+		uint64_t reads;
+		uint64_t events;
+		uint64_t motion_reports;
+		uint64_t motion_delivered;
+	} stats;
 };
 
 /* copied from udev/extras/input_id/input_id.c */
@@ -120,6 +134,9 @@ evdev_device_create(struct weston_seat *seat, const char *path, int device_fd);
 void
 evdev_device_destroy(struct evdev_device *device);
 
+void
+evdev_device_log_stats(struct evdev_device *device);
+
 void
 evdev_notify_keyboard_focus(struct weston_seat *seat,
 			    struct wl_list *evdev_devices);
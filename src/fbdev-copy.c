@@ -0,0 +1,154 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdint.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "fbdev-copy.h"
+
+/* Undamaged bytes between two rects of a band that we'd rather copy
+ * from the shadow than break the write stream for.  Frame buffer
+ * mappings are usually write-combined, where every gap costs a partial
+ * burst, while reading a few hundred extra bytes from the cached shadow
+ * is nearly free. */
+#define SPAN_GAP 256
+
+static void
+stream_copy(uint8_t *dst, const uint8_t *src, size_t len)
+{
+#ifdef __SSE2__
+	size_t head;
+
+	/* Non-temporal stores bypass the cache and go out as full
+	 * write-combining bursts.  Only use them for whole 64 byte
+	 * lines, a partially written line is flushed as several small
+	 * transactions. */
+	head = -(uintptr_t) dst & 63;
+	if (head > len)
+		head = len;
+	memcpy(dst, src, head);
+	dst += head;
+	src += head;
+	len -= head;
+
+	for (; len >= 64; len -= 64, dst += 64, src += 64) {
+		__m128i a = _mm_loadu_si128((const __m128i *) src);
+		__m128i b = _mm_loadu_si128((const __m128i *) (src + 16));
+		__m128i c = _mm_loadu_si128((const __m128i *) (src + 32));
+		__m128i d = _mm_loadu_si128((const __m128i *) (src + 48));
+
+		_mm_stream_si128((__m128i *) dst, a);
+		_mm_stream_si128((__m128i *) (dst + 16), b);
+		_mm_stream_si128((__m128i *) (dst + 32), c);
+		_mm_stream_si128((__m128i *) (dst + 48), d);
+	}
+
+#endif
+
+	memcpy(dst, src, len);
+}
+
+static size_t
+copy_span(uint8_t *fb, int fb_stride, const uint8_t *shadow,
+	  int shadow_stride, int cpp, int width,
+	  int x1, int x2, int y1, int y2)
+{
+	size_t len = (size_t) (x2 - x1) * cpp;
+	int y;
+
+	fb += (size_t) y1 * fb_stride + x1 * cpp;
+	shadow += (size_t) y1 * shadow_stride + x1 * cpp;
+
+	/* Whole rows of identically laid out buffers are contiguous. */
+	if (x1 == 0 && x2 == width &&
+	    fb_stride == shadow_stride && (size_t) fb_stride == len) {
+		len *= y2 - y1;
+		stream_copy(fb, shadow, len);
+		return len;
+	}
+
+	for (y = y1; y < y2; y++) {
+		stream_copy(fb, shadow, len);
+		fb += fb_stride;
+		shadow += shadow_stride;
+	}
+
+	return len * (y2 - y1);
+}
+
+size_t
+fbdev_copy_region(void *fb, int fb_stride, pixman_image_t *shadow,
+		  pixman_region32_t *region)
+{
+	const uint8_t *src = (const uint8_t *) pixman_image_get_data(shadow);
+	int src_stride = pixman_image_get_stride(shadow);
+	int width = pixman_image_get_width(shadow);
+	int cpp = PIXMAN_FORMAT_BPP(pixman_image_get_format(shadow)) / 8;
+	pixman_box32_t *rects;
+	size_t written = 0;
+	int i, j, n, x1, x2;
+
+	rects = pixman_region32_rectangles(region, &n);
+
+	/* pixman regions are y-x banded: the rects sharing a y1 have the
+	 * same height and are sorted by x, so each band becomes a few
+	 * long spans. */
+	for (i = 0; i < n; i = j) {
+		x1 = rects[i].x1;
+		x2 = rects[i].x2;
+
+		if (x1 * cpp <= SPAN_GAP)
+			x1 = 0;
+
+		for (j = i + 1; j < n && rects[j].y1 == rects[i].y1; j++) {
+			if ((rects[j].x1 - x2) * cpp <= SPAN_GAP) {
+				x2 = rects[j].x2;
+				continue;
+			}
+
+			written += copy_span(fb, fb_stride, src, src_stride,
+					     cpp, width, x1, x2,
+					     rects[i].y1, rects[i].y2);
+			x1 = rects[j].x1;
+			x2 = rects[j].x2;
+		}
+
+		if ((width - x2) * cpp <= SPAN_GAP)
+			x2 = width;
+
+		written += copy_span(fb, fb_stride, src, src_stride,
+				     cpp, width, x1, x2,
+				     rects[i].y1, rects[i].y2);
+	}
+
+#ifdef __SSE2__
+	/* Make the streamed stores globally visible before the frame is
+	 * considered done. */
+	_mm_sfence();
+#endif
+
+	return written;
+}
@@ -0,0 +1,40 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#ifndef _WESTON_FBDEV_COPY_H_
+#define _WESTON_FBDEV_COPY_H_
+
+#include <stddef.h>
+#include <pixman.h>
+
+/* Copy the damaged region of an untransformed shadow image into frame
+ * buffer memory of the same format.  The frame buffer is only ever
+ * written, never read, and the writes are grouped into long runs: rects
+ * in a band that are close together are merged into one span (copying
+ * the undamaged pixels between them from the shadow), and full width
+ * bands of a frame buffer without stride padding become a single
+ * sequential copy.  Returns the number of bytes written. */
+size_t
+fbdev_copy_region(void *fb, int fb_stride, pixman_image_t *shadow,
+		  pixman_region32_t *region);
+
+#endif
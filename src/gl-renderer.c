@@ -28,11 +28,11 @@
 #include <stdlib.h>
 #include <string.h>
 #include <ctype.h>
-#include <float.h>
 #include <assert.h>
 #include <linux/input.h>
 
 #include "gl-renderer.h"
+#include "vertex-clipping.h"
 
 #include <EGL/eglext.h>
 #include "weston-egl-ext.h"
@@ -52,12 +52,19 @@ struct gl_output_state {
 	pixman_region32_t buffer_damage[2];
 };
 
+enum buffer_type {
+	BUFFER_TYPE_NULL,
+	BUFFER_TYPE_SHM,
+	BUFFER_TYPE_EGL
+};
+
 struct gl_surface_state {
 	GLfloat color[4];
 	struct gl_shader *shader;
 
 	GLuint textures[3];
 	int num_textures;
+	int needs_full_upload;
 	pixman_region32_t texture_damage;
 
 	EGLImageKHR images[3];
@@ -65,7 +72,10 @@ struct gl_surface_state {
 	int num_images;
 
 	struct weston_buffer_reference buffer_ref;
+	enum buffer_type buffer_type;
 	int pitch; /* in pixels */
+	int height; /* in pixels */
+	uint32_t shm_format;
 };
 
 struct gl_renderer {
@@ -160,366 +170,8 @@ gl_renderer_print_egl_error_state(void)
 		egl_error_string(code), (long)code);
 }
 
-struct polygon8 {
-	GLfloat x[8];
-	GLfloat y[8];
-	int n;
-};
-
-struct clip_context {
-	struct {
-		GLfloat x;
-		GLfloat y;
-	} prev;
-
-	struct {
-		GLfloat x1, y1;
-		GLfloat x2, y2;
-	} clip;
-
-	struct {
-		GLfloat *x;
-		GLfloat *y;
-	} vertices;
-};
-
-static GLfloat
-float_difference(GLfloat a, GLfloat b)
-{
-	/* http://www.altdevblogaday.com/2012/02/22/comparing-floating-point-numbers-2012-edition/ */
-	static const GLfloat max_diff = 4.0f * FLT_MIN;
-	static const GLfloat max_rel_diff = 4.0e-5;
-	GLfloat diff = a - b;
-	GLfloat adiff = fabsf(diff);
-
-	if (adiff <= max_diff)
-		return 0.0f;
-
-	a = fabsf(a);
-	b = fabsf(b);
-	if (adiff <= (a > b ? a : b) * max_rel_diff)
-		return 0.0f;
-
-	return diff;
-}
-
-/* A line segment (p1x, p1y)-(p2x, p2y) intersects the line x = x_arg.
- * Compute the y coordinate of the intersection.
- */
-static GLfloat
-clip_intersect_y(GLfloat p1x, GLfloat p1y, GLfloat p2x, GLfloat p2y,
-		 GLfloat x_arg)
-{
-	GLfloat a;
-	GLfloat diff = float_difference(p1x, p2x);
-
-	/* Practically vertical line segment, yet the end points have already
-	 * been determined to be on different sides of the line. Therefore
-	 * the line segment is part of the line and intersects everywhere.
-	 * Return the end point, so we use the whole line segment.
-	 */
-	if (diff == 0.0f)
-		return p2y;
-
-	a = (x_arg - p2x) / diff;
-	return p2y + (p1y - p2y) * a;
-}
-
-/* A line segment (p1x, p1y)-(p2x, p2y) intersects the line y = y_arg.
- * Compute the x coordinate of the intersection.
- */
-static GLfloat
-clip_intersect_x(GLfloat p1x, GLfloat p1y, GLfloat p2x, GLfloat p2y,
-		 GLfloat y_arg)
-{
-	GLfloat a;
-	GLfloat diff = float_difference(p1y, p2y);
-
-	/* Practically horizontal line segment, yet the end points have already
-	 * been determined to be on different sides of the line. Therefore
-	 * the line segment is part of the line and intersects everywhere.
-	 * Return the end point, so we use the whole line segment.
-	 */
-	if (diff == 0.0f)
-		return p2x;
-
-	a = (y_arg - p2y) / diff;
-	return p2x + (p1x - p2x) * a;
-}
-
-enum path_transition {
-	PATH_TRANSITION_OUT_TO_OUT = 0,
-	PATH_TRANSITION_OUT_TO_IN = 1,
-	PATH_TRANSITION_IN_TO_OUT = 2,
-	PATH_TRANSITION_IN_TO_IN = 3,
-};
-
-static void
-clip_append_vertex(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	*ctx->vertices.x++ = x;
-	*ctx->vertices.y++ = y;
-}
-
-static enum path_transition
-path_transition_left_edge(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	return ((ctx->prev.x >= ctx->clip.x1) << 1) | (x >= ctx->clip.x1);
-}
-
-static enum path_transition
-path_transition_right_edge(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	return ((ctx->prev.x < ctx->clip.x2) << 1) | (x < ctx->clip.x2);
-}
-
-static enum path_transition
-path_transition_top_edge(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	return ((ctx->prev.y >= ctx->clip.y1) << 1) | (y >= ctx->clip.y1);
-}
-
-static enum path_transition
-path_transition_bottom_edge(struct clip_context *ctx, GLfloat x, GLfloat y)
-{
-	return ((ctx->prev.y < ctx->clip.y2) << 1) | (y < ctx->clip.y2);
-}
-
-static void
-clip_polygon_leftright(struct clip_context *ctx,
-		       enum path_transition transition,
-		       GLfloat x, GLfloat y, GLfloat clip_x)
-{
-	GLfloat yi;
-
-	switch (transition) {
-	case PATH_TRANSITION_IN_TO_IN:
-		clip_append_vertex(ctx, x, y);
-		break;
-	case PATH_TRANSITION_IN_TO_OUT:
-		yi = clip_intersect_y(ctx->prev.x, ctx->prev.y, x, y, clip_x);
-		clip_append_vertex(ctx, clip_x, yi);
-		break;
-	case PATH_TRANSITION_OUT_TO_IN:
-		yi = clip_intersect_y(ctx->prev.x, ctx->prev.y, x, y, clip_x);
-		clip_append_vertex(ctx, clip_x, yi);
-		clip_append_vertex(ctx, x, y);
-		break;
-	case PATH_TRANSITION_OUT_TO_OUT:
-		/* nothing */
-		break;
-	default:
-		assert(0 && "bad enum path_transition");
-	}
-
-	ctx->prev.x = x;
-	ctx->prev.y = y;
-}
-
-static void
-clip_polygon_topbottom(struct clip_context *ctx,
-		       enum path_transition transition,
-		       GLfloat x, GLfloat y, GLfloat clip_y)
-{
-	GLfloat xi;
-
-	switch (transition) {
-	case PATH_TRANSITION_IN_TO_IN:
-		clip_append_vertex(ctx, x, y);
-		break;
-	case PATH_TRANSITION_IN_TO_OUT:
-		xi = clip_intersect_x(ctx->prev.x, ctx->prev.y, x, y, clip_y);
-		clip_append_vertex(ctx, xi, clip_y);
-		break;
-	case PATH_TRANSITION_OUT_TO_IN:
-		xi = clip_intersect_x(ctx->prev.x, ctx->prev.y, x, y, clip_y);
-		clip_append_vertex(ctx, xi, clip_y);
-		clip_append_vertex(ctx, x, y);
-		break;
-	case PATH_TRANSITION_OUT_TO_OUT:
-		/* nothing */
-		break;
-	default:
-		assert(0 && "bad enum path_transition");
-	}
-
-	ctx->prev.x = x;
-	ctx->prev.y = y;
-}
-
-static void
-clip_context_prepare(struct clip_context *ctx, const struct polygon8 *src,
-		      GLfloat *dst_x, GLfloat *dst_y)
-{
-	ctx->prev.x = src->x[src->n - 1];
-	ctx->prev.y = src->y[src->n - 1];
-	ctx->vertices.x = dst_x;
-	ctx->vertices.y = dst_y;
-}
-
-static int
-clip_polygon_left(struct clip_context *ctx, const struct polygon8 *src,
-		  GLfloat *dst_x, GLfloat *dst_y)
-{
-	enum path_transition trans;
-	int i;
-
-	clip_context_prepare(ctx, src, dst_x, dst_y);
-	for (i = 0; i < src->n; i++) {
-		trans = path_transition_left_edge(ctx, src->x[i], src->y[i]);
-		clip_polygon_leftright(ctx, trans, src->x[i], src->y[i],
-				       ctx->clip.x1);
-	}
-	return ctx->vertices.x - dst_x;
-}
-
-static int
-clip_polygon_right(struct clip_context *ctx, const struct polygon8 *src,
-		   GLfloat *dst_x, GLfloat *dst_y)
-{
-	enum path_transition trans;
-	int i;
-
-	clip_context_prepare(ctx, src, dst_x, dst_y);
-	for (i = 0; i < src->n; i++) {
-		trans = path_transition_right_edge(ctx, src->x[i], src->y[i]);
-		clip_polygon_leftright(ctx, trans, src->x[i], src->y[i],
-				       ctx->clip.x2);
-	}
-	return ctx->vertices.x - dst_x;
-}
-
-static int
-clip_polygon_top(struct clip_context *ctx, const struct polygon8 *src,
-		 GLfloat *dst_x, GLfloat *dst_y)
-{
-	enum path_transition trans;
-	int i;
-
-	clip_context_prepare(ctx, src, dst_x, dst_y);
-	for (i = 0; i < src->n; i++) {
-		trans = path_transition_top_edge(ctx, src->x[i], src->y[i]);
-		clip_polygon_topbottom(ctx, trans, src->x[i], src->y[i],
-				       ctx->clip.y1);
-	}
-	return ctx->vertices.x - dst_x;
-}
-
-static int
-clip_polygon_bottom(struct clip_context *ctx, const struct polygon8 *src,
-		    GLfloat *dst_x, GLfloat *dst_y)
-{
-	enum path_transition trans;
-	int i;
-
-	clip_context_prepare(ctx, src, dst_x, dst_y);
-	for (i = 0; i < src->n; i++) {
-		trans = path_transition_bottom_edge(ctx, src->x[i], src->y[i]);
-		clip_polygon_topbottom(ctx, trans, src->x[i], src->y[i],
-				       ctx->clip.y2);
-	}
-	return ctx->vertices.x - dst_x;
-}
-
-#define max(a, b) (((a) > (b)) ? (a) : (b))
-#define min(a, b) (((a) > (b)) ? (b) : (a))
-#define clip(x, a, b)  min(max(x, a), b)
-
-/*
- * Compute the boundary vertices of the intersection of the global coordinate
- * aligned rectangle 'rect', and an arbitrary quadrilateral produced from
- * 'surf_rect' when transformed from surface coordinates into global coordinates.
- * The vertices are written to 'ex' and 'ey', and the return value is the
- * number of vertices. Vertices are produced in clockwise winding order.
- * Guarantees to produce either zero vertices, or 3-8 vertices with non-zero
- * polygon area.
- */
-static int
-calculate_edges(struct weston_surface *es, pixman_box32_t *rect,
-		pixman_box32_t *surf_rect, GLfloat *ex, GLfloat *ey)
-{
-	struct polygon8 polygon;
-	struct clip_context ctx;
-	int i, n;
-	GLfloat min_x, max_x, min_y, max_y;
-	struct polygon8 surf = {
-		{ surf_rect->x1, surf_rect->x2, surf_rect->x2, surf_rect->x1 },
-		{ surf_rect->y1, surf_rect->y1, surf_rect->y2, surf_rect->y2 },
-		4
-	};
-
-	ctx.clip.x1 = rect->x1;
-	ctx.clip.y1 = rect->y1;
-	ctx.clip.x2 = rect->x2;
-	ctx.clip.y2 = rect->y2;
-
-	/* transform surface to screen space: */
-	for (i = 0; i < surf.n; i++)
-		weston_surface_to_global_float(es, surf.x[i], surf.y[i],
-					       &surf.x[i], &surf.y[i]);
-
-	/* find bounding box: */
-	min_x = max_x = surf.x[0];
-	min_y = max_y = surf.y[0];
-
-	for (i = 1; i < surf.n; i++) {
-		min_x = min(min_x, surf.x[i]);
-		max_x = max(max_x, surf.x[i]);
-		min_y = min(min_y, surf.y[i]);
-		max_y = max(max_y, surf.y[i]);
-	}
-
-	/* First, simple bounding box check to discard early transformed
-	 * surface rects that do not intersect with the clip region:
-	 */
-	if ((min_x >= ctx.clip.x2) || (max_x <= ctx.clip.x1) ||
-	    (min_y >= ctx.clip.y2) || (max_y <= ctx.clip.y1))
-		return 0;
-
-	/* Simple case, bounding box edges are parallel to surface edges,
-	 * there will be only four edges.  We just need to clip the surface
-	 * vertices to the clip rect bounds:
-	 */
-	if (!es->transform.enabled) {
-		for (i = 0; i < surf.n; i++) {
-			ex[i] = clip(surf.x[i], ctx.clip.x1, ctx.clip.x2);
-			ey[i] = clip(surf.y[i], ctx.clip.y1, ctx.clip.y2);
-		}
-		return surf.n;
-	}
-
-	/* Transformed case: use a general polygon clipping algorithm to
-	 * clip the surface rectangle with each side of 'rect'.
-	 * The algorithm is Sutherland-Hodgman, as explained in
-	 * http://www.codeguru.com/cpp/misc/misc/graphics/article.php/c8965/Polygon-Clipping.htm
-	 * but without looking at any of that code.
-	 */
-	polygon.n = clip_polygon_left(&ctx, &surf, polygon.x, polygon.y);
-	surf.n = clip_polygon_right(&ctx, &polygon, surf.x, surf.y);
-	polygon.n = clip_polygon_top(&ctx, &surf, polygon.x, polygon.y);
-	surf.n = clip_polygon_bottom(&ctx, &polygon, surf.x, surf.y);
-
-	/* Get rid of duplicate vertices */
-	ex[0] = surf.x[0];
-	ey[0] = surf.y[0];
-	n = 1;
-	for (i = 1; i < surf.n; i++) {
-		if (float_difference(ex[n - 1], surf.x[i]) == 0.0f &&
-		    float_difference(ey[n - 1], surf.y[i]) == 0.0f)
-			continue;
-		ex[n] = surf.x[i];
-		ey[n] = surf.y[i];
-		n++;
-	}
-	if (float_difference(ex[n - 1], surf.x[0]) == 0.0f &&
-	    float_difference(ey[n - 1], surf.y[0]) == 0.0f)
-		n--;
-
-	if (n < 3)
-		return 0;
-
-	return n;
-}
+/* Damage rects handed to clip_quad_boxes() at a time. */
+#define CLIP_BATCH 64
 
 static int
 texture_region(struct weston_surface *es, pixman_region32_t *region,
@@ -530,7 +182,7 @@ texture_region(struct weston_surface *es, pixman_region32_t *region,
 	GLfloat *v, inv_width, inv_height;
 	unsigned int *vtxcnt, nvtx = 0;
 	pixman_box32_t *rects, *surf_rects;
-	int i, j, k, nrects, nsurf;
+	int i, j, k, m, nrects, nsurf, nbatch, npolygons;
 
 	rects = pixman_region32_rectangles(region, &nrects);
 	surf_rects = pixman_region32_rectangles(surf_region, &nsurf);
@@ -554,46 +206,74 @@ texture_region(struct weston_surface *es, pixman_region32_t *region,
 		inv_height = 1.0 / es->geometry.height;
 	}
 
-	for (i = 0; i < nrects; i++) {
-		pixman_box32_t *rect = &rects[i];
-		for (j = 0; j < nsurf; j++) {
-			pixman_box32_t *surf_rect = &surf_rects[j];
+	for (j = 0; j < nsurf; j++) {
+		pixman_box32_t *surf_rect = &surf_rects[j];
+		struct polygon8 quad = {
+			{ surf_rect->x1, surf_rect->x2,
+			  surf_rect->x2, surf_rect->x1 },
+			{ surf_rect->y1, surf_rect->y1,
+			  surf_rect->y2, surf_rect->y2 },
+			4
+		};
+
+		/* transform surface to screen space, once for all of the
+		 * damage rects: */
+		for (k = 0; k < quad.n; k++)
+			weston_surface_to_global_float(es,
+						       quad.x[k], quad.y[k],
+						       &quad.x[k], &quad.y[k]);
+
+		for (i = 0; i < nrects; i += nbatch) {
 			GLfloat sx, sy, bx, by;
-			GLfloat ex[8], ey[8];          /* edge points in screen space */
-			int n;
-
-			/* The transformed surface, after clipping to the clip region,
-			 * can have as many as eight sides, emitted as a triangle-fan.
-			 * The first vertex in the triangle fan can be chosen arbitrarily,
-			 * since the area is guaranteed to be convex.
+			/* edge points in screen space */
+			GLfloat ex[CLIP_BATCH * 8], ey[CLIP_BATCH * 8];
+			GLfloat *px = ex, *py = ey;
+			int counts[CLIP_BATCH];
+
+			nbatch = nrects - i;
+			if (nbatch > CLIP_BATCH)
+				nbatch = CLIP_BATCH;
+
+			/* The transformed surface, after clipping to the clip
+			 * region, can have as many as eight sides, emitted as
+			 * a triangle-fan.  The first vertex in the triangle
+			 * fan can be chosen arbitrarily, since the area is
+			 * guaranteed to be convex.
 			 *
-			 * If a corner of the transformed surface falls outside of the
-			 * clip region, instead of emitting one vertex for the corner
-			 * of the surface, up to two are emitted for two corresponding
-			 * intersection point(s) between the surface and the clip region.
+			 * If a corner of the transformed surface falls
+			 * outside of the clip region, instead of emitting one
+			 * vertex for the corner of the surface, up to two are
+			 * emitted for two corresponding intersection point(s)
+			 * between the surface and the clip region.
 			 *
-			 * To do this, we first calculate the (up to eight) points that
-			 * form the intersection of the clip rect and the transformed
-			 * surface.
+			 * To do this, we first calculate the (up to eight)
+			 * points that form the intersection of each clip rect
+			 * and the transformed surface.
 			 */
-			n = calculate_edges(es, rect, surf_rect, ex, ey);
-			if (n < 3)
-				continue;
+			npolygons = clip_quad_boxes(&quad,
+						    es->transform.enabled,
+						    &rects[i], nbatch,
+						    ex, ey, counts);
 
 			/* emit edge points: */
-			for (k = 0; k < n; k++) {
-				weston_surface_from_global_float(es, ex[k], ey[k], &sx, &sy);
-				/* position: */
-				*(v++) = ex[k];
-				*(v++) = ey[k];
-				/* texcoord: */
-				weston_surface_to_buffer_float(es, sx, sy,
-							       &bx, &by);
-				*(v++) = bx * inv_width;
-				*(v++) = by * inv_height;
+			for (m = 0; m < npolygons; m++) {
+				for (k = 0; k < counts[m]; k++) {
+					weston_surface_from_global_float(es,
+						px[k], py[k], &sx, &sy);
+					/* position: */
+					*(v++) = px[k];
+					*(v++) = py[k];
+					/* texcoord: */
+					weston_surface_to_buffer_float(es,
+						sx, sy, &bx, &by);
+					*(v++) = bx * inv_width;
+					*(v++) = by * inv_height;
+				}
+
+				px += counts[m];
+				py += counts[m];
+				vtxcnt[nvtx++] = counts[m];
 			}
-
-			vtxcnt[nvtx++] = n;
 		}
 	}
 
@@ -762,6 +442,8 @@ draw_surface(struct weston_surface *es, struct weston_output *output,
 	buffer_damage = &go->buffer_damage[go->current_buffer];
 	pixman_region32_subtract(buffer_damage, buffer_damage, &repaint);
 
+	es->stats.total.composited_pixels += weston_region_area(&repaint);
+
 	glBlendFunc(GL_ONE, GL_ONE_MINUS_SRC_ALPHA);
 
 	if (ec->fan_debug) {
@@ -1065,16 +747,19 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 	if (surface->plane != &surface->compositor->primary_plane)
 		return;
 
-	if (!pixman_region32_not_empty(&gs->texture_damage))
+	if (!pixman_region32_not_empty(&gs->texture_damage) &&
+	    !gs->needs_full_upload)
 		goto done;
 
 	glBindTexture(GL_TEXTURE_2D, gs->textures[0]);
 
 	if (!gr->has_unpack_subimage) {
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_BGRA_EXT,
-			     gs->pitch, buffer->height, 0,
-			     GL_BGRA_EXT, GL_UNSIGNED_BYTE,
-			     wl_shm_buffer_get_data(buffer));
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+				gs->pitch, gs->height,
+				GL_BGRA_EXT, GL_UNSIGNED_BYTE,
+				wl_shm_buffer_get_data(buffer));
+		surface->stats.total.upload_bytes +=
+			(uint64_t) gs->pitch * gs->height * 4;
 
 		goto done;
 	}
@@ -1083,6 +768,21 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 	/* Mesa does not define GL_EXT_unpack_subimage */
 	glPixelStorei(GL_UNPACK_ROW_LENGTH, gs->pitch);
 	data = wl_shm_buffer_get_data(buffer);
+
+	/* Freshly allocated storage has undefined contents, so the
+	 * damage alone is not enough to fill it. */
+	if (gs->needs_full_upload) {
+		glPixelStorei(GL_UNPACK_SKIP_PIXELS, 0);
+		glPixelStorei(GL_UNPACK_SKIP_ROWS, 0);
+		glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0,
+				gs->pitch, gs->height,
+				GL_BGRA_EXT, GL_UNSIGNED_BYTE, data);
+		surface->stats.total.upload_bytes +=
+			(uint64_t) gs->pitch * gs->height * 4;
+
+		goto done;
+	}
+
 	rectangles = pixman_region32_rectangles(&gs->texture_damage, &n);
 	for (i = 0; i < n; i++) {
 		pixman_box32_t r;
@@ -1094,12 +794,15 @@ gl_renderer_flush_damage(struct weston_surface *surface)
 		glTexSubImage2D(GL_TEXTURE_2D, 0, r.x1, r.y1,
 				r.x2 - r.x1, r.y2 - r.y1,
 				GL_BGRA_EXT, GL_UNSIGNED_BYTE, data);
+		surface->stats.total.upload_bytes +=
+			(uint64_t) (r.x2 - r.x1) * (r.y2 - r.y1) * 4;
 	}
 #endif
 
 done:
 	pixman_region32_fini(&gs->texture_damage);
 	pixman_region32_init(&gs->texture_damage);
+	gs->needs_full_upload = 0;
 
 	weston_buffer_reference(&gs->buffer_ref, NULL);
 }
@@ -1131,7 +834,8 @@ gl_renderer_attach(struct weston_surface *es, struct wl_buffer *buffer)
 	struct gl_renderer *gr = get_renderer(ec);
 	struct gl_surface_state *gs = get_surface_state(es);
 	EGLint attribs[3], format;
-	int i, num_planes;
+	uint32_t shm_format;
+	int i, num_planes, pitch;
 
 	weston_buffer_reference(&gs->buffer_ref, buffer);
 
@@ -1143,22 +847,49 @@ gl_renderer_attach(struct weston_surface *es, struct wl_buffer *buffer)
 		gs->num_images = 0;
 		glDeleteTextures(gs->num_textures, gs->textures);
 		gs->num_textures = 0;
+		gs->buffer_type = BUFFER_TYPE_NULL;
 		return;
 	}
 
 	if (wl_buffer_is_shm(buffer)) {
-		gs->pitch = wl_shm_buffer_get_stride(buffer) / 4;
+		pitch = wl_shm_buffer_get_stride(buffer) / 4;
+		shm_format = wl_shm_buffer_get_format(buffer);
+
+		if (shm_format == WL_SHM_FORMAT_XRGB8888)
+			gs->shader = &gr->texture_shader_rgbx;
+		else
+			gs->shader = &gr->texture_shader_rgba;
+
+		/* Double-buffered clients attach a buffer of the same
+		 * layout every frame; keep the storage and let
+		 * gl_renderer_flush_damage() upload only the damage. */
+		if (gs->buffer_type == BUFFER_TYPE_SHM &&
+		    gs->pitch == pitch && gs->height == buffer->height &&
+		    gs->shm_format == shm_format)
+			return;
+
+		if (gs->buffer_type == BUFFER_TYPE_EGL) {
+			for (i = 0; i < gs->num_images; i++)
+				gr->destroy_image(gr->egl_display,
+						  gs->images[i]);
+			gs->num_images = 0;
+			glDeleteTextures(gs->num_textures, gs->textures);
+			gs->num_textures = 0;
+		}
+
+		gs->pitch = pitch;
+		gs->height = buffer->height;
+		gs->shm_format = shm_format;
 		gs->target = GL_TEXTURE_2D;
+		gs->buffer_type = BUFFER_TYPE_SHM;
+		gs->needs_full_upload = 1;
 
 		ensure_textures(gs, 1);
 		glBindTexture(GL_TEXTURE_2D, gs->textures[0]);
 		glTexImage2D(GL_TEXTURE_2D, 0, GL_BGRA_EXT,
-			     gs->pitch, buffer->height, 0,
+			     gs->pitch, gs->height, 0,
 			     GL_BGRA_EXT, GL_UNSIGNED_BYTE, NULL);
-		if (wl_shm_buffer_get_format(buffer) == WL_SHM_FORMAT_XRGB8888)
-			gs->shader = &gr->texture_shader_rgbx;
-		else
-			gs->shader = &gr->texture_shader_rgba;
+		es->stats.total.texture_allocs++;
 	} else if (gr->query_buffer(gr->egl_display, buffer,
 				    EGL_TEXTURE_FORMAT, &format)) {
 		for (i = 0; i < gs->num_images; i++)
@@ -1213,6 +944,8 @@ gl_renderer_attach(struct weston_surface *es, struct wl_buffer *buffer)
 		}
 
 		gs->pitch = buffer->width;
+		gs->height = buffer->height;
+		gs->buffer_type = BUFFER_TYPE_EGL;
 	} else {
 		weston_log("unhandled buffer type!\n");
 		weston_buffer_reference(&gs->buffer_ref, NULL);
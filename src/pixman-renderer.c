@@ -23,6 +23,8 @@
 
 #define _GNU_SOURCE
 
+#include "config.h"
+
 #include <errno.h>
 #include <stdlib.h>
 
@@ -31,14 +33,30 @@
 #include <linux/input.h>
 
 struct pixman_output_state {
+	uint32_t flags;
 	void *shadow_buffer;
 	pixman_image_t *shadow_image;
 	pixman_image_t *hw_buffer;
+
+	/* Surfaces are composited into the shadow image and then copied
+	 * to hw_buffer only when the output is transformed, the hardware
+	 * buffer format isn't one we can draw into directly, or the
+	 * backend asked for it.  Otherwise this is hw_buffer. */
+	pixman_image_t *target;
 };
 
+typedef void (*convert_func_t)(pixman_image_t *image,
+			       struct wl_buffer *buffer,
+			       const pixman_box32_t *box);
+
 struct pixman_surface_state {
 	pixman_image_t *image;
 	struct weston_buffer_reference buffer_ref;
+
+	/* Buffers in formats pixman can't sample from are converted
+	 * into image, which is x8r8g8b8, as they get damaged. */
+	convert_func_t convert;
+	int needs_full_convert;
 };
 
 struct pixman_renderer {
@@ -155,7 +173,7 @@ repaint_region_complex(struct weston_surface *es, struct weston_output *output,
 		pixman_image_composite32(PIXMAN_OP_OVER,
 			ps->image, /* src */
 			NULL /* mask */,
-			po->shadow_image, /* dest */
+			po->target, /* dest */
 			rects[i].x1, rects[i].y1, /* src_x, src_y */
 			0, 0, /* mask_x, mask_y */
 			rect.x1, rect.y1, /* dst_x, dst_y */
@@ -169,7 +187,7 @@ repaint_region_complex(struct weston_surface *es, struct weston_output *output,
 		pixman_image_composite32(PIXMAN_OP_OVER,
 			pr->debug_color, /* src */
 			NULL /* mask */,
-			po->shadow_image, /* dest */
+			po->target, /* dest */
 			0, 0, /* src_x, src_y */
 			0, 0, /* mask_x, mask_y */
 			rect.x1, rect.y1, /* dest_x, dest_y */
@@ -220,7 +238,7 @@ repaint_region_simple(struct weston_surface *es, struct weston_output *output,
 		pixman_image_composite32(pixman_op,
 			ps->image, /* src */
 			NULL /* mask */,
-			po->shadow_image, /* dest */
+			po->target, /* dest */
 			src_x, src_y, /* src_x, src_y */
 			0, 0, /* mask_x, mask_y */
 			rect.x1, rect.y1, /* dest_x, dest_y */
@@ -233,7 +251,7 @@ repaint_region_simple(struct weston_surface *es, struct weston_output *output,
 		pixman_image_composite32(PIXMAN_OP_OVER,
 			pr->debug_color, /* src */
 			NULL /* mask */,
-			po->shadow_image, /* dest */
+			po->target, /* dest */
 			src_x, src_y, /* src_x, src_y */
 			0, 0, /* mask_x, mask_y */
 			rect.x1, rect.y1, /* dest_x, dest_y */
@@ -270,6 +288,8 @@ draw_surface(struct weston_surface *es, struct weston_output *output,
 		goto out;
 	}
 
+	es->stats.total.composited_pixels += weston_region_area(&repaint);
+
 	/* TODO: Implement repaint_region_complex() using pixman_composite_trapezoids() */
 	if (es->transform.enabled &&
 	    es->transform.matrix.type != WESTON_MATRIX_TRANSFORM_TRANSLATE) {
@@ -345,7 +365,8 @@ pixman_renderer_repaint_output(struct weston_output *output,
 		return;
 
 	repaint_surfaces(output, output_damage);
-	copy_to_hw_buffer(output, output_damage);
+	if (po->target != po->hw_buffer)
+		copy_to_hw_buffer(output, output_damage);
 
 	pixman_region32_copy(&output->previous_damage, output_damage);
 	wl_signal_emit(&output->frame_signal, output);
@@ -353,52 +374,215 @@ pixman_renderer_repaint_output(struct weston_output *output,
 	/* Actual flip should be done by caller */
 }
 
+/* BT.601 limited range YCbCr to RGB in 8.8 fixed point.  The chroma
+ * terms are shared by the two pixels of a subsampled pair, so the
+ * row loops below only do the luma multiply per pixel and compile to
+ * straight-line integer code the compiler can vectorize. */
+
+static inline uint32_t
+clamp_u8(int32_t v)
+{
+	if (v & ~0xff)
+		return v < 0 ? 0 : 0xff;
+
+	return v;
+}
+
+static inline uint32_t
+yuv_pixel(int32_t y, int32_t r, int32_t g, int32_t b)
+{
+	y = (y - 16) * 298 + 128;
+
+	return 0xff000000 |
+		clamp_u8((y + r) >> 8) << 16 |
+		clamp_u8((y + g) >> 8) << 8 |
+		clamp_u8((y + b) >> 8);
+}
+
+static inline void
+yuv_chroma(int32_t u, int32_t v, int32_t *r, int32_t *g, int32_t *b)
+{
+	u -= 128;
+	v -= 128;
+	*r = 409 * v;
+	*g = -100 * u - 208 * v;
+	*b = 516 * u;
+}
+
+static void
+convert_yuyv_row(uint32_t *dst, const uint8_t *src, int width)
+{
+	int32_t r, g, b;
+	int i;
+
+	for (i = 0; i < width; i += 2, src += 4) {
+		yuv_chroma(src[1], src[3], &r, &g, &b);
+		dst[i] = yuv_pixel(src[0], r, g, b);
+		dst[i + 1] = yuv_pixel(src[2], r, g, b);
+	}
+}
+
+/* The box is aligned to the chroma subsampling by the caller. */
+static void
+convert_yuyv(pixman_image_t *image, struct wl_buffer *buffer,
+	     const pixman_box32_t *box)
+{
+	uint8_t *src = wl_shm_buffer_get_data(buffer);
+	int src_stride = wl_shm_buffer_get_stride(buffer);
+	uint32_t *dst = pixman_image_get_data(image);
+	int dst_stride = pixman_image_get_stride(image) / 4;
+	int y;
+
+	for (y = box->y1; y < box->y2; y++)
+		convert_yuyv_row(dst + y * dst_stride + box->x1,
+				 src + y * src_stride + box->x1 * 2,
+				 box->x2 - box->x1);
+}
+
 static void
 pixman_renderer_flush_damage(struct weston_surface *surface)
 {
-	/* No-op for pixman renderer */
+	struct pixman_surface_state *ps = get_surface_state(surface);
+	struct wl_buffer *buffer = ps->buffer_ref.buffer;
+	pixman_box32_t *rects, full, r;
+	int i, n;
+
+	if (!ps->convert || !buffer)
+		return;
+
+	full.x1 = 0;
+	full.y1 = 0;
+	full.x2 = buffer->width;
+	full.y2 = buffer->height;
+
+	if (ps->needs_full_convert) {
+		rects = &full;
+		n = 1;
+	} else {
+		rects = pixman_region32_rectangles(&surface->damage, &n);
+	}
+
+	for (i = 0; i < n; i++) {
+		if (ps->needs_full_convert)
+			r = full;
+		else
+			r = weston_surface_to_buffer_rect(surface, rects[i]);
+
+		/* Whole chroma samples only; the width is even, see
+		 * pixman_renderer_attach(). */
+		r.x1 = r.x1 < 0 ? 0 : r.x1 & ~1;
+		r.y1 = r.y1 < 0 ? 0 : r.y1;
+		r.x2 = r.x2 > full.x2 ? full.x2 : (r.x2 + 1) & ~1;
+		r.y2 = r.y2 > full.y2 ? full.y2 : r.y2;
+		if (r.x1 >= r.x2 || r.y1 >= r.y2)
+			continue;
+
+		ps->convert(ps->image, buffer, &r);
+		surface->stats.total.upload_bytes +=
+			(uint64_t) (r.x2 - r.x1) * (r.y2 - r.y1) * 4;
+	}
+
+	ps->needs_full_convert = 0;
+
+	/* The contents now live in ps->image, so the client can have
+	 * the buffer back before the repaint. */
+	weston_buffer_reference(&ps->buffer_ref, NULL);
 }
 
 static void
 pixman_renderer_attach(struct weston_surface *es, struct wl_buffer *buffer)
 {
 	struct pixman_surface_state *ps = get_surface_state(es);
-	pixman_format_code_t pixman_format;
+	pixman_format_code_t pixman_format = PIXMAN_x8r8g8b8;
+	convert_func_t convert = NULL;
+	int width, height, stride, bpp = 4;
 
 	weston_buffer_reference(&ps->buffer_ref, buffer);
 
+	if (buffer && !wl_buffer_is_shm(buffer)) {
+		weston_log("Pixman renderer supports only SHM buffers\n");
+		weston_buffer_reference(&ps->buffer_ref, NULL);
+		buffer = NULL;
+	}
+
+	if (buffer) {
+		width = wl_shm_buffer_get_width(buffer);
+		height = wl_shm_buffer_get_height(buffer);
+
+		switch (wl_shm_buffer_get_format(buffer)) {
+		case WL_SHM_FORMAT_XRGB8888:
+			pixman_format = PIXMAN_x8r8g8b8;
+			break;
+		case WL_SHM_FORMAT_ARGB8888:
+			pixman_format = PIXMAN_a8r8g8b8;
+			break;
+		case WL_SHM_FORMAT_XBGR8888:
+			pixman_format = PIXMAN_x8b8g8r8;
+			break;
+		case WL_SHM_FORMAT_ABGR8888:
+			pixman_format = PIXMAN_a8b8g8r8;
+			break;
+		case WL_SHM_FORMAT_RGB565:
+			pixman_format = PIXMAN_r5g6b5;
+			bpp = 2;
+			break;
+		case WL_SHM_FORMAT_YUYV:
+			convert = convert_yuyv;
+			bpp = 2;
+			break;
+		default:
+			weston_log("Unsupported SHM buffer format\n");
+			weston_buffer_reference(&ps->buffer_ref, NULL);
+			buffer = NULL;
+			break;
+		}
+	}
+
+	/* libwayland only checks that stride * height bytes fit in the
+	 * pool, so the rows must hold the width we are going to read.
+	 * pixman only wraps rows that are 32-bit aligned, and YUYV
+	 * pixels come in pairs. */
+	if (buffer) {
+		stride = wl_shm_buffer_get_stride(buffer);
+		if (stride < width * bpp ||
+		    (convert ? (width & 1) : (stride & 3))) {
+			weston_log("SHM buffer with width %d and stride %d "
+				   "is not supported\n", width, stride);
+			weston_buffer_reference(&ps->buffer_ref, NULL);
+			buffer = NULL;
+		}
+	}
+
+	/* Video clients cycle through buffers of the same size; keep
+	 * the converted image so only the damage has to be converted. */
+	if (buffer && convert && ps->convert == convert &&
+	    pixman_image_get_width(ps->image) == width &&
+	    pixman_image_get_height(ps->image) == height)
+		return;
+
 	if (ps->image) {
 		pixman_image_unref(ps->image);
 		ps->image = NULL;
 	}
+	ps->convert = NULL;
 
 	if (!buffer)
 		return;
 
-	if (!wl_buffer_is_shm(buffer)) {
-		weston_log("Pixman renderer supports only SHM buffers\n");
-		weston_buffer_reference(&ps->buffer_ref, NULL);
+	if (convert) {
+		ps->image = pixman_image_create_bits(PIXMAN_x8r8g8b8,
+						     width, height, NULL, 0);
+		if (!ps->image)
+			return;
+		ps->convert = convert;
+		ps->needs_full_convert = 1;
+		es->stats.total.texture_allocs++;
 		return;
 	}
 
-	switch (wl_shm_buffer_get_format(buffer)) {
-	case WL_SHM_FORMAT_XRGB8888:
-		pixman_format = PIXMAN_x8r8g8b8;
-		break;
-	case WL_SHM_FORMAT_ARGB8888:
-		pixman_format = PIXMAN_a8r8g8b8;
-		break;
-	default:
-		weston_log("Unsupported SHM buffer format\n");
-		weston_buffer_reference(&ps->buffer_ref, NULL);
-		return;
-	break;
-	}
 	ps->image = pixman_image_create_bits(pixman_format,
-		wl_shm_buffer_get_width(buffer),
-		wl_shm_buffer_get_height(buffer),
-		wl_shm_buffer_get_data(buffer),
-		wl_shm_buffer_get_stride(buffer));
+		width, height,
+		wl_shm_buffer_get_data(buffer), stride);
 }
 
 static int
@@ -431,6 +615,7 @@ pixman_renderer_surface_set_color(struct weston_surface *es,
 		pixman_image_unref(ps->image);
 		ps->image = NULL;
 	}
+	ps->convert = NULL;
 
 	ps->image = pixman_image_create_solid_fill(&color);
 }
@@ -495,38 +680,27 @@ pixman_renderer_init(struct weston_compositor *ec)
 	renderer->base.destroy = pixman_renderer_destroy;
 	ec->renderer = &renderer->base;
 
+#ifdef HAVE_WL_DISPLAY_ADD_SHM_FORMAT
+	wl_display_add_shm_format(ec->wl_display, WL_SHM_FORMAT_RGB565);
+	wl_display_add_shm_format(ec->wl_display, WL_SHM_FORMAT_XBGR8888);
+	wl_display_add_shm_format(ec->wl_display, WL_SHM_FORMAT_ABGR8888);
+	wl_display_add_shm_format(ec->wl_display, WL_SHM_FORMAT_YUYV);
+#endif
+
 	weston_compositor_add_debug_binding(ec, KEY_R,
 					    debug_binding, ec);
 	return 0;
 }
 
-WL_EXPORT void
-pixman_renderer_output_set_buffer(struct weston_output *output, pixman_image_t *buffer)
-{
-	struct pixman_output_state *po = get_output_state(output);
-
-	if (po->hw_buffer)
-		pixman_image_unref(po->hw_buffer);
-	po->hw_buffer = buffer;
-
-	if (po->hw_buffer) {
-		output->compositor->read_format = pixman_image_get_format(po->hw_buffer);
-		pixman_image_ref(po->hw_buffer);
-	}
-}
-
-WL_EXPORT int
-pixman_renderer_output_create(struct weston_output *output)
+static int
+output_create_shadow(struct weston_output *output,
+		     struct pixman_output_state *po)
 {
-	struct pixman_output_state *po = calloc(1, sizeof *po);
 	pixman_transform_t transform;
 	pixman_fixed_t fw, fh;
 	int w, h;
 	int rotated = 0;
 
-	if (!po)
-		return -1;
-
 	/* set shadow image transformation */
 	w = output->current->width;
 	h = output->current->height;
@@ -564,10 +738,8 @@ pixman_renderer_output_create(struct weston_output *output)
 
 	po->shadow_buffer = malloc(w * h * 4);
 
-	if (!po->shadow_buffer) {
-		free(po);
+	if (!po->shadow_buffer)
 		return -1;
-	}
 
 	po->shadow_image =
 		pixman_image_create_bits(PIXMAN_x8r8g8b8, w, h,
@@ -575,12 +747,86 @@ pixman_renderer_output_create(struct weston_output *output)
 
 	if (!po->shadow_image) {
 		free(po->shadow_buffer);
-		free(po);
+		po->shadow_buffer = NULL;
 		return -1;
 	}
 
 	pixman_image_set_transform(po->shadow_image, &transform);
 
+	return 0;
+}
+
+static int
+output_needs_shadow(struct weston_output *output,
+		    struct pixman_output_state *po)
+{
+	if (po->flags & PIXMAN_RENDERER_OUTPUT_USE_SHADOW)
+		return 1;
+
+	if (output->transform != WL_OUTPUT_TRANSFORM_NORMAL)
+		return 1;
+
+	switch (pixman_image_get_format(po->hw_buffer)) {
+	case PIXMAN_x8r8g8b8:
+	case PIXMAN_a8r8g8b8:
+		return 0;
+	default:
+		return 1;
+	}
+}
+
+WL_EXPORT void
+pixman_renderer_output_set_buffer(struct weston_output *output, pixman_image_t *buffer)
+{
+	struct pixman_output_state *po = get_output_state(output);
+
+	if (po->hw_buffer)
+		pixman_image_unref(po->hw_buffer);
+	po->hw_buffer = buffer;
+	po->target = NULL;
+
+	if (!po->hw_buffer)
+		return;
+
+	output->compositor->read_format = pixman_image_get_format(po->hw_buffer);
+	pixman_image_ref(po->hw_buffer);
+
+	if (!output_needs_shadow(output, po)) {
+		po->target = po->hw_buffer;
+		return;
+	}
+
+	if (!po->shadow_image && output_create_shadow(output, po) < 0) {
+		weston_log("failed to allocate pixman shadow buffer\n");
+		pixman_image_unref(po->hw_buffer);
+		po->hw_buffer = NULL;
+		return;
+	}
+
+	po->target = po->shadow_image;
+}
+
+WL_EXPORT int
+pixman_renderer_output_create(struct weston_output *output, uint32_t flags)
+{
+	struct pixman_output_state *po = calloc(1, sizeof *po);
+
+	if (!po)
+		return -1;
+
+	po->flags = flags;
+
+	/* Allocate the shadow up front when we already know we need it,
+	 * so a failure shows up here rather than at the first repaint.
+	 * Otherwise it is created by set_buffer if the hardware buffer
+	 * turns out to be in a format we don't draw into directly. */
+	if ((flags & PIXMAN_RENDERER_OUTPUT_USE_SHADOW ||
+	     output->transform != WL_OUTPUT_TRANSFORM_NORMAL) &&
+	    output_create_shadow(output, po) < 0) {
+		free(po);
+		return -1;
+	}
+
 	output->renderer_state = po;
 
 	return 0;
@@ -591,13 +837,17 @@ pixman_renderer_output_destroy(struct weston_output *output)
 {
 	struct pixman_output_state *po = get_output_state(output);
 
-	pixman_image_unref(po->shadow_image);
+	if (po->shadow_image) {
+		pixman_image_unref(po->shadow_image);
+		free(po->shadow_buffer);
+	}
 
 	if (po->hw_buffer)
 		pixman_image_unref(po->hw_buffer);
 
 	po->shadow_image = NULL;
 	po->hw_buffer = NULL;
+	po->target = NULL;
 
 	free(po);
 }
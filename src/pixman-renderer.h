@@ -25,8 +25,14 @@
 int
 pixman_renderer_init(struct weston_compositor *ec);
 
+/* Always composite into an intermediate x8r8g8b8 buffer and copy the
+ * damage to the hardware buffer, for backends whose buffers are slow to
+ * read back from.  Without it the shadow is only used for transformed
+ * outputs and hardware formats other than [ax]8r8g8b8. */
+#define PIXMAN_RENDERER_OUTPUT_USE_SHADOW	(1 << 0)
+
 int
-pixman_renderer_output_create(struct weston_output *output);
+pixman_renderer_output_create(struct weston_output *output, uint32_t flags);
 
 void
 pixman_renderer_output_set_buffer(struct weston_output *output, pixman_image_t *buffer);
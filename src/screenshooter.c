@@ -32,6 +32,7 @@
 #include "screenshooter-server-protocol.h"
 
 #include "../wcap/wcap-decode.h"
+#include "../shared/timespec-util.h"
 
 struct screenshooter {
 	struct wl_object base;
@@ -310,7 +311,7 @@ weston_recorder_frame_notify(struct wl_listener *listener, void *data)
 	struct weston_recorder *recorder =
 		container_of(listener, struct weston_recorder, frame_listener);
 	struct weston_output *output = data;
-	uint32_t msecs = output->frame_time;
+	uint32_t msecs = timespec_to_msec(&output->frame_time);
 	pixman_box32_t *r;
 	pixman_region32_t damage;
 	int i, j, k, n, width, height, run, stride;
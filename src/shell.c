@@ -38,6 +38,7 @@
 #include "input-method-server-protocol.h"
 #include "workspaces-server-protocol.h"
 #include "../shared/config-parser.h"
+#include "../shared/timespec-util.h"
 
 #define DEFAULT_NUM_WORKSPACES 1
 #define DEFAULT_WORKSPACE_CHANGE_ANIMATION_LENGTH 200
@@ -124,7 +125,7 @@ struct desktop_shell {
 		struct weston_animation animation;
 		struct wl_list anim_sticky_list;
 		int anim_dir;
-		uint32_t anim_timestamp;
+		struct timespec anim_timestamp;
 		double anim_current;
 		struct workspace *anim_from;
 		struct workspace *anim_to;
@@ -669,7 +670,7 @@ reverse_workspace_change_animation(struct desktop_shell *shell,
 	shell->workspaces.anim_to = to;
 	shell->workspaces.anim_from = from;
 	shell->workspaces.anim_dir = -1 * shell->workspaces.anim_dir;
-	shell->workspaces.anim_timestamp = 0;
+	shell->workspaces.anim_timestamp = (struct timespec) { 0 };
 
 	weston_compositor_schedule_repaint(shell->compositor);
 }
@@ -707,7 +708,8 @@ finish_workspace_change_animation(struct desktop_shell *shell,
 
 static void
 animate_workspace_change_frame(struct weston_animation *animation,
-			       struct weston_output *output, uint32_t msecs)
+			       struct weston_output *output,
+			       const struct timespec *time)
 {
 	struct desktop_shell *shell =
 		container_of(animation, struct desktop_shell,
@@ -722,19 +724,19 @@ animate_workspace_change_frame(struct weston_animation *animation,
 		return;
 	}
 
-	if (shell->workspaces.anim_timestamp == 0) {
+	if (timespec_is_zero(&shell->workspaces.anim_timestamp)) {
 		if (shell->workspaces.anim_current == 0.0)
-			shell->workspaces.anim_timestamp = msecs;
+			shell->workspaces.anim_timestamp = *time;
 		else
-			shell->workspaces.anim_timestamp =
-				msecs -
+			timespec_add_msec(&shell->workspaces.anim_timestamp,
+				time,
 				/* Invers of movement function 'y' below. */
-				(asin(1.0 - shell->workspaces.anim_current) *
-				 DEFAULT_WORKSPACE_CHANGE_ANIMATION_LENGTH *
-				 M_2_PI);
+				-(asin(1.0 - shell->workspaces.anim_current) *
+				  DEFAULT_WORKSPACE_CHANGE_ANIMATION_LENGTH *
+				  M_2_PI));
 	}
 
-	t = msecs - shell->workspaces.anim_timestamp;
+	t = timespec_sub_to_msec(time, &shell->workspaces.anim_timestamp);
 
 	/*
 	 * x = [0, π/2]
@@ -777,7 +779,7 @@ animate_workspace_change(struct desktop_shell *shell,
 	shell->workspaces.anim_from = from;
 	shell->workspaces.anim_to = to;
 	shell->workspaces.anim_current = 0.0;
-	shell->workspaces.anim_timestamp = 0;
+	shell->workspaces.anim_timestamp = (struct timespec) { 0 };
 
 	output = container_of(shell->compositor->output_list.next,
 			      struct weston_output, link);
@@ -0,0 +1,231 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <linux/input.h>
+#include <sys/types.h>
+
+#include "compositor.h"
+#include "surface-stats-server-protocol.h"
+#include "../shared/timespec-util.h"
+
+struct surface_stats {
+	struct weston_compositor *ec;
+	struct wl_global *global;
+	struct wl_listener destroy_listener;
+};
+
+WL_EXPORT uint64_t
+weston_region_area(pixman_region32_t *region)
+{
+	pixman_box32_t *rects;
+	uint64_t area = 0;
+	int i, n;
+
+	rects = pixman_region32_rectangles(region, &n);
+	for (i = 0; i < n; i++)
+		area += (uint64_t) (rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1);
+
+	return area;
+}
+
+static uint64_t
+stats_rate(uint64_t total, uint64_t start, int64_t elapsed)
+{
+	return (total - start) * NSEC_PER_SEC / elapsed;
+}
+
+/* Close the current accounting window if it is at least a second old,
+ * turning the counts accumulated in it into per second rates.
+ * Called on every commit and before reporting, so no timer is needed
+ * and idle surfaces decay to zero the next time they are looked at.
+ */
+WL_EXPORT void
+weston_surface_stats_update(struct weston_surface *surface,
+			    const struct timespec *now)
+{
+	struct weston_surface_stats *total = &surface->stats.total;
+	struct weston_surface_stats *window = &surface->stats.window;
+	struct weston_surface_stats *rate = &surface->stats.rate;
+	int64_t elapsed;
+
+	elapsed = timespec_sub_to_nsec(now, &surface->stats.window_start);
+	if (elapsed < NSEC_PER_SEC)
+		return;
+
+	rate->commits = stats_rate(total->commits, window->commits, elapsed);
+	rate->attaches =
+		stats_rate(total->attaches, window->attaches, elapsed);
+	rate->damage_pixels =
+		stats_rate(total->damage_pixels, window->damage_pixels,
+			   elapsed);
+	rate->upload_bytes =
+		stats_rate(total->upload_bytes, window->upload_bytes, elapsed);
+	rate->composited_pixels =
+		stats_rate(total->composited_pixels,
+			   window->composited_pixels, elapsed);
+	rate->texture_allocs =
+		stats_rate(total->texture_allocs, window->texture_allocs,
+			   elapsed);
+
+	*window = *total;
+	surface->stats.window_start = *now;
+}
+
+static pid_t
+surface_get_pid(struct weston_surface *surface)
+{
+	struct wl_client *client = surface->surface.resource.client;
+	pid_t pid;
+	uid_t uid;
+	gid_t gid;
+
+	if (!client)
+		return 0;
+
+	wl_client_get_credentials(client, &pid, &uid, &gid);
+
+	return pid;
+}
+
+static uint32_t
+clamp_rate(uint64_t value)
+{
+	return value > UINT32_MAX ? UINT32_MAX : value;
+}
+
+static void
+surface_stats_dump(struct wl_client *client, struct wl_resource *resource)
+{
+	struct surface_stats *stats = resource->data;
+	struct weston_surface *surface;
+	struct weston_surface_stats *rate;
+	struct timespec now;
+
+	weston_compositor_read_clock(&now);
+
+	wl_list_for_each(surface, &stats->ec->surface_list, link) {
+		weston_surface_stats_update(surface, &now);
+		rate = &surface->stats.rate;
+
+		surface_stats_send_surface(resource,
+					   surface_get_pid(surface),
+					   surface->geometry.width,
+					   surface->geometry.height,
+					   clamp_rate(surface->stats.total.commits),
+					   clamp_rate(rate->commits),
+					   clamp_rate(rate->attaches),
+					   clamp_rate(rate->damage_pixels),
+					   clamp_rate(rate->upload_bytes),
+					   clamp_rate(rate->composited_pixels));
+	}
+
+	surface_stats_send_done(resource);
+}
+
+struct surface_stats_interface surface_stats_implementation = {
+	surface_stats_dump
+};
+
+static void
+bind_surface_stats(struct wl_client *client,
+		   void *data, uint32_t version, uint32_t id)
+{
+	wl_client_add_object(client, &surface_stats_interface,
+			     &surface_stats_implementation, id, data);
+}
+
+static void
+surface_stats_binding(struct wl_seat *seat, uint32_t time, uint32_t key,
+		      void *data)
+{
+	struct surface_stats *stats = data;
+	struct weston_surface *surface;
+	struct weston_surface_stats *rate;
+	struct timespec now;
+
+	weston_compositor_read_clock(&now);
+
+	weston_log("surface statistics:\n");
+	wl_list_for_each(surface, &stats->ec->surface_list, link) {
+		weston_surface_stats_update(surface, &now);
+		rate = &surface->stats.rate;
+
+		weston_log_continue(STAMP_SPACE "pid %d, %dx%d: "
+				    "%llu commits (%llu/s), %llu attaches/s, "
+				    "%llu damaged px/s, %llu upload bytes/s, "
+				    "%llu composited px/s, "
+				    "%llu texture allocs/s (%llu total)\n",
+				    (int) surface_get_pid(surface),
+				    surface->geometry.width,
+				    surface->geometry.height,
+				    (unsigned long long)
+					surface->stats.total.commits,
+				    (unsigned long long) rate->commits,
+				    (unsigned long long) rate->attaches,
+				    (unsigned long long) rate->damage_pixels,
+				    (unsigned long long) rate->upload_bytes,
+				    (unsigned long long)
+					rate->composited_pixels,
+				    (unsigned long long) rate->texture_allocs,
+				    (unsigned long long)
+					surface->stats.total.texture_allocs);
+	}
+}
+
+static void
+surface_stats_destroy(struct wl_listener *listener, void *data)
+{
+	struct surface_stats *stats =
+		container_of(listener, struct surface_stats, destroy_listener);
+
+	if (stats->global)
+		wl_display_remove_global(stats->ec->wl_display, stats->global);
+	free(stats);
+}
+
+/* The log binding is always there; the protocol lets any client see
+ * every client's surfaces, so it is only offered when asked for. */
+void
+surface_stats_create(struct weston_compositor *ec, int add_global)
+{
+	struct surface_stats *stats;
+
+	stats = malloc(sizeof *stats);
+	if (stats == NULL)
+		return;
+
+	stats->ec = ec;
+	stats->global = NULL;
+	if (add_global)
+		stats->global =
+			wl_display_add_global(ec->wl_display,
+					      &surface_stats_interface,
+					      stats, bind_surface_stats);
+	weston_compositor_add_debug_binding(ec, KEY_P,
+					    surface_stats_binding, stats);
+
+	stats->destroy_listener.notify = surface_stats_destroy;
+	wl_signal_add(&ec->destroy_signal, &stats->destroy_listener);
+}
@@ -259,6 +259,18 @@ drm_led_update(struct weston_seat *seat_base, enum weston_led leds)
 		evdev_led_update(device, leds);
 }
 
+static void
+input_stats_binding(struct wl_seat *wl_seat, uint32_t time, uint32_t key,
+		    void *data)
+{
+	struct udev_seat *seat = data;
+	struct evdev_device *device;
+
+	weston_log("input statistics for %s:\n", seat->seat_id);
+	wl_list_for_each(device, &seat->devices_list, link)
+		evdev_device_log_stats(device);
+}
+
 struct udev_seat *
 udev_seat_create(struct weston_compositor *c, struct udev *udev,
 		const char *seat_id)
@@ -278,6 +290,10 @@ udev_seat_create(struct weston_compositor *c, struct udev *udev,
 	if (udev_seat_enable(seat, udev) < 0)
 		goto err;
 
+	seat->stats_binding =
+		weston_compositor_add_debug_binding(c, KEY_I,
+						    input_stats_binding, seat);
+
 	return seat;
 
  err:
@@ -291,6 +307,8 @@ udev_seat_destroy(struct udev_seat *seat)
 {
 	udev_seat_disable(seat);
 
+	if (seat->stats_binding)
+		weston_binding_destroy(seat->stats_binding);
 	weston_seat_release(&seat->base);
 	free(seat->seat_id);
 	free(seat);
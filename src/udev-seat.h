@@ -33,6 +33,7 @@ struct udev_seat {
 	struct udev_monitor *udev_monitor;
 	struct wl_event_source *udev_monitor_source;
 	char *seat_id;
+	struct weston_binding *stats_binding;
 };
 
 int udev_seat_enable(struct udev_seat *seat, struct udev *udev);
@@ -0,0 +1,594 @@
+/*
+ * Copyright © 2012 Collabora, Ltd.
+ * Copyright © 2012 Rob Clark
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <float.h>
+#include <math.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#include "vertex-clipping.h"
+
+struct clip_context {
+	struct {
+		float x;
+		float y;
+	} prev;
+
+	struct {
+		float x1, y1;
+		float x2, y2;
+	} clip;
+
+	struct {
+		float *x;
+		float *y;
+	} vertices;
+};
+
+float
+float_difference(float a, float b)
+{
+	/* http://www.altdevblogaday.com/2012/02/22/comparing-floating-point-numbers-2012-edition/ */
+	static const float max_diff = 4.0f * FLT_MIN;
+	static const float max_rel_diff = 4.0e-5;
+	float diff = a - b;
+	float adiff = fabsf(diff);
+
+	if (adiff <= max_diff)
+		return 0.0f;
+
+	a = fabsf(a);
+	b = fabsf(b);
+	if (adiff <= (a > b ? a : b) * max_rel_diff)
+		return 0.0f;
+
+	return diff;
+}
+
+/* A line segment (p1x, p1y)-(p2x, p2y) intersects the line x = x_arg.
+ * Compute the y coordinate of the intersection.
+ */
+static float
+clip_intersect_y(float p1x, float p1y, float p2x, float p2y,
+		 float x_arg)
+{
+	float a;
+	float diff = float_difference(p1x, p2x);
+
+	/* Practically vertical line segment, yet the end points have already
+	 * been determined to be on different sides of the line. Therefore
+	 * the line segment is part of the line and intersects everywhere.
+	 * Return the end point, so we use the whole line segment.
+	 */
+	if (diff == 0.0f)
+		return p2y;
+
+	a = (x_arg - p2x) / diff;
+	return p2y + (p1y - p2y) * a;
+}
+
+/* A line segment (p1x, p1y)-(p2x, p2y) intersects the line y = y_arg.
+ * Compute the x coordinate of the intersection.
+ */
+static float
+clip_intersect_x(float p1x, float p1y, float p2x, float p2y,
+		 float y_arg)
+{
+	float a;
+	float diff = float_difference(p1y, p2y);
+
+	/* Practically horizontal line segment, yet the end points have already
+	 * been determined to be on different sides of the line. Therefore
+	 * the line segment is part of the line and intersects everywhere.
+	 * Return the end point, so we use the whole line segment.
+	 */
+	if (diff == 0.0f)
+		return p2x;
+
+	a = (y_arg - p2y) / diff;
+	return p2x + (p1x - p2x) * a;
+}
+
+enum path_transition {
+	PATH_TRANSITION_OUT_TO_OUT = 0,
+	PATH_TRANSITION_OUT_TO_IN = 1,
+	PATH_TRANSITION_IN_TO_OUT = 2,
+	PATH_TRANSITION_IN_TO_IN = 3,
+};
+
+static void
+clip_append_vertex(struct clip_context *ctx, float x, float y)
+{
+	*ctx->vertices.x++ = x;
+	*ctx->vertices.y++ = y;
+}
+
+static enum path_transition
+path_transition_left_edge(struct clip_context *ctx, float x, float y)
+{
+	return ((ctx->prev.x >= ctx->clip.x1) << 1) | (x >= ctx->clip.x1);
+}
+
+static enum path_transition
+path_transition_right_edge(struct clip_context *ctx, float x, float y)
+{
+	return ((ctx->prev.x < ctx->clip.x2) << 1) | (x < ctx->clip.x2);
+}
+
+static enum path_transition
+path_transition_top_edge(struct clip_context *ctx, float x, float y)
+{
+	return ((ctx->prev.y >= ctx->clip.y1) << 1) | (y >= ctx->clip.y1);
+}
+
+static enum path_transition
+path_transition_bottom_edge(struct clip_context *ctx, float x, float y)
+{
+	return ((ctx->prev.y < ctx->clip.y2) << 1) | (y < ctx->clip.y2);
+}
+
+static void
+clip_polygon_leftright(struct clip_context *ctx,
+		       enum path_transition transition,
+		       float x, float y, float clip_x)
+{
+	float yi;
+
+	switch (transition) {
+	case PATH_TRANSITION_IN_TO_IN:
+		clip_append_vertex(ctx, x, y);
+		break;
+	case PATH_TRANSITION_IN_TO_OUT:
+		yi = clip_intersect_y(ctx->prev.x, ctx->prev.y, x, y, clip_x);
+		clip_append_vertex(ctx, clip_x, yi);
+		break;
+	case PATH_TRANSITION_OUT_TO_IN:
+		yi = clip_intersect_y(ctx->prev.x, ctx->prev.y, x, y, clip_x);
+		clip_append_vertex(ctx, clip_x, yi);
+		clip_append_vertex(ctx, x, y);
+		break;
+	case PATH_TRANSITION_OUT_TO_OUT:
+		/* nothing */
+		break;
+	default:
+		assert(0 && "bad enum path_transition");
+	}
+
+	ctx->prev.x = x;
+	ctx->prev.y = y;
+}
+
+static void
+clip_polygon_topbottom(struct clip_context *ctx,
+		       enum path_transition transition,
+		       float x, float y, float clip_y)
+{
+	float xi;
+
+	switch (transition) {
+	case PATH_TRANSITION_IN_TO_IN:
+		clip_append_vertex(ctx, x, y);
+		break;
+	case PATH_TRANSITION_IN_TO_OUT:
+		xi = clip_intersect_x(ctx->prev.x, ctx->prev.y, x, y, clip_y);
+		clip_append_vertex(ctx, xi, clip_y);
+		break;
+	case PATH_TRANSITION_OUT_TO_IN:
+		xi = clip_intersect_x(ctx->prev.x, ctx->prev.y, x, y, clip_y);
+		clip_append_vertex(ctx, xi, clip_y);
+		clip_append_vertex(ctx, x, y);
+		break;
+	case PATH_TRANSITION_OUT_TO_OUT:
+		/* nothing */
+		break;
+	default:
+		assert(0 && "bad enum path_transition");
+	}
+
+	ctx->prev.x = x;
+	ctx->prev.y = y;
+}
+
+static void
+clip_context_prepare(struct clip_context *ctx, const struct polygon8 *src,
+		      float *dst_x, float *dst_y)
+{
+	ctx->prev.x = src->x[src->n - 1];
+	ctx->prev.y = src->y[src->n - 1];
+	ctx->vertices.x = dst_x;
+	ctx->vertices.y = dst_y;
+}
+
+static int
+clip_polygon_left(struct clip_context *ctx, const struct polygon8 *src,
+		  float *dst_x, float *dst_y)
+{
+	enum path_transition trans;
+	int i;
+
+	clip_context_prepare(ctx, src, dst_x, dst_y);
+	for (i = 0; i < src->n; i++) {
+		trans = path_transition_left_edge(ctx, src->x[i], src->y[i]);
+		clip_polygon_leftright(ctx, trans, src->x[i], src->y[i],
+				       ctx->clip.x1);
+	}
+	return ctx->vertices.x - dst_x;
+}
+
+static int
+clip_polygon_right(struct clip_context *ctx, const struct polygon8 *src,
+		   float *dst_x, float *dst_y)
+{
+	enum path_transition trans;
+	int i;
+
+	clip_context_prepare(ctx, src, dst_x, dst_y);
+	for (i = 0; i < src->n; i++) {
+		trans = path_transition_right_edge(ctx, src->x[i], src->y[i]);
+		clip_polygon_leftright(ctx, trans, src->x[i], src->y[i],
+				       ctx->clip.x2);
+	}
+	return ctx->vertices.x - dst_x;
+}
+
+static int
+clip_polygon_top(struct clip_context *ctx, const struct polygon8 *src,
+		 float *dst_x, float *dst_y)
+{
+	enum path_transition trans;
+	int i;
+
+	clip_context_prepare(ctx, src, dst_x, dst_y);
+	for (i = 0; i < src->n; i++) {
+		trans = path_transition_top_edge(ctx, src->x[i], src->y[i]);
+		clip_polygon_topbottom(ctx, trans, src->x[i], src->y[i],
+				       ctx->clip.y1);
+	}
+	return ctx->vertices.x - dst_x;
+}
+
+static int
+clip_polygon_bottom(struct clip_context *ctx, const struct polygon8 *src,
+		    float *dst_x, float *dst_y)
+{
+	enum path_transition trans;
+	int i;
+
+	clip_context_prepare(ctx, src, dst_x, dst_y);
+	for (i = 0; i < src->n; i++) {
+		trans = path_transition_bottom_edge(ctx, src->x[i], src->y[i]);
+		clip_polygon_topbottom(ctx, trans, src->x[i], src->y[i],
+				       ctx->clip.y2);
+	}
+	return ctx->vertices.x - dst_x;
+}
+
+#define max(a, b) (((a) > (b)) ? (a) : (b))
+#define min(a, b) (((a) > (b)) ? (b) : (a))
+#define clip(x, a, b)  min(max(x, a), b)
+
+/* What the batch clipper needs to know about a quad, computed once. */
+struct quad_setup {
+	float min_x, max_x, min_y, max_y;
+
+	/* A point is inside the quad if a[i] * x + b[i] * y + c[i] >= 0
+	 * for all four edges.  A box is inside if its corner nearest to
+	 * the outside of each edge is, which is the corner picking x2
+	 * over x1 where use_x2[i] and likewise for y. */
+	float a[4], b[4], c[4];
+	int use_x2[4], use_y2[4];
+	int degenerate;
+};
+
+static void
+quad_setup_bounds(struct quad_setup *qs, const struct polygon8 *quad)
+{
+	int i;
+
+	qs->min_x = qs->max_x = quad->x[0];
+	qs->min_y = qs->max_y = quad->y[0];
+
+	for (i = 1; i < quad->n; i++) {
+		qs->min_x = min(qs->min_x, quad->x[i]);
+		qs->max_x = max(qs->max_x, quad->x[i]);
+		qs->min_y = min(qs->min_y, quad->y[i]);
+		qs->max_y = max(qs->max_y, quad->y[i]);
+	}
+}
+
+static void
+quad_setup_edges(struct quad_setup *qs, const struct polygon8 *quad)
+{
+	float area = 0.0f, sign, dx, dy;
+	int i, j;
+
+	for (i = 0; i < 4; i++) {
+		j = (i + 1) & 3;
+		area += quad->x[i] * quad->y[j] - quad->x[j] * quad->y[i];
+	}
+
+	/* Either winding is fine, transforms can flip it. */
+	qs->degenerate = float_difference(area, 0.0f) == 0.0f;
+	sign = area > 0.0f ? 1.0f : -1.0f;
+
+	for (i = 0; i < 4; i++) {
+		j = (i + 1) & 3;
+		dx = quad->x[j] - quad->x[i];
+		dy = quad->y[j] - quad->y[i];
+		qs->a[i] = -dy * sign;
+		qs->b[i] = dx * sign;
+		qs->c[i] = (dy * quad->x[i] - dx * quad->y[i]) * sign;
+		qs->use_x2[i] = qs->a[i] < 0.0f;
+		qs->use_y2[i] = qs->b[i] < 0.0f;
+	}
+}
+
+static int
+box_outside_bounds(const struct quad_setup *qs, const pixman_box32_t *box)
+{
+	return qs->min_x >= box->x2 || qs->max_x <= box->x1 ||
+		qs->min_y >= box->y2 || qs->max_y <= box->y1;
+}
+
+static int
+clip_simple(const struct polygon8 *quad, const pixman_box32_t *box,
+	    float *ex, float *ey)
+{
+	int i;
+
+	for (i = 0; i < quad->n; i++) {
+		ex[i] = clip(quad->x[i], box->x1, box->x2);
+		ey[i] = clip(quad->y[i], box->y1, box->y2);
+	}
+
+	return quad->n;
+}
+
+static int
+clip_transformed(const struct polygon8 *quad, const pixman_box32_t *box,
+		 float *ex, float *ey)
+{
+	struct polygon8 polygon, surf;
+	struct clip_context ctx;
+	int i, n;
+
+	ctx.clip.x1 = box->x1;
+	ctx.clip.y1 = box->y1;
+	ctx.clip.x2 = box->x2;
+	ctx.clip.y2 = box->y2;
+
+	/* Use a general polygon clipping algorithm to clip the quad with
+	 * each side of 'box'.  The algorithm is Sutherland-Hodgman, as
+	 * explained in
+	 * http://www.codeguru.com/cpp/misc/misc/graphics/article.php/c8965/Polygon-Clipping.htm
+	 * but without looking at any of that code.
+	 */
+	polygon.n = clip_polygon_left(&ctx, quad, polygon.x, polygon.y);
+	surf.n = clip_polygon_right(&ctx, &polygon, surf.x, surf.y);
+	polygon.n = clip_polygon_top(&ctx, &surf, polygon.x, polygon.y);
+	surf.n = clip_polygon_bottom(&ctx, &polygon, surf.x, surf.y);
+
+	if (surf.n == 0)
+		return 0;
+
+	/* Get rid of duplicate vertices */
+	ex[0] = surf.x[0];
+	ey[0] = surf.y[0];
+	n = 1;
+	for (i = 1; i < surf.n; i++) {
+		if (float_difference(ex[n - 1], surf.x[i]) == 0.0f &&
+		    float_difference(ey[n - 1], surf.y[i]) == 0.0f)
+			continue;
+		ex[n] = surf.x[i];
+		ey[n] = surf.y[i];
+		n++;
+	}
+	if (float_difference(ex[n - 1], surf.x[0]) == 0.0f &&
+	    float_difference(ey[n - 1], surf.y[0]) == 0.0f)
+		n--;
+
+	if (n < 3)
+		return 0;
+
+	return n;
+}
+
+int
+clip_quad(const struct polygon8 *quad, int transformed,
+	  const pixman_box32_t *box, float *ex, float *ey)
+{
+	struct quad_setup qs;
+
+	/* First, simple bounding box check to discard early transformed
+	 * surface rects that do not intersect with the clip region:
+	 */
+	quad_setup_bounds(&qs, quad);
+	if (box_outside_bounds(&qs, box))
+		return 0;
+
+	/* Simple case, bounding box edges are parallel to surface edges,
+	 * there will be only four edges.  We just need to clip the surface
+	 * vertices to the clip rect bounds:
+	 */
+	if (!transformed)
+		return clip_simple(quad, box, ex, ey);
+
+	return clip_transformed(quad, box, ex, ey);
+}
+
+#ifdef __SSE2__
+
+/* The same tests as above, four lanes at a time.  pixman_box32_t is
+ * four consecutive int32_t, x1 y1 x2 y2, so a box is one load. */
+
+static inline __m128
+box_load(const pixman_box32_t *box)
+{
+	return _mm_cvtepi32_ps(_mm_loadu_si128((const __m128i *) box));
+}
+
+int
+clip_quad_boxes(const struct polygon8 *quad, int transformed,
+		const pixman_box32_t *boxes, int nboxes,
+		float *ex, float *ey, int *counts)
+{
+	struct quad_setup qs;
+	__m128 bounds, flip, b, x, y, e;
+	__m128 qx, qy, a, bb, c, sel_x2, sel_y2;
+	int i, n, npolygons = 0;
+
+	quad_setup_bounds(&qs, quad);
+	if (transformed)
+		quad_setup_edges(&qs, quad);
+	if (transformed && qs.degenerate)
+		return 0;
+
+	/* box (x1, y1, -x2, -y2) >= (max_x, max_y, -min_x, -min_y) in
+	 * any lane means no overlap. */
+	bounds = _mm_setr_ps(qs.max_x, qs.max_y, -qs.min_x, -qs.min_y);
+	flip = _mm_setr_ps(1.0f, 1.0f, -1.0f, -1.0f);
+
+	/* One lane per edge for the inside test. */
+	qx = _mm_loadu_ps(quad->x);
+	qy = _mm_loadu_ps(quad->y);
+	a = _mm_loadu_ps(qs.a);
+	bb = _mm_loadu_ps(qs.b);
+	c = _mm_loadu_ps(qs.c);
+	sel_x2 = _mm_cmplt_ps(a, _mm_setzero_ps());
+	sel_y2 = _mm_cmplt_ps(bb, _mm_setzero_ps());
+
+	for (i = 0; i < nboxes; i++) {
+		b = box_load(&boxes[i]);
+		if (_mm_movemask_ps(_mm_cmpge_ps(_mm_mul_ps(b, flip), bounds)))
+			continue;
+
+		if (!transformed) {
+			/* quad->n is 4 */
+			x = _mm_shuffle_ps(b, b, _MM_SHUFFLE(0, 0, 0, 0));
+			y = _mm_shuffle_ps(b, b, _MM_SHUFFLE(1, 1, 1, 1));
+			e = _mm_max_ps(qx, x);
+			y = _mm_max_ps(qy, y);
+			x = _mm_shuffle_ps(b, b, _MM_SHUFFLE(2, 2, 2, 2));
+			_mm_storeu_ps(ex, _mm_min_ps(e, x));
+			x = _mm_shuffle_ps(b, b, _MM_SHUFFLE(3, 3, 3, 3));
+			_mm_storeu_ps(ey, _mm_min_ps(y, x));
+			n = 4;
+			goto emit;
+		}
+
+		x = _mm_or_ps(_mm_and_ps(sel_x2, _mm_shuffle_ps(b, b,
+						_MM_SHUFFLE(2, 2, 2, 2))),
+			      _mm_andnot_ps(sel_x2, _mm_shuffle_ps(b, b,
+						_MM_SHUFFLE(0, 0, 0, 0))));
+		y = _mm_or_ps(_mm_and_ps(sel_y2, _mm_shuffle_ps(b, b,
+						_MM_SHUFFLE(3, 3, 3, 3))),
+			      _mm_andnot_ps(sel_y2, _mm_shuffle_ps(b, b,
+						_MM_SHUFFLE(1, 1, 1, 1))));
+		e = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a, x), _mm_mul_ps(bb, y)),
+			       c);
+
+		if (_mm_movemask_ps(_mm_cmplt_ps(e, _mm_setzero_ps())) == 0) {
+			/* Corners in clockwise order: (x1, x2, x2, x1),
+			 * (y1, y1, y2, y2). */
+			_mm_storeu_ps(ex, _mm_shuffle_ps(b, b,
+						_MM_SHUFFLE(0, 2, 2, 0)));
+			_mm_storeu_ps(ey, _mm_shuffle_ps(b, b,
+						_MM_SHUFFLE(3, 3, 1, 1)));
+			n = 4;
+		} else {
+			n = clip_transformed(quad, &boxes[i], ex, ey);
+			if (n == 0)
+				continue;
+		}
+
+	emit:
+		counts[npolygons++] = n;
+		ex += n;
+		ey += n;
+	}
+
+	return npolygons;
+}
+
+#else
+
+static int
+box_inside_quad(const struct quad_setup *qs, const pixman_box32_t *box)
+{
+	float x, y;
+	int k;
+
+	for (k = 0; k < 4; k++) {
+		x = qs->use_x2[k] ? box->x2 : box->x1;
+		y = qs->use_y2[k] ? box->y2 : box->y1;
+		if (qs->a[k] * x + qs->b[k] * y + qs->c[k] < 0.0f)
+			return 0;
+	}
+
+	return 1;
+}
+
+int
+clip_quad_boxes(const struct polygon8 *quad, int transformed,
+		const pixman_box32_t *boxes, int nboxes,
+		float *ex, float *ey, int *counts)
+{
+	struct quad_setup qs;
+	int i, n, npolygons = 0;
+
+	quad_setup_bounds(&qs, quad);
+	if (transformed)
+		quad_setup_edges(&qs, quad);
+	if (transformed && qs.degenerate)
+		return 0;
+
+	for (i = 0; i < nboxes; i++) {
+		if (box_outside_bounds(&qs, &boxes[i]))
+			continue;
+
+		if (!transformed) {
+			n = clip_simple(quad, &boxes[i], ex, ey);
+		} else if (box_inside_quad(&qs, &boxes[i])) {
+			ex[0] = ex[3] = boxes[i].x1;
+			ex[1] = ex[2] = boxes[i].x2;
+			ey[0] = ey[1] = boxes[i].y1;
+			ey[2] = ey[3] = boxes[i].y2;
+			n = 4;
+		} else {
+			n = clip_transformed(quad, &boxes[i], ex, ey);
+			if (n == 0)
+				continue;
+		}
+
+		counts[npolygons++] = n;
+		ex += n;
+		ey += n;
+	}
+
+	return npolygons;
+}
+
+#endif
@@ -0,0 +1,70 @@
+/*
+ * Copyright © 2012 Collabora, Ltd.
+ * Copyright © 2012 Rob Clark
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#ifndef _WESTON_VERTEX_CLIPPING_H_
+#define _WESTON_VERTEX_CLIPPING_H_
+
+#include <pixman.h>
+
+/* A convex polygon of at most eight vertices, which is what clipping a
+ * quadrilateral against a rectangle can produce. */
+struct polygon8 {
+	float x[8];
+	float y[8];
+	int n;
+};
+
+float
+float_difference(float a, float b);
+
+/*
+ * Compute the boundary vertices of the intersection of the axis aligned
+ * rectangle 'box' and the quadrilateral 'quad' (a surface rectangle
+ * already transformed into global coordinates; 'transformed' is zero if
+ * its edges are axis aligned).  The vertices are written to 'ex' and
+ * 'ey', and the return value is the number of vertices.  Vertices are
+ * produced in clockwise winding order.  Guarantees to produce either
+ * zero vertices, or 3-8 vertices with non-zero polygon area.
+ */
+int
+clip_quad(const struct polygon8 *quad, int transformed,
+	  const pixman_box32_t *box, float *ex, float *ey);
+
+/*
+ * Clip one quad against many boxes, as clip_quad() would for each of
+ * them, sharing the per quad setup and testing the boxes with SIMD
+ * where available.  Boxes lying entirely inside the quad come out as
+ * themselves without running the general clipper, which is the common
+ * case for fragmented damage on a transformed surface; such a polygon
+ * may start from a different vertex than clip_quad() would give.
+ *
+ * The non-empty polygons are packed into 'ex' and 'ey', which must
+ * have room for 8 * nboxes vertices, and their vertex counts into
+ * 'counts'.  Returns the number of polygons.
+ */
+int
+clip_quad_boxes(const struct polygon8 *quad, int transformed,
+		const pixman_box32_t *boxes, int nboxes,
+		float *ex, float *ey, int *counts);
+
+#endif
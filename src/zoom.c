@@ -110,12 +110,12 @@ weston_text_cursor_position_notify(struct weston_surface *surface,
 
 static void
 weston_zoom_frame_z(struct weston_animation *animation,
-		struct weston_output *output, uint32_t msecs)
+		struct weston_output *output, const struct timespec *time)
 {
 	if (animation->frame_counter <= 1)
-		output->zoom.spring_z.timestamp = msecs;
+		output->zoom.spring_z.timestamp = *time;
 
-	weston_spring_update(&output->zoom.spring_z, msecs);
+	weston_spring_update(&output->zoom.spring_z, time);
 
 	if (output->zoom.spring_z.current > output->zoom.max_level)
 		output->zoom.spring_z.current = output->zoom.max_level;
@@ -146,15 +146,15 @@ weston_zoom_pick_seat(struct weston_compositor *compositor)
 
 static void
 weston_zoom_frame_xy(struct weston_animation *animation,
-		struct weston_output *output, uint32_t msecs)
+		struct weston_output *output, const struct timespec *time)
 {
 	struct weston_seat *seat = weston_zoom_pick_seat(output->compositor);
 	wl_fixed_t x, y;
 
 	if (animation->frame_counter <= 1)
-		output->zoom.spring_xy.timestamp = msecs;
+		output->zoom.spring_xy.timestamp = *time;
 
-	weston_spring_update(&output->zoom.spring_xy, msecs);
+	weston_spring_update(&output->zoom.spring_xy, time);
 
 	x = output->zoom.from.x - ((output->zoom.from.x - output->zoom.to.x) *
 						output->zoom.spring_xy.current);
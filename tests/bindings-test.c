@@ -0,0 +1,377 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <assert.h>
+#include <string.h>
+#include <linux/input.h>
+
+#include "weston-test-runner.h"
+#include "compositor.h"
+
+#define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
+
+/* Just enough of a compositor and a seat for src/bindings.c. */
+static struct weston_compositor compositor;
+static struct weston_seat seat;
+static struct weston_keyboard keyboard;
+static struct wl_keyboard_grab grab;
+
+/* Which handlers ran, by the number they were added with. */
+static int ran[32];
+static int nran;
+
+static struct weston_binding *bindings[32];
+
+struct action {
+	int id;
+	int add;		/* id of a binding to add, or -1 */
+	int destroy;		/* id of a binding to destroy, or -1 */
+	uint32_t key, modifier;
+};
+
+static struct action actions[32];
+
+static void
+setup(void)
+{
+	memset(&compositor, 0, sizeof compositor);
+	wl_list_init(&compositor.key_binding_list);
+	wl_list_init(&compositor.button_binding_list);
+	wl_list_init(&compositor.axis_binding_list);
+	wl_list_init(&compositor.debug_binding_list);
+	weston_binding_index_init(&compositor.key_binding_index);
+	weston_binding_index_init(&compositor.button_binding_index);
+	weston_binding_index_init(&compositor.axis_binding_index);
+	weston_binding_index_init(&compositor.debug_binding_index);
+
+	/* Pretend a grab is active, so running a key binding doesn't
+	 * install its own. */
+	memset(&seat, 0, sizeof seat);
+	memset(&keyboard, 0, sizeof keyboard);
+	seat.seat.keyboard = &keyboard.keyboard;
+	keyboard.keyboard.grab = &grab;
+
+	memset(bindings, 0, sizeof bindings);
+	nran = 0;
+}
+
+static void
+teardown(void)
+{
+	weston_binding_list_destroy_all(&compositor.key_binding_list);
+	weston_binding_list_destroy_all(&compositor.button_binding_list);
+	weston_binding_list_destroy_all(&compositor.axis_binding_list);
+	weston_binding_list_destroy_all(&compositor.debug_binding_list);
+	weston_binding_index_release(&compositor.key_binding_index);
+	weston_binding_index_release(&compositor.button_binding_index);
+	weston_binding_index_release(&compositor.axis_binding_index);
+	weston_binding_index_release(&compositor.debug_binding_index);
+}
+
+static void
+add_key(int id, uint32_t key, uint32_t modifier);
+
+static void
+key_handler(struct wl_seat *s, uint32_t time, uint32_t key, void *data)
+{
+	struct action *action = data;
+
+	assert(nran < (int) ARRAY_LENGTH(ran));
+	ran[nran++] = action->id;
+
+	if (action->destroy >= 0) {
+		weston_binding_destroy(bindings[action->destroy]);
+		bindings[action->destroy] = NULL;
+	}
+	if (action->add >= 0)
+		add_key(action->add, action->key, action->modifier);
+}
+
+static void
+button_handler(struct wl_seat *s, uint32_t time, uint32_t button,
+	       void *data)
+{
+	key_handler(s, time, button, data);
+}
+
+static void
+axis_handler(struct wl_seat *s, uint32_t time, uint32_t axis,
+	     wl_fixed_t value, void *data)
+{
+	key_handler(s, time, axis, data);
+}
+
+static struct action *
+action(int id)
+{
+	actions[id].id = id;
+	actions[id].add = -1;
+	actions[id].destroy = -1;
+
+	return &actions[id];
+}
+
+static void
+add_key(int id, uint32_t key, uint32_t modifier)
+{
+	bindings[id] = weston_compositor_add_key_binding(&compositor,
+							 key, modifier,
+							 key_handler,
+							 action(id));
+	assert(bindings[id]);
+}
+
+static void
+press_key(uint32_t key, uint32_t modifier)
+{
+	nran = 0;
+	seat.modifier_state = modifier;
+	weston_compositor_run_key_binding(&compositor, &seat, 0, key,
+					  WL_KEYBOARD_KEY_STATE_PRESSED);
+}
+
+static void
+check_ran(const int *expected, int n)
+{
+	int i;
+
+	assert(nran == n);
+	for (i = 0; i < n; i++)
+		assert(ran[i] == expected[i]);
+}
+
+#define CHECK_RAN(...) do {						\
+	static const int expected[] = { __VA_ARGS__ };			\
+	check_ran(expected, ARRAY_LENGTH(expected));			\
+} while (0)
+
+TEST(bindings_exact_modifiers)
+{
+	setup();
+
+	/* Overlapping modifier masks only match exactly, and bindings
+	 * with equal keys run in the order they were added, whatever
+	 * was added in between. */
+	add_key(0, KEY_A, MODIFIER_CTRL | MODIFIER_ALT);
+	add_key(1, KEY_A, MODIFIER_CTRL);
+	add_key(2, KEY_B, MODIFIER_CTRL);
+	add_key(3, KEY_A, 0);
+	add_key(4, KEY_A, MODIFIER_ALT);
+	add_key(5, KEY_A, MODIFIER_CTRL);
+	add_key(6, KEY_A, MODIFIER_CTRL | MODIFIER_ALT | MODIFIER_SHIFT);
+
+	press_key(KEY_A, MODIFIER_CTRL);
+	CHECK_RAN(1, 5);
+
+	press_key(KEY_A, MODIFIER_CTRL | MODIFIER_ALT);
+	CHECK_RAN(0);
+
+	press_key(KEY_A, 0);
+	CHECK_RAN(3);
+
+	press_key(KEY_A, MODIFIER_SHIFT);
+	assert(nran == 0);
+
+	press_key(KEY_B, MODIFIER_CTRL);
+	CHECK_RAN(2);
+
+	press_key(KEY_C, MODIFIER_CTRL);
+	assert(nran == 0);
+
+	/* Releases don't run bindings. */
+	seat.modifier_state = MODIFIER_CTRL;
+	weston_compositor_run_key_binding(&compositor, &seat, 0, KEY_A,
+					  WL_KEYBOARD_KEY_STATE_RELEASED);
+	assert(nran == 0);
+
+	teardown();
+}
+
+TEST(bindings_destroyed)
+{
+	setup();
+
+	add_key(0, KEY_A, MODIFIER_CTRL);
+	add_key(1, KEY_A, MODIFIER_CTRL);
+	add_key(2, KEY_A, MODIFIER_CTRL);
+
+	weston_binding_destroy(bindings[1]);
+	bindings[1] = NULL;
+
+	press_key(KEY_A, MODIFIER_CTRL);
+	CHECK_RAN(0, 2);
+
+	teardown();
+}
+
+TEST(bindings_destroyed_during_dispatch)
+{
+	setup();
+
+	add_key(0, KEY_A, MODIFIER_CTRL);
+	add_key(1, KEY_A, MODIFIER_CTRL);
+	add_key(2, KEY_A, MODIFIER_CTRL);
+
+	/* Binding 0 destroys binding 1, which is later in the same
+	 * run.  Dispatch stops there rather than reading it. */
+	actions[0].destroy = 1;
+
+	press_key(KEY_A, MODIFIER_CTRL);
+	CHECK_RAN(0);
+
+	actions[0].destroy = -1;
+	press_key(KEY_A, MODIFIER_CTRL);
+	CHECK_RAN(0, 2);
+
+	teardown();
+}
+
+TEST(bindings_destroy_self_during_dispatch)
+{
+	setup();
+
+	add_key(0, KEY_A, 0);
+	add_key(1, KEY_A, 0);
+	actions[0].destroy = 0;
+
+	press_key(KEY_A, 0);
+	CHECK_RAN(0);
+
+	press_key(KEY_A, 0);
+	CHECK_RAN(1);
+
+	teardown();
+}
+
+TEST(bindings_added_during_dispatch)
+{
+	setup();
+
+	add_key(0, KEY_A, MODIFIER_ALT);
+	add_key(1, KEY_A, MODIFIER_ALT);
+
+	/* Binding 0 adds binding 2 for the same key.  Dispatch stops,
+	 * and the next press picks the new binding up, last. */
+	actions[0].add = 2;
+	actions[0].key = KEY_A;
+	actions[0].modifier = MODIFIER_ALT;
+
+	press_key(KEY_A, MODIFIER_ALT);
+	CHECK_RAN(0);
+
+	actions[0].add = -1;
+	press_key(KEY_A, MODIFIER_ALT);
+	CHECK_RAN(0, 1, 2);
+
+	teardown();
+}
+
+TEST(bindings_other_keys_added_during_dispatch)
+{
+	int i;
+
+	setup();
+
+	/* Enough new bindings to make the index grow while it is being
+	 * dispatched from. */
+	add_key(0, KEY_A, 0);
+	actions[0].key = KEY_B;
+	for (i = 1; i < 20; i++) {
+		actions[0].add = i;
+		press_key(KEY_A, 0);
+		CHECK_RAN(0);
+	}
+
+	actions[0].add = -1;
+	press_key(KEY_B, 0);
+	assert(nran == 19);
+	for (i = 0; i < nran; i++)
+		assert(ran[i] == i + 1);
+
+	teardown();
+}
+
+TEST(bindings_button_axis_debug)
+{
+	struct weston_binding *b;
+
+	setup();
+
+	b = weston_compositor_add_button_binding(&compositor, BTN_LEFT,
+						 MODIFIER_SUPER,
+						 button_handler, action(0));
+	assert(b);
+	b = weston_compositor_add_button_binding(&compositor, BTN_LEFT,
+						 MODIFIER_SUPER |
+						 MODIFIER_SHIFT,
+						 button_handler, action(1));
+	assert(b);
+	b = weston_compositor_add_axis_binding(&compositor,
+					       WL_POINTER_AXIS_VERTICAL_SCROLL,
+					       MODIFIER_SUPER,
+					       axis_handler, action(2));
+	assert(b);
+	b = weston_compositor_add_debug_binding(&compositor, KEY_R,
+						key_handler, action(3));
+	assert(b);
+	b = weston_compositor_add_debug_binding(&compositor, KEY_R,
+						key_handler, action(4));
+	assert(b);
+
+	/* Each kind has its own index: the same code in another table
+	 * doesn't match. */
+	seat.modifier_state = MODIFIER_SUPER;
+	weston_compositor_run_button_binding(&compositor, &seat, 0, BTN_LEFT,
+					     WL_POINTER_BUTTON_STATE_PRESSED);
+	CHECK_RAN(0);
+
+	nran = 0;
+	weston_compositor_run_button_binding(&compositor, &seat, 0, BTN_LEFT,
+					     WL_POINTER_BUTTON_STATE_RELEASED);
+	assert(nran == 0);
+
+	weston_compositor_run_axis_binding(&compositor, &seat, 0,
+					   WL_POINTER_AXIS_VERTICAL_SCROLL,
+					   wl_fixed_from_int(10));
+	CHECK_RAN(2);
+
+	/* Debug bindings ignore the modifiers and report how many ran. */
+	nran = 0;
+	assert(weston_compositor_run_debug_binding(&compositor, &seat, 0,
+						   KEY_R,
+						   WL_KEYBOARD_KEY_STATE_PRESSED)
+	       == 2);
+	CHECK_RAN(3, 4);
+
+	nran = 0;
+	assert(weston_compositor_run_debug_binding(&compositor, &seat, 0,
+						   KEY_Q,
+						   WL_KEYBOARD_KEY_STATE_PRESSED)
+	       == 0);
+	assert(nran == 0);
+
+	press_key(KEY_R, MODIFIER_SUPER);
+	assert(nran == 0);
+
+	teardown();
+}
@@ -0,0 +1,49 @@
+#!/bin/sh
+#
+# Replay evdev-replay-mouse.rec, a 1 kHz mouse moving for 80 reports
+# with a click in the middle, and check what motion coalescing
+# delivers: one motion event per 16 ms frame, plus one to flush the
+# motion before each button event, moving the pointer just as far.
+
+# The recording holds struct input_event as laid out on 64 bit.
+test "$(getconf LONG_BIT)" = 64 || exit 77
+
+replay=./evdev-replay
+recording=$(dirname "$0")/evdev-replay-mouse.rec
+
+run()
+{
+	$replay "$@" "$recording" 2> /dev/null
+}
+
+# Prints the number of motion events and where they add up to.
+motion()
+{
+	run "$@" | awk '$2 == "motion" { n++; x += $3; y += $4 }
+			END { printf "%d %.3f %.3f\n", n, x, y }'
+}
+
+check()
+{
+	expected=$1
+	shift
+	result=$(motion "$@")
+	if test "$result" != "$expected"; then
+		echo "evdev-replay $*: got '$result', expected '$expected'"
+		exit 1
+	fi
+}
+
+check "80 100.000 100.000"
+check "80 100.000 100.000" --coalesce
+check "7 100.000 100.000" --frame=16 --coalesce
+
+# The press is delivered after the motion that came before it.
+run --frame=16 --coalesce | awk '
+	$2 == "motion" { last = $1 }
+	$2 == "button" && $4 == "pressed" { exit !(last == 1060) }' || {
+	echo "evdev-replay: button press not preceded by its motion"
+	exit 1
+}
+
+exit 0
@@ -0,0 +1,649 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Record the events of an evdev device and replay them offline through
+ * src/evdev.c, src/evdev-touchpad.c and src/filter.c.
+ *
+ *   evdev-replay -r /dev/input/eventN > mouse.rec
+ *   evdev-replay [options] mouse.rec
+ *
+ * A recording starts with a struct replay_header describing the device
+ * (id, name, capability bits and absinfo), followed by the raw
+ * struct input_event stream.  On replay the evdev code talks to a pipe;
+ * the ioctls it issues are answered from the header, and the event loop
+ * entry points it uses are replaced so that the touchpad timers run on
+ * the clock of the recording.  Every notify_*() call is printed to
+ * stdout, one per line, so that the traces of two builds can be diffed.
+ *
+ * Options:
+ *   --frame=MS	    deliver events in batches of MS milliseconds, the way
+ *		    they are read while the compositor is repainting;
+ *		    0 (the default) delivers every SYN_REPORT on its own
+ *   --coalesce	    enable motion coalescing ([input] coalesce_motion)
+ *   --repeat=N	    replay N times and report the average cost
+ *   --quiet	    don't print the notify_*() trace
+ *   --width=W, --height=H
+ *		    size of the output absolute devices map to
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdarg.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/input.h>
+
+#include "compositor.h"
+#include "evdev.h"
+#include "../shared/config-parser.h"
+#include "../shared/timespec-util.h"
+
+#define REPLAY_MAGIC "WREPLAY1"
+
+#ifndef EVIOCSCLOCKID
+#define EVIOCSCLOCKID _IOW('E', 0xa0, int)
+#endif
+
+struct replay_header {
+	char magic[8];
+	struct input_id id;
+	char name[256];
+	uint8_t bits[EV_CNT][KEY_CNT / 8];
+	struct input_absinfo abs[ABS_CNT];
+};
+
+struct wl_event_source {
+	struct wl_list link;
+	wl_event_loop_fd_func_t fd_func;
+	wl_event_loop_timer_func_t timer_func;
+	void *data;
+	int fd;
+	int armed;
+	uint32_t deadline;
+};
+
+static struct {
+	struct replay_header header;
+	struct input_event *events;
+	int count;
+
+	struct weston_compositor compositor;
+	struct weston_output output;
+	struct weston_mode mode;
+	struct weston_seat seat;
+	struct wl_list devices;
+	struct wl_list sources;
+	int fd[2];
+
+	uint32_t now;
+	int quiet;
+
+	struct {
+		uint64_t motion, button, key, axis, touch;
+	} notify;
+	uint64_t dispatches;
+	int64_t dispatch_nsec;
+} replay;
+
+/* ioctl() is overridden so that the evdev code, and mtdev, can query the
+ * recorded device through the read end of the pipe.  All other file
+ * descriptors go straight to the kernel. */
+WL_EXPORT int
+ioctl(int fd, unsigned long request, ...)
+{
+	struct replay_header *header = &replay.header;
+	unsigned int nr, size;
+	va_list ap;
+	void *arg;
+
+	va_start(ap, request);
+	arg = va_arg(ap, void *);
+	va_end(ap);
+
+	if (fd != replay.fd[0] || _IOC_TYPE(request) != 'E')
+		return syscall(SYS_ioctl, fd, request, arg);
+
+	nr = _IOC_NR(request);
+	size = _IOC_SIZE(request);
+
+	if (request == EVIOCGID) {
+		memcpy(arg, &header->id, sizeof header->id);
+		return 0;
+	} else if (request == EVIOCSCLOCKID) {
+		return 0;
+	} else if (nr == _IOC_NR(EVIOCGNAME(0))) {
+		size = size < sizeof header->name ? size : sizeof header->name;
+		memcpy(arg, header->name, size);
+		return strlen(header->name);
+	} else if (nr == _IOC_NR(EVIOCGKEY(0))) {
+		memset(arg, 0, size);
+		return size;
+	} else if (nr >= _IOC_NR(EVIOCGBIT(0, 0)) &&
+		   nr < _IOC_NR(EVIOCGBIT(EV_CNT, 0))) {
+		memset(arg, 0, size);
+		if (size > sizeof header->bits[0])
+			size = sizeof header->bits[0];
+		memcpy(arg, header->bits[nr - _IOC_NR(EVIOCGBIT(0, 0))], size);
+		return size;
+	} else if (nr >= _IOC_NR(EVIOCGABS(0)) &&
+		   nr < _IOC_NR(EVIOCGABS(ABS_CNT))) {
+		memcpy(arg, &header->abs[nr - _IOC_NR(EVIOCGABS(0))],
+		       sizeof header->abs[0]);
+		return 0;
+	}
+
+	errno = EINVAL;
+	return -1;
+}
+
+/* The event loop entry points evdev and the touchpad use.  Timers fire
+ * on the timestamps of the recording, see run_timers(). */
+
+WL_EXPORT struct wl_event_loop *
+wl_display_get_event_loop(struct wl_display *display)
+{
+	return NULL;
+}
+
+static struct wl_event_source *
+add_source(void *data)
+{
+	struct wl_event_source *source;
+
+	source = calloc(1, sizeof *source);
+	if (source == NULL)
+		return NULL;
+
+	source->data = data;
+	source->fd = -1;
+	wl_list_insert(replay.sources.prev, &source->link);
+
+	return source;
+}
+
+WL_EXPORT struct wl_event_source *
+wl_event_loop_add_fd(struct wl_event_loop *loop, int fd, uint32_t mask,
+		     wl_event_loop_fd_func_t func, void *data)
+{
+	struct wl_event_source *source;
+
+	source = add_source(data);
+	if (source) {
+		source->fd = fd;
+		source->fd_func = func;
+	}
+
+	return source;
+}
+
+WL_EXPORT struct wl_event_source *
+wl_event_loop_add_timer(struct wl_event_loop *loop,
+			wl_event_loop_timer_func_t func, void *data)
+{
+	struct wl_event_source *source;
+
+	source = add_source(data);
+	if (source)
+		source->timer_func = func;
+
+	return source;
+}
+
+WL_EXPORT int
+wl_event_source_timer_update(struct wl_event_source *source, int ms_delay)
+{
+	source->armed = ms_delay > 0;
+	source->deadline = replay.now + ms_delay;
+
+	return 0;
+}
+
+WL_EXPORT int
+wl_event_source_remove(struct wl_event_source *source)
+{
+	wl_list_remove(&source->link);
+	free(source);
+
+	return 0;
+}
+
+static void
+run_timers(uint32_t time)
+{
+	struct wl_event_source *source, *next;
+
+	for (;;) {
+		next = NULL;
+		wl_list_for_each(source, &replay.sources, link)
+			if (source->armed && source->deadline <= time &&
+			    (!next || source->deadline < next->deadline))
+				next = source;
+		if (!next)
+			break;
+
+		next->armed = 0;
+		replay.now = next->deadline;
+		next->timer_func(next->data);
+	}
+}
+
+/* Compositor side stubs. */
+
+WL_EXPORT uint32_t
+weston_compositor_get_time(void)
+{
+	return replay.now;
+}
+
+WL_EXPORT void
+weston_seat_init_pointer(struct weston_seat *seat)
+{
+}
+
+WL_EXPORT int
+weston_seat_init_keyboard(struct weston_seat *seat, struct xkb_keymap *keymap)
+{
+	return 0;
+}
+
+WL_EXPORT void
+weston_seat_init_touch(struct weston_seat *seat)
+{
+}
+
+WL_EXPORT int
+weston_log(const char *fmt, ...)
+{
+	va_list ap;
+	int l;
+
+	if (replay.quiet)
+		return 0;
+
+	va_start(ap, fmt);
+	l = vfprintf(stderr, fmt, ap);
+	va_end(ap);
+
+	return l;
+}
+
+WL_EXPORT int
+weston_log_continue(const char *fmt, ...)
+{
+	va_list ap;
+	int l;
+
+	if (replay.quiet)
+		return 0;
+
+	va_start(ap, fmt);
+	l = vfprintf(stderr, fmt, ap);
+	va_end(ap);
+
+	return l;
+}
+
+WL_EXPORT void
+notify_motion(struct weston_seat *seat, uint32_t time,
+	      wl_fixed_t x, wl_fixed_t y)
+{
+	replay.notify.motion++;
+	if (!replay.quiet)
+		printf("%10u motion %.3f %.3f\n", time,
+		       wl_fixed_to_double(x), wl_fixed_to_double(y));
+}
+
+WL_EXPORT void
+notify_button(struct weston_seat *seat, uint32_t time, int32_t button,
+	      enum wl_pointer_button_state state)
+{
+	replay.notify.button++;
+	if (!replay.quiet)
+		printf("%10u button %d %s\n", time, button,
+		       state == WL_POINTER_BUTTON_STATE_PRESSED ?
+		       "pressed" : "released");
+}
+
+WL_EXPORT void
+notify_axis(struct weston_seat *seat, uint32_t time, uint32_t axis,
+	    wl_fixed_t value)
+{
+	replay.notify.axis++;
+	if (!replay.quiet)
+		printf("%10u axis %u %.3f\n", time, axis,
+		       wl_fixed_to_double(value));
+}
+
+WL_EXPORT void
+notify_key(struct weston_seat *seat, uint32_t time, uint32_t key,
+	   enum wl_keyboard_key_state state,
+	   enum weston_key_state_update update_state)
+{
+	replay.notify.key++;
+	if (!replay.quiet)
+		printf("%10u key %u %s\n", time, key,
+		       state == WL_KEYBOARD_KEY_STATE_PRESSED ?
+		       "pressed" : "released");
+}
+
+WL_EXPORT void
+notify_keyboard_focus_in(struct weston_seat *seat, struct wl_array *keys,
+			 enum weston_key_state_update update_state)
+{
+}
+
+WL_EXPORT void
+notify_touch(struct weston_seat *seat, uint32_t time, int touch_id,
+	     wl_fixed_t x, wl_fixed_t y, int touch_type)
+{
+	static const char *types[] = { "down", "up", "motion" };
+
+	replay.notify.touch++;
+	if (!replay.quiet)
+		printf("%10u touch %d %.3f %.3f %s\n", time, touch_id,
+		       wl_fixed_to_double(x), wl_fixed_to_double(y),
+		       touch_type >= 0 && touch_type < 3 ?
+		       types[touch_type] : "?");
+}
+
+/* Recording. */
+
+static int
+record(const char *path)
+{
+	struct replay_header header;
+	struct input_event ev[64];
+	unsigned long *abs_bits;
+	int clockid = CLOCK_MONOTONIC;
+	int fd, i, len;
+
+	if (isatty(STDOUT_FILENO)) {
+		fprintf(stderr, "refusing to write a recording to a tty\n");
+		return -1;
+	}
+
+	fd = open(path, O_RDONLY);
+	if (fd < 0) {
+		fprintf(stderr, "failed to open %s: %m\n", path);
+		return -1;
+	}
+
+	memset(&header, 0, sizeof header);
+	memcpy(header.magic, REPLAY_MAGIC, sizeof header.magic);
+	ioctl(fd, EVIOCGID, &header.id);
+	ioctl(fd, EVIOCGNAME(sizeof header.name - 1), header.name);
+	for (i = 0; i < EV_CNT; i++)
+		ioctl(fd, EVIOCGBIT(i, sizeof header.bits[i]), header.bits[i]);
+	abs_bits = (unsigned long *) header.bits[EV_ABS];
+	for (i = 0; i < ABS_CNT; i++)
+		if (TEST_BIT(abs_bits, i))
+			ioctl(fd, EVIOCGABS(i), &header.abs[i]);
+
+	/* Same clock as the compositor, see evdev_device_create(). */
+	ioctl(fd, EVIOCSCLOCKID, &clockid);
+
+	if (write(STDOUT_FILENO, &header, sizeof header) != sizeof header)
+		return -1;
+
+	fprintf(stderr, "recording %s (%s), ^C to stop\n", path, header.name);
+
+	while (len = read(fd, ev, sizeof ev), len > 0)
+		if (write(STDOUT_FILENO, ev, len) != len)
+			return -1;
+
+	return 0;
+}
+
+/* Replay. */
+
+static int
+load(const char *path)
+{
+	FILE *fp;
+	long size;
+
+	fp = fopen(path, "r");
+	if (fp == NULL) {
+		fprintf(stderr, "failed to open %s: %m\n", path);
+		return -1;
+	}
+
+	if (fread(&replay.header, sizeof replay.header, 1, fp) != 1 ||
+	    memcmp(replay.header.magic, REPLAY_MAGIC,
+		   sizeof replay.header.magic) != 0) {
+		fprintf(stderr, "%s is not an evdev recording\n", path);
+		fclose(fp);
+		return -1;
+	}
+
+	fseek(fp, 0, SEEK_END);
+	size = ftell(fp) - sizeof replay.header;
+	fseek(fp, sizeof replay.header, SEEK_SET);
+
+	replay.count = size / sizeof replay.events[0];
+	replay.events = malloc(replay.count * sizeof replay.events[0]);
+	if (replay.events == NULL ||
+	    fread(replay.events, sizeof replay.events[0],
+		  replay.count, fp) != (size_t) replay.count) {
+		fprintf(stderr, "failed to read %s\n", path);
+		fclose(fp);
+		return -1;
+	}
+
+	fclose(fp);
+
+	return 0;
+}
+
+static uint32_t
+event_time(const struct input_event *e)
+{
+	return e->time.tv_sec * 1000 + e->time.tv_usec / 1000;
+}
+
+/* Call evdev_device_data() the way the input loop would once the
+ * events have become readable. */
+static void
+dispatch(void)
+{
+	struct wl_event_source *source;
+	struct timespec begin, end;
+
+	wl_list_for_each(source, &replay.sources, link) {
+		if (source->fd != replay.fd[0])
+			continue;
+
+		clock_gettime(CLOCK_MONOTONIC, &begin);
+		source->fd_func(source->fd, WL_EVENT_READABLE, source->data);
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		replay.dispatch_nsec += timespec_sub_to_nsec(&end, &begin);
+		replay.dispatches++;
+		break;
+	}
+}
+
+static void
+deliver(struct input_event *ev, int count)
+{
+	int len, size = count * sizeof *ev;
+	char *p = (char *) ev;
+
+	while (size > 0) {
+		len = write(replay.fd[1], p, size);
+		if (len < 0 && errno == EAGAIN) {
+			/* Pipe full, let evdev drain it. */
+			dispatch();
+			continue;
+		} else if (len < 0) {
+			fprintf(stderr, "write to pipe failed: %m\n");
+			exit(EXIT_FAILURE);
+		}
+		p += len;
+		size -= len;
+	}
+
+	dispatch();
+}
+
+static int
+replay_once(const char *path, int frame_ms)
+{
+	struct evdev_device *device;
+	struct input_event *e, *end, *batch;
+	uint32_t frame_end = 0;
+
+	if (pipe(replay.fd) < 0) {
+		fprintf(stderr, "failed to create pipe: %m\n");
+		return -1;
+	}
+	fcntl(replay.fd[0], F_SETFL, O_NONBLOCK);
+	fcntl(replay.fd[1], F_SETFL, O_NONBLOCK);
+
+	device = evdev_device_create(&replay.seat, path, replay.fd[0]);
+	if (device == NULL || device == EVDEV_UNHANDLED_DEVICE) {
+		fprintf(stderr, "evdev doesn't handle %s\n",
+			replay.header.name);
+		close(replay.fd[0]);
+		close(replay.fd[1]);
+		return -1;
+	}
+	wl_list_insert(&replay.devices, &device->link);
+
+	batch = replay.events;
+	end = replay.events + replay.count;
+	for (e = replay.events; e < end; e++) {
+		if (frame_ms > 0 && e == batch)
+			frame_end = (event_time(e) / frame_ms + 1) * frame_ms;
+
+		if (e->type != EV_SYN || e->code != SYN_REPORT)
+			continue;
+
+		/* Reports arrive whole, so a batch always ends on one. */
+		if (frame_ms > 0 && e + 1 < end &&
+		    event_time(e + 1) < frame_end)
+			continue;
+
+		replay.now = frame_ms > 0 ? frame_end : event_time(e);
+		run_timers(replay.now);
+		deliver(batch, e + 1 - batch);
+		batch = e + 1;
+	}
+
+	if (batch < end) {
+		replay.now = event_time(end - 1);
+		deliver(batch, end - batch);
+	}
+	run_timers(UINT32_MAX);
+
+	if (!replay.quiet)
+		evdev_device_log_stats(device);
+
+	evdev_device_destroy(device);
+	close(replay.fd[1]);
+
+	return 0;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int32_t record_mode = 0, frame_ms = 0, coalesce = 0;
+	int32_t repeat = 1, quiet = 0, width = 1024, height = 768;
+	uint64_t notified;
+	int i;
+
+	const struct weston_option options[] = {
+		{ WESTON_OPTION_BOOLEAN, "record", 'r', &record_mode },
+		{ WESTON_OPTION_INTEGER, "frame", 'f', &frame_ms },
+		{ WESTON_OPTION_BOOLEAN, "coalesce", 'c', &coalesce },
+		{ WESTON_OPTION_INTEGER, "repeat", 'n', &repeat },
+		{ WESTON_OPTION_BOOLEAN, "quiet", 'q', &quiet },
+		{ WESTON_OPTION_INTEGER, "width", 0, &width },
+		{ WESTON_OPTION_INTEGER, "height", 0, &height },
+	};
+
+	replay.fd[0] = -1;
+	replay.fd[1] = -1;
+
+	parse_options(options, ARRAY_LENGTH(options), &argc, argv);
+
+	if (argc != 2) {
+		fprintf(stderr, "usage: %s -r DEVICE > FILE\n"
+			"       %s [--frame=MS] [--coalesce] [--repeat=N] "
+			"[--quiet] [--width=W] [--height=H] FILE\n",
+			argv[0], argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	if (record_mode)
+		return record(argv[1]) < 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+
+	if (load(argv[1]) < 0)
+		return EXIT_FAILURE;
+
+	wl_list_init(&replay.devices);
+	wl_list_init(&replay.sources);
+	wl_list_init(&replay.compositor.output_list);
+	replay.compositor.focus = 1;
+	replay.compositor.coalesce_motion = coalesce;
+	replay.mode.width = width;
+	replay.mode.height = height;
+	replay.output.current = &replay.mode;
+	wl_list_insert(&replay.compositor.output_list, &replay.output.link);
+	replay.seat.compositor = &replay.compositor;
+	replay.quiet = quiet;
+
+	for (i = 0; i < repeat; i++) {
+		if (replay_once(argv[1], frame_ms) < 0)
+			return EXIT_FAILURE;
+		replay.quiet = 1;
+	}
+
+	notified = replay.notify.motion + replay.notify.button +
+		replay.notify.key + replay.notify.axis + replay.notify.touch;
+
+	fprintf(stderr, "%d events, %llu dispatches, %llu notifications "
+		"(%llu motion, %llu button, %llu key, %llu axis, %llu touch)\n",
+		replay.count * repeat,
+		(unsigned long long) replay.dispatches,
+		(unsigned long long) notified,
+		(unsigned long long) replay.notify.motion,
+		(unsigned long long) replay.notify.button,
+		(unsigned long long) replay.notify.key,
+		(unsigned long long) replay.notify.axis,
+		(unsigned long long) replay.notify.touch);
+	if (replay.count > 0)
+		fprintf(stderr, "%.1f ns per event, %.1f ns per dispatch\n",
+			(double) replay.dispatch_nsec / replay.count / repeat,
+			(double) replay.dispatch_nsec / replay.dispatches);
+
+	free(replay.events);
+
+	return EXIT_SUCCESS;
+}
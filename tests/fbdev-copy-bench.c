@@ -0,0 +1,328 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Compare the fbdev backend's shadow to frame buffer copy
+ * (src/fbdev-copy.c) against compositing every damage rect with
+ * pixman, which is what the backend used to do.  The frame buffer is a
+ * shared mapping of a memfd, so the numbers show the cost of the write
+ * pattern but not the extra penalty a write-combined mapping puts on
+ * scattered writes; run it on the target for those.
+ *
+ * Options:
+ *   --width=W, --height=H   frame buffer size (1024x768)
+ *   --bpp=16|32             frame buffer depth (32)
+ *   --padding=BYTES         extra bytes at the end of each fb line (0)
+ *   --iterations=N          frames per scene (500)
+ */
+
+#define _GNU_SOURCE
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <pixman.h>
+
+#include "fbdev-copy.h"
+#include "../shared/config-parser.h"
+#include "../shared/timespec-util.h"
+
+#define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
+
+struct bench {
+	int width, height, cpp, fb_stride;
+	pixman_format_code_t format;
+	size_t fb_size;
+	uint8_t *fb;
+	uint8_t *reference;
+	pixman_image_t *fb_image;
+	pixman_image_t *shadow;
+};
+
+static int
+create_fake_fb(size_t size)
+{
+	char path[] = "/tmp/fbdev-copy-bench-XXXXXX";
+	int fd;
+
+#ifdef __NR_memfd_create
+	fd = syscall(__NR_memfd_create, "fake-fb", 0);
+	if (fd >= 0)
+		goto out;
+#endif
+
+	fd = mkstemp(path);
+	if (fd < 0)
+		return -1;
+	unlink(path);
+
+out:
+	if (ftruncate(fd, size) < 0) {
+		close(fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+static void
+scene_full(struct bench *b, pixman_region32_t *region)
+{
+	pixman_region32_init_rect(region, 0, 0, b->width, b->height);
+}
+
+/* A terminal scrolling text: every other cell row gets a few runs of
+ * 8x16 glyphs, plus a cursor. */
+static void
+scene_terminal(struct bench *b, pixman_region32_t *region)
+{
+	int row, run;
+
+	pixman_region32_init(region);
+	for (row = 0; row + 16 <= b->height; row += 32)
+		for (run = 0; run < 4; run++)
+			pixman_region32_union_rect(region, region,
+						   run * 200 + row % 64,
+						   row, 8 * (5 + run * 3), 16);
+	pixman_region32_union_rect(region, region, 400, 320, 8, 16);
+}
+
+/* Two side by side windows updating, a few pixels apart. */
+static void
+scene_columns(struct bench *b, pixman_region32_t *region)
+{
+	pixman_region32_init_rect(region, 0, 32,
+				  b->width / 2 - 4, b->height - 64);
+	pixman_region32_union_rect(region, region, b->width / 2 + 4, 32,
+				   b->width / 2 - 4, b->height - 64);
+}
+
+/* Small rects all over the screen, like icons or a busy panel. */
+static void
+scene_scattered(struct bench *b, pixman_region32_t *region)
+{
+	unsigned int seed = 1;
+	int i, x, y;
+
+	pixman_region32_init(region);
+	for (i = 0; i < 64; i++) {
+		seed = seed * 1103515245 + 12345;
+		x = (seed >> 8) % (b->width - 32);
+		seed = seed * 1103515245 + 12345;
+		y = (seed >> 8) % (b->height - 32);
+		pixman_region32_union_rect(region, region, x, y, 32, 32);
+	}
+}
+
+static const struct {
+	const char *name;
+	void (*create)(struct bench *b, pixman_region32_t *region);
+} scenes[] = {
+	{ "full", scene_full },
+	{ "terminal", scene_terminal },
+	{ "columns", scene_columns },
+	{ "scattered", scene_scattered },
+};
+
+static size_t
+copy_pixman(struct bench *b, pixman_region32_t *region)
+{
+	pixman_box32_t *rects;
+	size_t written = 0;
+	int i, n;
+
+	rects = pixman_region32_rectangles(region, &n);
+	for (i = 0; i < n; i++) {
+		pixman_image_composite32(PIXMAN_OP_SRC,
+					 b->shadow, NULL, b->fb_image,
+					 rects[i].x1, rects[i].y1,
+					 0, 0,
+					 rects[i].x1, rects[i].y1,
+					 rects[i].x2 - rects[i].x1,
+					 rects[i].y2 - rects[i].y1);
+		written += (size_t) (rects[i].x2 - rects[i].x1) *
+			(rects[i].y2 - rects[i].y1) * b->cpp;
+	}
+
+	return written;
+}
+
+static size_t
+copy_engine(struct bench *b, pixman_region32_t *region)
+{
+	return fbdev_copy_region(b->fb, b->fb_stride, b->shadow, region);
+}
+
+/* Damaged pixels must match the shadow; everything else must either
+ * be untouched or, where the engine bridged a gap, match the shadow,
+ * which holds the complete frame. */
+static int
+verify(struct bench *b, pixman_region32_t *region)
+{
+	uint8_t *shadow = (uint8_t *) pixman_image_get_data(b->shadow);
+	int shadow_stride = pixman_image_get_stride(b->shadow);
+	uint8_t *fb, *s, *ref;
+	int x, y;
+
+	for (y = 0; y < b->height; y++) {
+		for (x = 0; x < b->width; x++) {
+			fb = b->fb + y * b->fb_stride + x * b->cpp;
+			s = shadow + y * shadow_stride + x * b->cpp;
+			ref = b->reference + y * b->fb_stride + x * b->cpp;
+
+			if (memcmp(fb, s, b->cpp) == 0)
+				continue;
+			if (!pixman_region32_contains_point(region, x, y,
+							    NULL) &&
+			    memcmp(fb, ref, b->cpp) == 0)
+				continue;
+
+			fprintf(stderr, "mismatch at %d,%d\n", x, y);
+			return -1;
+		}
+	}
+
+	return 0;
+}
+
+static double
+run(struct bench *b, pixman_region32_t *region, int iterations,
+    size_t (*copy)(struct bench *b, pixman_region32_t *region),
+    size_t *written)
+{
+	struct timespec start, end;
+	int i;
+
+	memcpy(b->fb, b->reference, b->fb_size);
+	*written = copy(b, region);
+	if (verify(b, region) < 0)
+		exit(EXIT_FAILURE);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < iterations; i++)
+		copy(b, region);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return timespec_sub_to_nsec(&end, &start) / 1000.0 / iterations;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int32_t width = 1024, height = 768, bpp = 32, padding = 0;
+	int32_t iterations = 500;
+	struct bench b;
+	pixman_region32_t region;
+	size_t old_bytes, new_bytes;
+	double old_us, new_us;
+	uint32_t *p;
+	unsigned int i, npixels;
+	int fd, nrects;
+
+	const struct weston_option options[] = {
+		{ WESTON_OPTION_INTEGER, "width", 0, &width },
+		{ WESTON_OPTION_INTEGER, "height", 0, &height },
+		{ WESTON_OPTION_INTEGER, "bpp", 0, &bpp },
+		{ WESTON_OPTION_INTEGER, "padding", 0, &padding },
+		{ WESTON_OPTION_INTEGER, "iterations", 'n', &iterations },
+	};
+
+	parse_options(options, ARRAY_LENGTH(options), &argc, argv);
+
+	if (argc != 1 || (bpp != 16 && bpp != 32) ||
+	    width < 64 || height < 64 || padding < 0 || iterations < 1) {
+		fprintf(stderr, "usage: %s [--width=W] [--height=H] "
+			"[--bpp=16|32] [--padding=BYTES] [--iterations=N]\n",
+			argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	memset(&b, 0, sizeof b);
+	b.width = width;
+	b.height = height;
+	b.cpp = bpp / 8;
+	b.format = bpp == 16 ? PIXMAN_r5g6b5 : PIXMAN_x8r8g8b8;
+	b.fb_stride = (width * b.cpp + padding + 3) & ~3;
+	b.fb_size = (size_t) b.fb_stride * height;
+
+	fd = create_fake_fb(b.fb_size);
+	if (fd < 0) {
+		fprintf(stderr, "failed to create fake frame buffer: %m\n");
+		return EXIT_FAILURE;
+	}
+
+	b.fb = mmap(NULL, b.fb_size, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    fd, 0);
+	if (b.fb == MAP_FAILED) {
+		fprintf(stderr, "failed to map fake frame buffer: %m\n");
+		return EXIT_FAILURE;
+	}
+
+	b.fb_image = pixman_image_create_bits(b.format, width, height,
+					      (uint32_t *) b.fb, b.fb_stride);
+	b.shadow = pixman_image_create_bits(b.format, width, height,
+					    NULL, 0);
+	b.reference = malloc(b.fb_size);
+	if (!b.fb_image || !b.shadow || !b.reference) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	p = pixman_image_get_data(b.shadow);
+	npixels = pixman_image_get_stride(b.shadow) / 4 * height;
+	for (i = 0; i < npixels; i++)
+		p[i] = i * 2654435761u;
+	memset(b.reference, 0x5a, b.fb_size);
+
+	printf("%dx%d, %d bpp, fb stride %d, %d iterations\n",
+	       width, height, bpp, b.fb_stride, iterations);
+	printf("%-10s %6s %12s %12s %12s %12s %8s\n",
+	       "scene", "rects", "pixman us", "engine us",
+	       "pixman B", "engine B", "speedup");
+
+	for (i = 0; i < ARRAY_LENGTH(scenes); i++) {
+		scenes[i].create(&b, &region);
+		pixman_region32_rectangles(&region, &nrects);
+
+		old_us = run(&b, &region, iterations, copy_pixman, &old_bytes);
+		new_us = run(&b, &region, iterations, copy_engine, &new_bytes);
+
+		printf("%-10s %6d %12.1f %12.1f %12zu %12zu %7.2fx\n",
+		       scenes[i].name, nrects, old_us, new_us,
+		       old_bytes, new_bytes, old_us / new_us);
+
+		pixman_region32_fini(&region);
+	}
+
+	pixman_image_unref(b.fb_image);
+	pixman_image_unref(b.shadow);
+	free(b.reference);
+	munmap(b.fb, b.fb_size);
+	close(fd);
+
+	return EXIT_SUCCESS;
+}
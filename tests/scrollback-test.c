@@ -0,0 +1,235 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "weston-test-runner.h"
+#include "../clients/scrollback.h"
+
+/* Laid out like weston-terminal's cells. */
+union cell_text {
+	unsigned char byte[4];
+	unsigned int ch;
+};
+
+struct cell_attr {
+	unsigned char fg, bg;
+	char a, s;
+};
+
+static const struct cell_attr fill = { 7, 0, 0, 0 };
+
+static const char *glyphs[] = {
+	"a", "Z", "~", "\xc3\xa9", "\xe2\x82\xac", "\xf0\x9f\x90\xa7",
+};
+
+#define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
+
+/* Fill a row from 'seed': runs of attributes, one to four byte UTF-8,
+ * empty cells in the middle and a varying number of trailing empty
+ * cells. */
+static void
+make_row(union cell_text *text, struct cell_attr *attr, int width,
+	 unsigned int seed)
+{
+	struct cell_attr current = { 0, 0, 0, 0 };
+	const char *g;
+	int i, used;
+
+	memset(text, 0, width * sizeof *text);
+	used = width - seed % (width / 2 + 1);
+
+	for (i = 0; i < width; i++) {
+		seed = seed * 1103515245 + 12345;
+		if ((seed >> 16) % 5 == 0) {
+			current.fg = (seed >> 8) % 16;
+			current.bg = (seed >> 12) % 16;
+			current.a = (seed >> 20) % 4;
+		}
+		attr[i] = current;
+
+		if (i >= used || (seed >> 24) % 7 == 0)
+			continue;
+		g = glyphs[(seed >> 4) % ARRAY_LENGTH(glyphs)];
+		memcpy(text[i].byte, g, strlen(g));
+	}
+}
+
+static void
+check_row(struct scrollback *sb, int n, int width, unsigned int seed)
+{
+	union cell_text *text, *expect_text;
+	struct cell_attr *attr, *expect_attr;
+
+	text = malloc(width * sizeof *text);
+	attr = malloc(width * sizeof *attr);
+	expect_text = malloc(width * sizeof *expect_text);
+	expect_attr = malloc(width * sizeof *expect_attr);
+	assert(text && attr && expect_text && expect_attr);
+
+	make_row(expect_text, expect_attr, width, seed);
+	assert(scrollback_get(sb, n, text, attr, width, &fill) == 0);
+	assert(memcmp(text, expect_text, width * sizeof *text) == 0);
+	assert(memcmp(attr, expect_attr, width * sizeof *attr) == 0);
+
+	free(text);
+	free(attr);
+	free(expect_text);
+	free(expect_attr);
+}
+
+static void
+push_row(struct scrollback *sb, int width, unsigned int seed)
+{
+	union cell_text text[4096];
+	struct cell_attr attr[4096];
+
+	make_row(text, attr, width, seed);
+	scrollback_push(sb, text, attr, width);
+}
+
+TEST(scrollback_round_trip)
+{
+	struct scrollback *sb;
+	int i;
+
+	sb = scrollback_create(1000);
+	assert(sb);
+	assert(scrollback_rows(sb) == 0);
+
+	for (i = 0; i < 500; i++)
+		push_row(sb, 80, i);
+	assert(scrollback_rows(sb) == 500);
+
+	/* Row 0 is the one pushed last. */
+	for (i = 0; i < 500; i++)
+		check_row(sb, i, 80, 499 - i);
+
+	scrollback_destroy(sb);
+}
+
+TEST(scrollback_width_change)
+{
+	union cell_text text[120], expect_text[120];
+	struct cell_attr attr[120], expect_attr[120];
+	struct scrollback *sb;
+	int i;
+
+	sb = scrollback_create(10);
+	push_row(sb, 80, 1);
+
+	/* Reading back wider fills with empty cells and fill_attr. */
+	make_row(expect_text, expect_attr, 80, 1);
+	assert(scrollback_get(sb, 0, text, attr, 120, &fill) == 0);
+	assert(memcmp(text, expect_text, 80 * sizeof *text) == 0);
+	assert(memcmp(attr, expect_attr, 80 * sizeof *attr) == 0);
+	for (i = 80; i < 120; i++) {
+		assert(text[i].ch == 0);
+		assert(memcmp(&attr[i], &fill, sizeof fill) == 0);
+	}
+
+	/* Reading back narrower truncates. */
+	assert(scrollback_get(sb, 0, text, attr, 40, &fill) == 0);
+	assert(memcmp(text, expect_text, 40 * sizeof *text) == 0);
+	assert(memcmp(attr, expect_attr, 40 * sizeof *attr) == 0);
+
+	scrollback_destroy(sb);
+}
+
+TEST(scrollback_blank_rows)
+{
+	union cell_text text[40], blank[40];
+	struct cell_attr attr[40];
+	struct scrollback *sb;
+	int i;
+
+	memset(blank, 0, sizeof blank);
+	for (i = 0; i < 40; i++)
+		attr[i] = fill;
+
+	sb = scrollback_create(10);
+	scrollback_push(sb, blank, attr, 40);
+	assert(scrollback_get(sb, 0, text, attr, 40, &fill) == 0);
+	assert(memcmp(text, blank, sizeof text) == 0);
+
+	assert(scrollback_get(sb, 1, text, attr, 40, &fill) == -1);
+	assert(scrollback_get(sb, -1, text, attr, 40, &fill) == -1);
+
+	scrollback_destroy(sb);
+}
+
+TEST(scrollback_eviction)
+{
+	struct scrollback *sb;
+	size_t memory;
+	int i;
+
+	/* Enough rows to go through several chunks, so whole chunks get
+	 * dropped and reused. */
+	sb = scrollback_create(100);
+	for (i = 0; i < 10000; i++) {
+		push_row(sb, 80, i);
+		assert(scrollback_rows(sb) == (i < 100 ? i + 1 : 100));
+	}
+
+	for (i = 0; i < 100; i++)
+		check_row(sb, i, 80, 9999 - i);
+	assert(scrollback_get(sb, 100, NULL, NULL, 80, &fill) == -1);
+
+	memory = scrollback_memory(sb);
+	for (; i < 20000; i++)
+		push_row(sb, 80, i);
+	assert(scrollback_memory(sb) == memory);
+
+	scrollback_destroy(sb);
+}
+
+TEST(scrollback_wide_rows)
+{
+	struct scrollback *sb;
+	int i;
+
+	/* Rows wide enough that chunks fill up by size first. */
+	sb = scrollback_create(50);
+	for (i = 0; i < 200; i++)
+		push_row(sb, 4096, i);
+	assert(scrollback_rows(sb) == 50);
+
+	for (i = 0; i < 50; i++)
+		check_row(sb, i, 4096, 199 - i);
+
+	scrollback_destroy(sb);
+}
+
+TEST(scrollback_disabled)
+{
+	struct scrollback *sb;
+
+	sb = scrollback_create(0);
+	push_row(sb, 80, 1);
+	assert(scrollback_rows(sb) == 0);
+
+	scrollback_destroy(sb);
+}
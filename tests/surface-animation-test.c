@@ -0,0 +1,111 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <assert.h>
+
+#include "../src/compositor.h"
+
+/* Start a zoom, a fade and a slide, and let the outputs run them to the
+ * end.  The first frame of each runs right away, on the current time. */
+
+struct animation_test {
+	struct weston_compositor *compositor;
+	struct wl_event_source *timeout;
+	int done;
+};
+
+static void
+animation_done(struct weston_surface_animation *animation, void *data)
+{
+	struct animation_test *test = data;
+
+	fprintf(stderr, "animation %d done\n", test->done);
+	if (++test->done == 3)
+		wl_display_terminate(test->compositor->wl_display);
+}
+
+static int
+animation_timeout(void *data)
+{
+	fprintf(stderr, "animations didn't finish\n");
+	abort();
+
+	return 0;
+}
+
+static struct weston_surface *
+create_surface(struct weston_compositor *compositor)
+{
+	struct weston_surface *surface;
+
+	surface = weston_surface_create(compositor);
+	assert(surface);
+	weston_surface_configure(surface, 10, 10, 100, 100);
+	weston_surface_update_transform(surface);
+	assert(surface->output);
+
+	return surface;
+}
+
+static void
+surface_animation(void *data)
+{
+	struct animation_test *test = data;
+	struct weston_compositor *compositor = test->compositor;
+	struct weston_surface *surface;
+
+	assert(weston_zoom_run(create_surface(compositor), 0.8, 1.0,
+			       animation_done, test));
+
+	surface = create_surface(compositor);
+	assert(weston_fade_run(surface, 0.0, 1.0, 200.0,
+			       animation_done, test));
+	assert(surface->alpha == 0.0);
+
+	assert(weston_slide_run(create_surface(compositor), -100, 0,
+				animation_done, test));
+
+	assert(test->done == 0);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor,
+	    int *argc, char *argv[], const char *config_file)
+{
+	struct wl_event_loop *loop;
+	struct animation_test *test;
+
+	test = calloc(1, sizeof *test);
+	if (!test)
+		return -1;
+	test->compositor = compositor;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+	wl_event_loop_add_idle(loop, surface_animation, test);
+	test->timeout = wl_event_loop_add_timer(loop, animation_timeout, test);
+	wl_event_source_timer_update(test->timeout, 10000);
+
+	return 0;
+}
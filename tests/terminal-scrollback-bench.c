@@ -0,0 +1,266 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/*
+ * Feed rows through the weston-terminal history (clients/scrollback.c)
+ * the way a terminal scrolling a big log would, and report the push
+ * throughput, the memory the history settles at and the cost of
+ * reading rows back while scrolled back.
+ *
+ * Options:
+ *   --size=MIB      amount of text to push (1024)
+ *   --width=COLS    terminal width (120)
+ *   --lines=N       history depth (10000)
+ *   --file=PATH     push the lines of PATH, over and over, instead of
+ *                   generated log lines
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <time.h>
+
+#include "../clients/scrollback.h"
+#include "../shared/config-parser.h"
+#include "../shared/timespec-util.h"
+
+#define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
+
+/* Rows are generated up front and cycled through, so the timed loop
+ * only pushes. */
+#define POOL_ROWS	4096
+
+/* Laid out like weston-terminal's cells. */
+struct cell_attr {
+	unsigned char fg, bg;
+	char a, s;
+};
+
+struct source {
+	char *file;
+	size_t file_size, file_pos;
+	unsigned int seed, line;
+};
+
+static const char *levels[] = { "DEBUG", "INFO", "WARN", "ERROR" };
+static const char *words[] = {
+	"compositor", "output", "repaint", "surface", "buffer", "commit",
+	"frame", "seat", "keyboard", "focus", "damage", "region", "0x7f3a",
+	"done", "failed", "retrying", "connected", "-", "ms", "[ok]",
+};
+
+static unsigned int
+next_random(struct source *src)
+{
+	src->seed = src->seed * 1103515245 + 12345;
+
+	return src->seed >> 8;
+}
+
+/* Write the next line into 'line' and return its length. */
+static int
+next_line(struct source *src, char *line, int max)
+{
+	const char *w;
+	int len, n, i;
+
+	if (src->file) {
+		for (len = 0; len < max; len++) {
+			if (src->file_pos == src->file_size)
+				src->file_pos = 0;
+			if (src->file[src->file_pos] == '\n') {
+				src->file_pos++;
+				break;
+			}
+			line[len] = src->file[src->file_pos++];
+		}
+		return len;
+	}
+
+	len = snprintf(line, max, "2013-05-%02u %02u:%02u:%02u.%03u %-5s ",
+		       src->line / 86400 % 28 + 1, src->line / 3600 % 24,
+		       src->line / 60 % 60, src->line % 60,
+		       next_random(src) % 1000,
+		       levels[next_random(src) % ARRAY_LENGTH(levels)]);
+	src->line++;
+
+	n = next_random(src) % 12;
+	for (i = 0; i < n && len < max; i++) {
+		w = words[next_random(src) % ARRAY_LENGTH(words)];
+		len += snprintf(line + len, max - len, "%s ", w);
+	}
+
+	return len < max ? len : max;
+}
+
+/* Lay a line out in cells: ASCII bytes one to a cell, the level field
+ * coloured, the rest in the default colours. */
+static void
+fill_row(const char *line, int len, uint8_t *text, struct cell_attr *attr,
+	 int width)
+{
+	struct cell_attr plain = { 7, 0, 0, 0 };
+	int i;
+
+	memset(text, 0, (size_t) width * 4);
+	for (i = 0; i < width; i++)
+		attr[i] = plain;
+
+	for (i = 0; i < len && i < width; i++)
+		text[i * 4] = line[i];
+
+	if (len > 29 && width > 29) {
+		for (i = 24; i < 29; i++) {
+			attr[i].fg = line[24] == 'E' ? 1 : 3;
+			attr[i].a = 1;
+		}
+	}
+}
+
+static char *
+read_file(const char *path, size_t *size)
+{
+	FILE *fp;
+	char *data;
+	long length;
+
+	fp = fopen(path, "rb");
+	if (!fp)
+		return NULL;
+
+	fseek(fp, 0, SEEK_END);
+	length = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	data = length > 0 ? malloc(length) : NULL;
+	if (data && fread(data, 1, length, fp) != (size_t) length) {
+		free(data);
+		data = NULL;
+	}
+	fclose(fp);
+
+	*size = length;
+
+	return data;
+}
+
+int
+main(int argc, char *argv[])
+{
+	int32_t size_mib = 1024, width = 120, lines = 10000;
+	char *file = NULL;
+	struct source src;
+	struct scrollback *sb;
+	struct timespec start, end;
+	struct cell_attr *attr, fill = { 7, 0, 0, 0 };
+	uint8_t *text;
+	char *line;
+	int *length;
+	uint64_t bytes = 0, total, rows = 0;
+	int64_t push_nsec, get_nsec;
+	int i, n, gets = 1000000;
+
+	const struct weston_option options[] = {
+		{ WESTON_OPTION_INTEGER, "size", 0, &size_mib },
+		{ WESTON_OPTION_INTEGER, "width", 0, &width },
+		{ WESTON_OPTION_INTEGER, "lines", 0, &lines },
+		{ WESTON_OPTION_STRING, "file", 0, &file },
+	};
+
+	parse_options(options, ARRAY_LENGTH(options), &argc, argv);
+
+	if (argc != 1 || size_mib < 1 || width < 1 || lines < 1) {
+		fprintf(stderr, "usage: %s [--size=MIB] [--width=COLS] "
+			"[--lines=N] [--file=PATH]\n", argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	memset(&src, 0, sizeof src);
+	src.seed = 1;
+	if (file) {
+		src.file = read_file(file, &src.file_size);
+		if (!src.file) {
+			fprintf(stderr, "failed to read %s\n", file);
+			return EXIT_FAILURE;
+		}
+	}
+
+	text = malloc((size_t) width * 4 * POOL_ROWS);
+	attr = malloc(width * sizeof *attr * POOL_ROWS);
+	length = malloc(POOL_ROWS * sizeof *length);
+	line = malloc(width + 1);
+	sb = scrollback_create(lines);
+	if (!text || !attr || !length || !line || !sb) {
+		fprintf(stderr, "out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	for (i = 0; i < POOL_ROWS; i++) {
+		length[i] = next_line(&src, line, width);
+		fill_row(line, length[i], text + (size_t) i * width * 4,
+			 attr + (size_t) i * width, width);
+	}
+
+	total = (uint64_t) size_mib * 1024 * 1024;
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; bytes < total; i = (i + 1) % POOL_ROWS) {
+		scrollback_push(sb, text + (size_t) i * width * 4,
+				attr + (size_t) i * width, width);
+		bytes += length[i] + 1;
+		rows++;
+	}
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	push_nsec = timespec_sub_to_nsec(&end, &start);
+
+	n = scrollback_rows(sb);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < gets; i++)
+		scrollback_get(sb, (next_random(&src) % n), text, attr,
+			       width, &fill);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	get_nsec = timespec_sub_to_nsec(&end, &start);
+
+	printf("%d columns, %d lines of history\n", width, lines);
+	printf("pushed %llu rows, %.1f MiB of text\n",
+	       (unsigned long long) rows, bytes / (1024.0 * 1024.0));
+	printf("push: %.1f MiB/s, %.0f rows/s, %.1f ns/row\n",
+	       bytes / (1024.0 * 1024.0) / (push_nsec / 1e9),
+	       rows / (push_nsec / 1e9), (double) push_nsec / rows);
+	printf("memory: %.1f KiB for %d rows (%.1f bytes/row, "
+	       "uncompressed %zu bytes/row)\n",
+	       scrollback_memory(sb) / 1024.0, n,
+	       (double) scrollback_memory(sb) / n,
+	       (size_t) width * (4 + sizeof *attr));
+	printf("get: %.1f ns/row\n", (double) get_nsec / gets);
+
+	scrollback_destroy(sb);
+	free(src.file);
+	free(text);
+	free(attr);
+	free(length);
+	free(line);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,172 @@
+/*
+ * Copyright © 2013 Intel Corporation
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <assert.h>
+#include <math.h>
+
+#include "weston-test-runner.h"
+#include "vertex-clipping.h"
+
+#define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
+
+static void
+make_quad(struct polygon8 *quad, float x1, float y1, float x2, float y2,
+	  float phi)
+{
+	const float x[4] = { x1, x2, x2, x1 };
+	const float y[4] = { y1, y1, y2, y2 };
+	float s = sinf(phi), c = cosf(phi);
+	int i;
+
+	for (i = 0; i < 4; i++) {
+		quad->x[i] = c * x[i] + s * y[i];
+		quad->y[i] = -s * x[i] + c * y[i];
+	}
+	quad->n = 4;
+}
+
+static int
+has_vertex(const float *x, const float *y, int n, float px, float py)
+{
+	int i;
+
+	for (i = 0; i < n; i++)
+		if (fabsf(x[i] - px) < 1e-3f && fabsf(y[i] - py) < 1e-3f)
+			return 1;
+
+	return 0;
+}
+
+TEST(clip_untransformed)
+{
+	struct polygon8 quad;
+	pixman_box32_t box = { 5, -5, 15, 5 };
+	float ex[8], ey[8];
+	int n;
+
+	make_quad(&quad, 0, 0, 10, 10, 0.0f);
+	n = clip_quad(&quad, 0, &box, ex, ey);
+
+	assert(n == 4);
+	assert(has_vertex(ex, ey, n, 5, 0));
+	assert(has_vertex(ex, ey, n, 10, 0));
+	assert(has_vertex(ex, ey, n, 10, 5));
+	assert(has_vertex(ex, ey, n, 5, 5));
+}
+
+TEST(clip_outside)
+{
+	struct polygon8 quad;
+	pixman_box32_t box = { 20, 20, 30, 30 };
+	float ex[8], ey[8];
+
+	make_quad(&quad, 0, 0, 10, 10, 0.0f);
+	assert(clip_quad(&quad, 0, &box, ex, ey) == 0);
+
+	/* Inside the bounding box of the rotated quad, but outside the
+	 * quad itself. */
+	make_quad(&quad, -10, -10, 10, 10, M_PI / 4);
+	box.x1 = 10;
+	box.y1 = 10;
+	box.x2 = 14;
+	box.y2 = 14;
+	assert(clip_quad(&quad, 1, &box, ex, ey) == 0);
+}
+
+TEST(clip_octagon)
+{
+	struct polygon8 quad;
+	pixman_box32_t box = { -10, -10, 10, 10 };
+	float ex[8], ey[8];
+	int n;
+
+	/* A square rotated by 45 degrees with its corners sticking out of
+	 * every side of the box. */
+	make_quad(&quad, -12, -12, 12, 12, M_PI / 4);
+	n = clip_quad(&quad, 1, &box, ex, ey);
+
+	assert(n == 8);
+	assert(has_vertex(ex, ey, n, -10, 16.9706f - 10));
+	assert(has_vertex(ex, ey, n, 16.9706f - 10, -10));
+}
+
+TEST(clip_inside)
+{
+	struct polygon8 quad;
+	pixman_box32_t box = { -2, -2, 2, 2 };
+	float ex[8], ey[8];
+	int n, counts[1];
+
+	make_quad(&quad, -10, -10, 10, 10, 0.3f);
+	n = clip_quad(&quad, 1, &box, ex, ey);
+	assert(n == 4);
+
+	n = clip_quad_boxes(&quad, 1, &box, 1, ex, ey, counts);
+	assert(n == 1);
+	assert(counts[0] == 4);
+	assert(has_vertex(ex, ey, 4, -2, -2));
+	assert(has_vertex(ex, ey, 4, 2, -2));
+	assert(has_vertex(ex, ey, 4, 2, 2));
+	assert(has_vertex(ex, ey, 4, -2, 2));
+}
+
+TEST(clip_batch_matches_single)
+{
+	static const float angles[] = { 0.0f, 0.3f, M_PI / 4, 2.0f, -1.0f };
+	pixman_box32_t boxes[144];
+	float ex[8], ey[8], bx[144 * 8], by[144 * 8];
+	int counts[144];
+	struct polygon8 quad;
+	int i, j, k, n, npolygons, off, transformed;
+
+	for (i = 0; i < 12; i++) {
+		for (j = 0; j < 12; j++) {
+			boxes[i * 12 + j].x1 = j * 8 - 48;
+			boxes[i * 12 + j].y1 = i * 8 - 48;
+			boxes[i * 12 + j].x2 = j * 8 - 48 + 7;
+			boxes[i * 12 + j].y2 = i * 8 - 48 + 7;
+		}
+	}
+
+	for (k = 0; k < (int) ARRAY_LENGTH(angles); k++) {
+		transformed = angles[k] != 0.0f;
+		make_quad(&quad, -30, -20, 30, 20, angles[k]);
+		npolygons = clip_quad_boxes(&quad, transformed,
+					    boxes, 144, bx, by, counts);
+
+		off = 0;
+		j = 0;
+		for (i = 0; i < 144; i++) {
+			n = clip_quad(&quad, transformed, &boxes[i], ex, ey);
+			if (n == 0)
+				continue;
+
+			assert(j < npolygons);
+			assert(counts[j] == n);
+			while (n--)
+				assert(has_vertex(ex, ey, counts[j],
+						  bx[off + n], by[off + n]));
+			off += counts[j++];
+		}
+		assert(j == npolygons);
+	}
+}